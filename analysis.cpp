@@ -0,0 +1,518 @@
+#include "analysis.h"
+#include "parallel.h"
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+
+namespace {
+const std::size_t FILTER_BLOCK_CHANNELS = 64;
+
+bool same(const LowPassSettings &a, const LowPassSettings &b) {
+  return a.enabled == b.enabled && a.cutoffHz == b.cutoffHz &&
+         a.order == b.order && a.zeroPhase == b.zeroPhase;
+}
+
+bool same(const EnvelopeSettings &a, const EnvelopeSettings &b) {
+  return a.enabled == b.enabled && a.mode == b.mode &&
+         a.windowSeconds == b.windowSeconds;
+}
+
+bool sameFeatures(const DetectionSettings &a, const DetectionSettings &b) {
+  return a.windowSeconds == b.windowSeconds && a.stepSeconds == b.stepSeconds;
+}
+
+bool sameIntervals(const DetectionSettings &a, const DetectionSettings &b) {
+  return a.thresholdRatio == b.thresholdRatio &&
+         a.mergeGapSeconds == b.mergeGapSeconds &&
+         a.seizureMinSeconds == b.seizureMinSeconds &&
+         a.seMinSeconds == b.seMinSeconds;
+}
+
+bool same(const SpikeSettings &a, const SpikeSettings &b) {
+  return a.thresholdSigmas == b.thresholdSigmas &&
+         a.refractorySeconds == b.refractorySeconds &&
+         a.bothPolarities == b.bothPolarities;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+}
+
+void AnalysisGraph::setSource(std::vector<ChannelData> channels,
+                              double samplingRate,
+                              std::vector<ChannelQuality> quality) {
+  // Drop every cached output first, so the old recording is freed before the
+  // new one is processed
+  filtered.reset();
+  envelopeData.clear();
+  envelopesDropped = false;
+  featuresRestored = false;
+  spikesRestored = false;
+  features = DetectionFeatures();
+  channelEvents.clear();
+  spikeIndex = std::make_shared<SpikeIndex>();
+  for (Stage *stage : {&filterStage, &envelopeStage, &featureStage,
+                       &intervalStage, &spikeStage}) {
+    stage->stamps.clear();
+    stage->inputs.clear();
+  }
+
+  source = std::make_shared<std::vector<ChannelData>>(std::move(channels));
+  rate = samplingRate;
+  sourceStage.stamps.assign(source->size(), ++lastStamp);
+  ++sourceStage.version;
+  channelQuality = std::move(quality);
+  if (!channelQuality.empty()) {
+    classifyChannels(channelQuality, qualitySettings);
+  }
+  channelMask = usableMask(channelQuality);
+}
+
+void AnalysisGraph::setQualitySettings(const QualitySettings &settings) {
+  qualitySettings = settings;
+  if (!channelQuality.empty()) {
+    classifyChannels(channelQuality, qualitySettings);
+    channelMask = usableMask(channelQuality);
+  }
+}
+
+template <typename Drop>
+std::vector<char> AnalysisGraph::plan(Stage &stage,
+                                      const std::vector<uint64_t> &upstream,
+                                      bool reset, Drop drop, int &count) {
+  std::size_t n = upstream.size();
+  if (stage.stamps.size() != n) {
+    stage.stamps.assign(n, 0);
+    stage.inputs.assign(n, 0);
+  }
+  std::vector<char> todo(n, 0);
+  count = 0;
+  for (std::size_t c = 0; c < n; ++c) {
+    if (!channelUsable(channelMask, c)) {
+      if (stage.stamps[c] != 0) {
+        drop(c);
+        stage.stamps[c] = 0;
+        ++stage.version;
+      }
+    } else if (reset || stage.stamps[c] == 0 ||
+               stage.inputs[c] != upstream[c]) {
+      todo[c] = 1;
+      ++count;
+    }
+  }
+  return todo;
+}
+
+void AnalysisGraph::finish(Stage &stage, const std::vector<char> &todo,
+                           const std::vector<uint64_t> &upstream,
+                           const char *name, int count, double seconds) {
+  uint64_t stamp = ++lastStamp;
+  for (std::size_t c = 0; c < todo.size(); ++c) {
+    if (todo[c]) {
+      stage.stamps[c] = stamp;
+      stage.inputs[c] = upstream[c];
+    }
+  }
+  ++stage.version;
+  runs.push_back({name, count, seconds});
+}
+
+void AnalysisGraph::updateFilter() {
+  if (!source)
+    return;
+
+  // Without a filter the stage passes the source through untouched
+  if (!lowPass.enabled) {
+    if (filtered != source || filterStage.stamps != sourceStage.stamps) {
+      filtered = source;
+      filterStage.stamps = sourceStage.stamps;
+      filterStage.inputs = sourceStage.stamps;
+      ++filterStage.version;
+    }
+    filteredWith = lowPass;
+    return;
+  }
+
+  // Rejects a cutoff the rate cannot hold before anything is changed
+  std::vector<Biquad> sections =
+      butterworthLowPass(lowPass.order, lowPass.cutoffHz, rate);
+  bool reset = !same(lowPass, filteredWith) || filtered == source;
+  filteredWith = lowPass;
+  if (filtered == source || !filtered) {
+    filtered = std::make_shared<std::vector<ChannelData>>(*source);
+    filterStage.stamps.clear();
+  }
+  int count = 0;
+  // Masked channels keep whatever signal they have, for display
+  std::vector<char> todo =
+      plan(filterStage, sourceStage.stamps, reset, [](std::size_t) {}, count);
+  if (count == 0)
+    return;
+  if (filtered.use_count() > 1) {
+    // A plot load still reads the old signals
+    filtered = std::make_shared<std::vector<ChannelData>>(*filtered);
+  }
+
+  ScopedTrace trace("filter");
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::size_t> used;
+  for (std::size_t c = 0; c < todo.size(); ++c) {
+    if (todo[c]) {
+      (*filtered)[c].signal = (*source)[c].signal;
+      used.push_back(c);
+    }
+  }
+  std::size_t blocks =
+      (used.size() + FILTER_BLOCK_CHANNELS - 1) / FILTER_BLOCK_CHANNELS;
+  parallelFor(blocks, [&](std::size_t block) {
+    std::size_t first = block * FILTER_BLOCK_CHANNELS;
+    std::size_t last = std::min(used.size(), first + FILTER_BLOCK_CHANNELS);
+    std::vector<double *> signals;
+    std::size_t length = (*filtered)[used[first]].signal.size();
+    for (std::size_t i = first; i < last; ++i) {
+      std::vector<double> &signal = (*filtered)[used[i]].signal;
+      signals.push_back(signal.data());
+      length = std::min(length, signal.size());
+    }
+    FilterBank bank(sections, static_cast<int>(signals.size()));
+    filterChannels(bank, signals, length);
+    if (lowPass.zeroPhase) {
+      filterChannelsReverse(bank, signals, length);
+    }
+  });
+  finish(filterStage, todo, sourceStage.stamps, "filter", count,
+         secondsSince(start));
+}
+
+void AnalysisGraph::updateEnvelopes() {
+  updateFilter();
+  bool reset = !same(envelope, envelopedWith);
+  envelopedWith = envelope;
+  int count = 0;
+  std::vector<char> todo = plan(
+      envelopeStage, filterStage.stamps, reset,
+      [this](std::size_t c) { std::vector<double>().swap(envelopeData[c]); },
+      count);
+  if (count == 0)
+    return;
+
+  ScopedTrace trace("envelope");
+  auto start = std::chrono::steady_clock::now();
+  computeEnvelopes(*filtered, todo, envelope, rate, envelopeData);
+  finish(envelopeStage, todo, filterStage.stamps, "envelope", count,
+         secondsSince(start));
+}
+
+bool AnalysisGraph::keepRestored(bool &restored, Stage &stage,
+                                 bool settingsHold) {
+  if (!restored)
+    return false;
+  if (settingsHold && channelMask == restoredMask)
+    return true;
+  // Every usable channel is redone from the signals
+  restored = false;
+  std::fill(stage.stamps.begin(), stage.stamps.end(), 0);
+  return false;
+}
+
+void AnalysisGraph::updateFeatures() {
+  if (keepRestored(featuresRestored, featureStage,
+                   same(lowPass, restoredLowPass) &&
+                       same(envelope, restoredEnvelope) &&
+                       sameFeatures(detection, featuresWith)))
+    return;
+  updateEnvelopes();
+  bool reset = !sameFeatures(detection, featuresWith);
+  featuresWith = detection;
+  int count = 0;
+  std::vector<char> todo = plan(
+      featureStage, envelopeStage.stamps, reset,
+      [this](std::size_t c) { features.values[c].clear(); }, count);
+  if (count == 0)
+    return;
+
+  ScopedTrace trace("features");
+  restoreEnvelopes(todo);
+  auto start = std::chrono::steady_clock::now();
+  computeFeatures(*filtered, todo, envelopeData, rate, detection, features);
+  finish(featureStage, todo, envelopeStage.stamps, "features", count,
+         secondsSince(start));
+}
+
+void AnalysisGraph::updateIntervals() {
+  updateFeatures();
+  bool reset = !sameIntervals(detection, intervalsWith);
+  intervalsWith = detection;
+  int count = 0;
+  std::vector<char> todo = plan(
+      intervalStage, featureStage.stamps, reset,
+      [this](std::size_t c) { channelEvents[c] = ChannelEvents(); }, count);
+  if (count == 0)
+    return;
+
+  ScopedTrace trace("intervals");
+  auto start = std::chrono::steady_clock::now();
+  detectIntervals(features, todo, detection, channelEvents);
+  finish(intervalStage, todo, featureStage.stamps, "intervals", count,
+         secondsSince(start));
+}
+
+void AnalysisGraph::updateOrdering() {
+  updateIntervals();
+  if (orderedVersion == intervalStage.version)
+    return;
+
+  ScopedTrace trace("order/propagate");
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::pair<int, int>> positions(source->size(), {-1, -1});
+  for (std::size_t c = 0; c < source->size(); ++c) {
+    const std::vector<int> &name = (*source)[c].name;
+    if (name.size() >= 2) {
+      positions[c] = {name[0] - 1, name[1] - 1};
+    }
+  }
+  propagationEngine.setChannels(channelEvents, std::move(positions));
+  orderingEngine.setChannels(channelEvents,
+                             propagationEngine.recordingEvents());
+  orderedVersion = intervalStage.version;
+  runs.push_back({"order/propagate", static_cast<int>(source->size()),
+                  secondsSince(start)});
+}
+
+void AnalysisGraph::updateSpikes() {
+  if (keepRestored(spikesRestored, spikeStage,
+                   same(lowPass, restoredLowPass) &&
+                       same(spikeSettings, spikesWith)))
+    return;
+  updateFilter();
+  bool reset = !same(spikeSettings, spikesWith);
+  spikesWith = spikeSettings;
+  int count = 0;
+  // The lists are copied out of the index only when something changes, and
+  // a new index is built around them; views keep the old one until then
+  std::vector<std::vector<uint32_t>> lists;
+  bool taken = false;
+  auto take = [&]() {
+    if (!taken) {
+      lists = spikeIndex->channelSpikes();
+      lists.resize(source->size());
+      taken = true;
+    }
+  };
+  std::vector<char> todo = plan(
+      spikeStage, filterStage.stamps, reset,
+      [&](std::size_t c) {
+        take();
+        std::vector<uint32_t>().swap(lists[c]);
+      },
+      count);
+  if (count > 0) {
+    take();
+    ScopedTrace trace("spikes");
+    auto start = std::chrono::steady_clock::now();
+    detectChannelSpikes(*filtered, todo, rate, spikeSettings, lists);
+    finish(spikeStage, todo, filterStage.stamps, "spikes", count,
+           secondsSince(start));
+  }
+  if (taken) {
+    spikeIndex = std::make_shared<SpikeIndex>(std::move(lists), rate);
+  }
+}
+
+const std::vector<ChannelData> &AnalysisGraph::channels() {
+  static const std::vector<ChannelData> none;
+  updateFilter();
+  return filtered ? *filtered : none;
+}
+
+std::shared_ptr<const std::vector<ChannelData>>
+AnalysisGraph::channelsSnapshot() {
+  updateFilter();
+  return filtered;
+}
+
+const std::vector<std::vector<double>> &AnalysisGraph::envelopes() {
+  if (source) {
+    updateEnvelopes();
+    if (envelopesDropped) {
+      restoreEnvelopes(std::vector<char>(envelopeData.size(), 1));
+      envelopesDropped = false;
+    }
+  }
+  return envelopeData;
+}
+
+void AnalysisGraph::restoreEnvelopes(const std::vector<char> &needed) {
+  if (!envelopesDropped || !envelopedWith.enabled)
+    return;
+  std::vector<char> missing(envelopeData.size(), 0);
+  bool any = false;
+  for (std::size_t c = 0; c < missing.size() && c < needed.size(); ++c) {
+    if (needed[c] && envelopeStage.stamps[c] != 0 &&
+        envelopeData[c].empty()) {
+      missing[c] = 1;
+      any = true;
+    }
+  }
+  if (any) {
+    ScopedTrace trace("restore envelopes");
+    computeEnvelopes(*filtered, missing, envelopedWith, rate, envelopeData);
+  }
+}
+
+void AnalysisGraph::dropEnvelopes() {
+  for (std::vector<double> &envelope : envelopeData) {
+    std::vector<double>().swap(envelope);
+  }
+  envelopesDropped = true;
+}
+
+std::size_t AnalysisGraph::channelBytes() const {
+  std::size_t bytes = 0;
+  for (const auto *signals : {source.get(), filtered.get()}) {
+    if (!signals || (signals == filtered.get() && filtered == source))
+      continue;
+    for (const ChannelData &channel : *signals) {
+      bytes += channel.signal.capacity() * sizeof(double);
+    }
+  }
+  return bytes;
+}
+
+std::size_t AnalysisGraph::analysisBytes() const {
+  std::size_t bytes = 0;
+  for (const std::vector<double> &envelope : envelopeData) {
+    bytes += envelope.capacity() * sizeof(double);
+  }
+  for (const std::vector<double> &values : features.values) {
+    bytes += values.capacity() * sizeof(double);
+  }
+  // Per-channel offsets, then time-sorted offsets and channel ids
+  for (const std::vector<uint32_t> &spikes : spikeIndex->channelSpikes()) {
+    bytes += spikes.capacity() * sizeof(uint32_t);
+  }
+  bytes += spikeIndex->size() * (sizeof(uint32_t) + sizeof(uint16_t));
+  return bytes;
+}
+
+const std::vector<ChannelEvents> &AnalysisGraph::events() {
+  if (source) {
+    updateIntervals();
+  }
+  return channelEvents;
+}
+
+std::shared_ptr<const SpikeIndex> AnalysisGraph::spikes() {
+  if (source) {
+    updateSpikes();
+  }
+  return spikeIndex;
+}
+
+PropagationEngine &AnalysisGraph::propagation() {
+  if (source) {
+    updateOrdering();
+  }
+  return propagationEngine;
+}
+
+OrderingEngine &AnalysisGraph::ordering() {
+  if (source) {
+    updateOrdering();
+  }
+  return orderingEngine;
+}
+
+uint64_t AnalysisGraph::channelsVersion() {
+  updateFilter();
+  return filterStage.version;
+}
+
+uint64_t AnalysisGraph::eventsVersion() {
+  events();
+  return intervalStage.version;
+}
+
+uint64_t AnalysisGraph::spikesVersion() {
+  spikes();
+  return spikeStage.version;
+}
+
+AnalysisResults AnalysisGraph::results() {
+  AnalysisResults saved;
+  if (!source)
+    return saved;
+  updateIntervals();
+  saved.samplingRate = rate;
+  for (const ChannelData &channel : *source) {
+    saved.names.push_back(channel.name);
+  }
+  saved.quality = channelQuality;
+  saved.mask = channelMask;
+  saved.lowPass = featuresRestored ? restoredLowPass : filteredWith;
+  saved.envelope = featuresRestored ? restoredEnvelope : envelopedWith;
+  saved.detection = detection;
+  saved.features = features;
+  saved.events = channelEvents;
+  // Only spikes that were asked for, so saving never detects them
+  if (!spikeStage.stamps.empty()) {
+    updateSpikes();
+    saved.hasSpikes = true;
+    saved.spikeSettings = spikeSettings;
+    saved.spikes = spikeIndex->channelSpikes();
+  }
+  return saved;
+}
+
+bool AnalysisGraph::restore(const AnalysisResults &saved) {
+  std::size_t n = source ? source->size() : 0;
+  if (n == 0 || saved.samplingRate != rate || saved.events.size() != n ||
+      saved.features.values.size() != n ||
+      (!saved.mask.empty() && saved.mask.size() != n) ||
+      (saved.hasSpikes && saved.spikes.size() != n))
+    return false;
+
+  restoredLowPass = saved.lowPass;
+  restoredEnvelope = saved.envelope;
+  restoredMask = saved.mask;
+
+  uint64_t featureStamp = ++lastStamp;
+  featureStage.stamps.assign(n, 0);
+  featureStage.inputs.assign(n, 0);
+  uint64_t intervalStamp = ++lastStamp;
+  intervalStage.stamps.assign(n, 0);
+  intervalStage.inputs.assign(n, 0);
+  for (std::size_t c = 0; c < n; ++c) {
+    if (channelUsable(saved.mask, c)) {
+      featureStage.stamps[c] = featureStamp;
+      intervalStage.stamps[c] = intervalStamp;
+      intervalStage.inputs[c] = featureStamp;
+    }
+  }
+  features = saved.features;
+  featuresWith = saved.detection;
+  channelEvents = saved.events;
+  intervalsWith = saved.detection;
+  featuresRestored = true;
+  ++featureStage.version;
+  ++intervalStage.version;
+
+  if (saved.hasSpikes) {
+    spikeStage.stamps = featureStage.stamps;
+    spikeStage.inputs.assign(n, 0);
+    spikesWith = saved.spikeSettings;
+    spikeIndex = std::make_shared<SpikeIndex>(saved.spikes, rate);
+    spikesRestored = true;
+    ++spikeStage.version;
+  }
+  return true;
+}
+
+std::vector<StageRun> AnalysisGraph::takeRuns() {
+  std::vector<StageRun> taken;
+  taken.swap(runs);
+  return taken;
+}
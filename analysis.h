@@ -0,0 +1,183 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include "brwreader.h"
+#include "channelquality.h"
+#include "detector.h"
+#include "envelope.h"
+#include "filterbank.h"
+#include "ordering.h"
+#include "propagation.h"
+#include "spikeindex.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Wall-clock time of one stage run over the channels it had to redo.
+struct StageRun {
+  std::string stage;
+  int channels;
+  double seconds;
+};
+
+// Stage outputs together with the settings they were computed with, for
+// saving and restoring a recording's analysis without its signals
+struct AnalysisResults {
+  double samplingRate = 0.0;
+  std::vector<std::vector<int>> names;
+  std::vector<ChannelQuality> quality;
+  std::vector<char> mask;
+  LowPassSettings lowPass;
+  EnvelopeSettings envelope;
+  DetectionSettings detection;
+  DetectionFeatures features;
+  std::vector<ChannelEvents> events;
+  // Spikes are only kept once they have been detected
+  bool hasSpikes = false;
+  SpikeSettings spikeSettings;
+  std::vector<std::vector<uint32_t>> spikes;
+};
+
+// The analysis pipeline as a graph of stages:
+//
+//   source -> filter -> envelope -> features -> intervals -> order/propagate
+//                    \-> spikes
+//
+// Each stage keeps, per channel, a stamp for its output and the upstream
+// stamp the output was built from, plus the settings it last ran with.
+// Pulling an output brings its stage up to date by redoing only the usable
+// channels whose input or settings changed: a new detection threshold
+// reruns intervals from the cached features, and a channel that becomes
+// usable is filtered, enveloped and detected alone. Masked channels have no
+// output past the filter. Dirtiness is tracked per channel, not per time
+// range: every setting and every new source covers the whole recording, so
+// a stage input never changes over part of the time axis alone, and a pass
+// publishes all of its channels at once rather than the visible ones first.
+class AnalysisGraph {
+public:
+  // The loader's output, re-referenced and mean-corrected
+  void setSource(std::vector<ChannelData> channels, double samplingRate,
+                 std::vector<ChannelQuality> quality);
+  void setQualitySettings(const QualitySettings &settings);
+  void setLowPass(const LowPassSettings &settings) { lowPass = settings; }
+  void setEnvelope(const EnvelopeSettings &settings) { envelope = settings; }
+  void setDetection(const DetectionSettings &settings) {
+    detection = settings;
+  }
+  void setSpikeSettings(const SpikeSettings &settings) {
+    spikeSettings = settings;
+  }
+
+  bool empty() const { return !source || source->empty(); }
+  double samplingRate() const { return rate; }
+  const std::vector<ChannelQuality> &quality() const { return channelQuality; }
+  // Empty when the source came without quality results
+  const std::vector<char> &mask() const { return channelMask; }
+
+  // Filtered signals; the source itself while the low-pass is disabled
+  const std::vector<ChannelData> &channels();
+  // The same signals for reading on another thread. Later stage runs never
+  // modify a vector that is still shared.
+  std::shared_ptr<const std::vector<ChannelData>> channelsSnapshot();
+  const std::vector<std::vector<double>> &envelopes();
+  const std::vector<ChannelEvents> &events();
+  // Held by views as it is; a later run replaces it rather than changing it
+  std::shared_ptr<const SpikeIndex> spikes();
+  PropagationEngine &propagation();
+  OrderingEngine &ordering();
+
+  // Bumped whenever the matching output changes, so views can tell when to
+  // republish. Each brings its output up to date first.
+  uint64_t channelsVersion();
+  uint64_t eventsVersion();
+  uint64_t spikesVersion();
+
+  // Stage runs since the last call
+  std::vector<StageRun> takeRuns();
+
+  // The current outputs, brought up to date first
+  AnalysisResults results();
+  // Installs saved outputs for the current source. While the settings and
+  // mask they were computed with still hold, the features, intervals and
+  // spikes are served from them without pulling the signals through the
+  // filter and envelope; a changed threshold reruns the intervals from the
+  // saved features. Returns false when they belong to another recording.
+  bool restore(const AnalysisResults &saved);
+
+  // Bytes held by the source and filtered signals, and by the stage outputs
+  std::size_t channelBytes() const;
+  std::size_t analysisBytes() const;
+  // Frees the envelopes without invalidating anything downstream. They are
+  // rebuilt with the settings they had, for just the channels a later run
+  // needs, or all at once by envelopes().
+  void dropEnvelopes();
+
+private:
+  struct Stage {
+    // Zero where the channel has no output
+    std::vector<uint64_t> stamps;
+    std::vector<uint64_t> inputs;
+    uint64_t version = 0;
+  };
+
+  template <typename Drop>
+  std::vector<char> plan(Stage &stage, const std::vector<uint64_t> &upstream,
+                         bool reset, Drop drop, int &count);
+  void finish(Stage &stage, const std::vector<char> &todo,
+              const std::vector<uint64_t> &upstream, const char *name,
+              int count, double seconds);
+  void updateFilter();
+  void updateEnvelopes();
+  void updateFeatures();
+  void updateIntervals();
+  void updateOrdering();
+  void updateSpikes();
+  void restoreEnvelopes(const std::vector<char> &needed);
+  bool keepRestored(bool &restored, Stage &stage, bool settingsHold);
+
+  uint64_t lastStamp = 0;
+  std::vector<StageRun> runs;
+
+  std::shared_ptr<std::vector<ChannelData>> source;
+  double rate = 0.0;
+  Stage sourceStage;
+  QualitySettings qualitySettings;
+  std::vector<ChannelQuality> channelQuality;
+  std::vector<char> channelMask;
+
+  LowPassSettings lowPass, filteredWith;
+  std::shared_ptr<std::vector<ChannelData>> filtered;
+  Stage filterStage;
+
+  EnvelopeSettings envelope, envelopedWith;
+  std::vector<std::vector<double>> envelopeData;
+  Stage envelopeStage;
+  bool envelopesDropped = false;
+
+  DetectionSettings detection, featuresWith, intervalsWith;
+  DetectionFeatures features;
+  Stage featureStage;
+  std::vector<ChannelEvents> channelEvents;
+  Stage intervalStage;
+
+  PropagationEngine propagationEngine;
+  OrderingEngine orderingEngine;
+  uint64_t orderedVersion = 0;
+
+  SpikeSettings spikeSettings, spikesWith;
+  // Also holds the per-channel spike lists the stage updates
+  std::shared_ptr<const SpikeIndex> spikeIndex =
+      std::make_shared<SpikeIndex>();
+  Stage spikeStage;
+
+  // Set by restore() until a change falls back to running the stages
+  bool featuresRestored = false;
+  bool spikesRestored = false;
+  LowPassSettings restoredLowPass;
+  EnvelopeSettings restoredEnvelope;
+  std::vector<char> restoredMask;
+};
+
+#endif // ANALYSIS_H
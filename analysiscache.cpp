@@ -0,0 +1,429 @@
+#include "analysiscache.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+const char MAGIC[8] = {'M', 'E', 'A', 'C', 'A', 'C', 'H', 'E'};
+
+enum SectionId : uint32_t {
+  SETTINGS = 1,
+  NAMES,
+  QUALITY,
+  MASK,
+  FEATURE_OFFSETS,
+  FEATURE_VALUES,
+  EVENTS,
+  SPIKE_OFFSETS,
+  SPIKE_SAMPLES
+};
+const uint32_t SECTION_COUNT = 9;
+const std::size_t SETTINGS_VALUES = 19;
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t sections;
+  uint64_t sourceKey;
+  double samplingRate;
+  uint64_t channels;
+};
+
+struct TableEntry {
+  uint32_t id;
+  uint32_t elementSize;
+  uint64_t offset;
+  uint64_t count;
+};
+
+struct NameRecord {
+  int32_t row;
+  int32_t col;
+};
+
+struct QualityRecord {
+  double stdMv;
+  double saturationFraction;
+  double longestFlatSeconds;
+  double lineNoiseFraction;
+  uint64_t usable;
+};
+
+struct EventRecord {
+  uint32_t channel;
+  // 0 for a seizure, 1 for SE
+  uint32_t kind;
+  double start;
+  double stop;
+};
+
+struct Section {
+  uint32_t id;
+  uint32_t elementSize;
+  uint64_t count;
+  // Written back to back
+  std::vector<std::pair<const void *, std::size_t>> chunks;
+};
+
+uint64_t align8(uint64_t bytes) { return (bytes + 7) & ~uint64_t(7); }
+
+void hashBytes(uint64_t &hash, const void *data, std::size_t size) {
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  for (std::size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+  }
+}
+
+template <typename T> void hashValue(uint64_t &hash, T value) {
+  hashBytes(hash, &value, sizeof(value));
+}
+
+// Read-only mapping of a whole file; empty when it does not exist
+class MappedFile {
+public:
+  explicit MappedFile(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return;
+    struct stat info;
+    if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+      void *mapped = ::mmap(nullptr, static_cast<std::size_t>(info.st_size),
+                            PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped != MAP_FAILED) {
+        bytes = static_cast<const char *>(mapped);
+        length = static_cast<std::size_t>(info.st_size);
+      }
+    }
+    ::close(fd);
+  }
+  ~MappedFile() {
+    if (bytes) {
+      ::munmap(const_cast<char *>(bytes), length);
+    }
+  }
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const char *data() const { return bytes; }
+  std::size_t size() const { return length; }
+
+private:
+  const char *bytes = nullptr;
+  std::size_t length = 0;
+};
+
+// Section id of a mapped cache as a typed array, checked against the file
+template <typename T>
+const T *section(const MappedFile &file, const TableEntry *table,
+                 uint32_t sections, uint32_t id, uint64_t count) {
+  for (uint32_t i = 0; i < sections; ++i) {
+    const TableEntry &entry = table[i];
+    if (entry.id != id)
+      continue;
+    if (entry.elementSize != sizeof(T) || entry.count != count ||
+        entry.offset % 8 != 0 || entry.offset > file.size() ||
+        count > (file.size() - entry.offset) / sizeof(T)) {
+      throw std::runtime_error("Analysis cache section " +
+                               std::to_string(id) + " is malformed");
+    }
+    return reinterpret_cast<const T *>(file.data() + entry.offset);
+  }
+  throw std::runtime_error("Analysis cache section " + std::to_string(id) +
+                           " is missing");
+}
+
+uint64_t sectionCount(const TableEntry *table, uint32_t sections,
+                      uint32_t id) {
+  for (uint32_t i = 0; i < sections; ++i) {
+    if (table[i].id == id)
+      return table[i].count;
+  }
+  throw std::runtime_error("Analysis cache section " + std::to_string(id) +
+                           " is missing");
+}
+}
+
+std::string analysisCachePath(const std::string &recordingPath) {
+  return recordingPath + ".analysis";
+}
+
+uint64_t analysisSourceKey(const std::string &recordingPath,
+                           const ReferenceSettings &reference) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  hashValue(hash, ANALYSIS_CACHE_VERSION);
+  hashValue(hash, static_cast<uint64_t>(
+                      std::filesystem::file_size(recordingPath)));
+  hashValue(hash, static_cast<int64_t>(
+                      std::filesystem::last_write_time(recordingPath)
+                          .time_since_epoch()
+                          .count()));
+  hashValue(hash, static_cast<int>(reference.mode));
+  hashValue(hash, reference.blankArtifacts);
+  hashValue(hash, reference.artifactThresholdMv);
+  hashValue(hash, reference.artifactPaddingSeconds);
+  return hash;
+}
+
+void writeAnalysisCache(const std::string &path, uint64_t sourceKey,
+                        const AnalysisResults &results) {
+  const std::size_t n = results.events.size();
+  if (results.features.values.size() != n || results.names.size() != n ||
+      (results.hasSpikes && results.spikes.size() != n)) {
+    throw std::runtime_error("Analysis results do not cover every channel");
+  }
+
+  const AnalysisResults &r = results;
+  double settings[SETTINGS_VALUES] = {
+      static_cast<double>(r.lowPass.enabled),
+      r.lowPass.cutoffHz,
+      static_cast<double>(r.lowPass.order),
+      static_cast<double>(r.lowPass.zeroPhase),
+      static_cast<double>(r.envelope.enabled),
+      static_cast<double>(static_cast<int>(r.envelope.mode)),
+      r.envelope.windowSeconds,
+      r.detection.windowSeconds,
+      r.detection.stepSeconds,
+      r.detection.thresholdRatio,
+      r.detection.mergeGapSeconds,
+      r.detection.seizureMinSeconds,
+      r.detection.seMinSeconds,
+      r.features.stepSeconds,
+      r.features.windowSeconds,
+      static_cast<double>(r.hasSpikes),
+      r.spikeSettings.thresholdSigmas,
+      r.spikeSettings.refractorySeconds,
+      static_cast<double>(r.spikeSettings.bothPolarities)};
+
+  std::vector<NameRecord> names(n);
+  for (std::size_t c = 0; c < n; ++c) {
+    const std::vector<int> &name = r.names[c];
+    names[c] = {name.size() > 0 ? name[0] : 0, name.size() > 1 ? name[1] : 0};
+  }
+  std::vector<QualityRecord> quality;
+  for (const ChannelQuality &q : r.quality) {
+    quality.push_back({q.stdMv, q.saturationFraction, q.longestFlatSeconds,
+                       q.lineNoiseFraction, q.usable});
+  }
+  std::vector<uint64_t> featureOffsets(n + 1, 0);
+  std::vector<EventRecord> events;
+  std::vector<uint64_t> spikeOffsets(r.hasSpikes ? n + 1 : 1, 0);
+  for (std::size_t c = 0; c < n; ++c) {
+    featureOffsets[c + 1] = featureOffsets[c] + r.features.values[c].size();
+    for (const Region &region : r.events[c].seizures) {
+      events.push_back({static_cast<uint32_t>(c), 0, region.start,
+                        region.stop});
+    }
+    for (const Region &region : r.events[c].se) {
+      events.push_back({static_cast<uint32_t>(c), 1, region.start,
+                        region.stop});
+    }
+    if (r.hasSpikes) {
+      spikeOffsets[c + 1] = spikeOffsets[c] + r.spikes[c].size();
+    }
+  }
+
+  std::vector<Section> sections(SECTION_COUNT);
+  sections[0] = {SETTINGS, sizeof(double), SETTINGS_VALUES,
+                 {{settings, sizeof(settings)}}};
+  sections[1] = {NAMES, sizeof(NameRecord), n,
+                 {{names.data(), n * sizeof(NameRecord)}}};
+  sections[2] = {QUALITY, sizeof(QualityRecord), quality.size(),
+                 {{quality.data(), quality.size() * sizeof(QualityRecord)}}};
+  sections[3] = {MASK, 1, r.mask.size(), {{r.mask.data(), r.mask.size()}}};
+  sections[4] = {FEATURE_OFFSETS, sizeof(uint64_t), featureOffsets.size(),
+                 {{featureOffsets.data(),
+                   featureOffsets.size() * sizeof(uint64_t)}}};
+  sections[5] = {FEATURE_VALUES, sizeof(double), featureOffsets[n], {}};
+  for (const std::vector<double> &values : r.features.values) {
+    sections[5].chunks.push_back(
+        {values.data(), values.size() * sizeof(double)});
+  }
+  sections[6] = {EVENTS, sizeof(EventRecord), events.size(),
+                 {{events.data(), events.size() * sizeof(EventRecord)}}};
+  sections[7] = {SPIKE_OFFSETS, sizeof(uint64_t), spikeOffsets.size(),
+                 {{spikeOffsets.data(),
+                   spikeOffsets.size() * sizeof(uint64_t)}}};
+  sections[8] = {SPIKE_SAMPLES, sizeof(uint32_t), spikeOffsets.back(), {}};
+  if (r.hasSpikes) {
+    for (const std::vector<uint32_t> &spikes : r.spikes) {
+      sections[8].chunks.push_back(
+          {spikes.data(), spikes.size() * sizeof(uint32_t)});
+    }
+  }
+
+  Header header = {};
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = ANALYSIS_CACHE_VERSION;
+  header.sections = SECTION_COUNT;
+  header.sourceKey = sourceKey;
+  header.samplingRate = r.samplingRate;
+  header.channels = n;
+  std::vector<TableEntry> table(SECTION_COUNT);
+  uint64_t offset = align8(sizeof(Header) + sizeof(TableEntry) * SECTION_COUNT);
+  for (uint32_t i = 0; i < SECTION_COUNT; ++i) {
+    table[i] = {sections[i].id, sections[i].elementSize, offset,
+                sections[i].count};
+    offset = align8(offset + sections[i].count * sections[i].elementSize);
+  }
+
+  std::string temporary = path + ".tmp";
+  std::FILE *file = std::fopen(temporary.c_str(), "wb");
+  if (!file) {
+    throw std::runtime_error("Cannot write " + temporary);
+  }
+  const char padding[8] = {};
+  bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+            std::fwrite(table.data(), sizeof(TableEntry), table.size(),
+                        file) == table.size();
+  uint64_t written = sizeof(Header) + sizeof(TableEntry) * SECTION_COUNT;
+  for (uint32_t i = 0; ok && i < SECTION_COUNT; ++i) {
+    ok = std::fwrite(padding, 1, table[i].offset - written, file) ==
+         table[i].offset - written;
+    written = table[i].offset;
+    for (const auto &chunk : sections[i].chunks) {
+      ok = ok && (chunk.second == 0 ||
+                  std::fwrite(chunk.first, 1, chunk.second, file) ==
+                      chunk.second);
+      written += chunk.second;
+    }
+  }
+  if (std::fclose(file) != 0 || !ok ||
+      std::rename(temporary.c_str(), path.c_str()) != 0) {
+    std::remove(temporary.c_str());
+    throw std::runtime_error("Cannot write " + path);
+  }
+}
+
+bool readAnalysisCache(const std::string &path, uint64_t sourceKey,
+                       AnalysisResults &results) {
+  MappedFile file(path);
+  if (!file.data() || file.size() < sizeof(Header))
+    return false;
+  Header header;
+  std::memcpy(&header, file.data(), sizeof(header));
+  if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      header.version != ANALYSIS_CACHE_VERSION ||
+      header.sourceKey != sourceKey)
+    return false;
+  if (header.sections > 64 ||
+      sizeof(Header) + sizeof(TableEntry) * header.sections > file.size()) {
+    throw std::runtime_error(path + " is malformed");
+  }
+  const TableEntry *table =
+      reinterpret_cast<const TableEntry *>(file.data() + sizeof(Header));
+  const uint32_t sections = header.sections;
+  const std::size_t n = header.channels;
+
+  AnalysisResults r;
+  r.samplingRate = header.samplingRate;
+  const double *settings =
+      section<double>(file, table, sections, SETTINGS, SETTINGS_VALUES);
+  r.lowPass.enabled = settings[0] != 0;
+  r.lowPass.cutoffHz = settings[1];
+  r.lowPass.order = static_cast<int>(settings[2]);
+  r.lowPass.zeroPhase = settings[3] != 0;
+  r.envelope.enabled = settings[4] != 0;
+  r.envelope.mode = static_cast<EnvelopeMode>(static_cast<int>(settings[5]));
+  r.envelope.windowSeconds = settings[6];
+  r.detection.windowSeconds = settings[7];
+  r.detection.stepSeconds = settings[8];
+  r.detection.thresholdRatio = settings[9];
+  r.detection.mergeGapSeconds = settings[10];
+  r.detection.seizureMinSeconds = settings[11];
+  r.detection.seMinSeconds = settings[12];
+  r.features.stepSeconds = settings[13];
+  r.features.windowSeconds = settings[14];
+  r.hasSpikes = settings[15] != 0;
+  r.spikeSettings.thresholdSigmas = settings[16];
+  r.spikeSettings.refractorySeconds = settings[17];
+  r.spikeSettings.bothPolarities = settings[18] != 0;
+
+  const NameRecord *names =
+      section<NameRecord>(file, table, sections, NAMES, n);
+  r.names.resize(n);
+  for (std::size_t c = 0; c < n; ++c) {
+    r.names[c] = {names[c].row, names[c].col};
+  }
+
+  uint64_t qualityCount = sectionCount(table, sections, QUALITY);
+  if (qualityCount != 0 && qualityCount != n) {
+    throw std::runtime_error(path + " is malformed");
+  }
+  const QualityRecord *quality =
+      section<QualityRecord>(file, table, sections, QUALITY, qualityCount);
+  for (uint64_t c = 0; c < qualityCount; ++c) {
+    ChannelQuality q;
+    q.stdMv = quality[c].stdMv;
+    q.saturationFraction = quality[c].saturationFraction;
+    q.longestFlatSeconds = quality[c].longestFlatSeconds;
+    q.lineNoiseFraction = quality[c].lineNoiseFraction;
+    q.usable = quality[c].usable != 0;
+    r.quality.push_back(q);
+  }
+
+  uint64_t maskCount = sectionCount(table, sections, MASK);
+  if (maskCount != 0 && maskCount != n) {
+    throw std::runtime_error(path + " is malformed");
+  }
+  const char *mask = section<char>(file, table, sections, MASK, maskCount);
+  r.mask.assign(mask, mask + maskCount);
+
+  // Offsets must start at zero and never decrease, ending at the values'
+  // count
+  auto checkOffsets = [&](const uint64_t *offsets, std::size_t count,
+                          uint64_t total) {
+    if (offsets[0] != 0 || offsets[count - 1] != total ||
+        !std::is_sorted(offsets, offsets + count)) {
+      throw std::runtime_error(path + " is malformed");
+    }
+  };
+  const uint64_t *featureOffsets =
+      section<uint64_t>(file, table, sections, FEATURE_OFFSETS, n + 1);
+  uint64_t featureCount =
+      sectionCount(table, sections, FEATURE_VALUES);
+  const double *featureValues =
+      section<double>(file, table, sections, FEATURE_VALUES, featureCount);
+  checkOffsets(featureOffsets, n + 1, featureCount);
+  r.features.values.resize(n);
+  for (std::size_t c = 0; c < n; ++c) {
+    r.features.values[c].assign(featureValues + featureOffsets[c],
+                                featureValues + featureOffsets[c + 1]);
+  }
+
+  uint64_t eventCount = sectionCount(table, sections, EVENTS);
+  const EventRecord *events =
+      section<EventRecord>(file, table, sections, EVENTS, eventCount);
+  r.events.resize(n);
+  for (uint64_t i = 0; i < eventCount; ++i) {
+    const EventRecord &event = events[i];
+    if (event.channel >= n) {
+      throw std::runtime_error(path + " is malformed");
+    }
+    ChannelEvents &channel = r.events[event.channel];
+    (event.kind == 0 ? channel.seizures : channel.se)
+        .push_back({event.start, event.stop});
+  }
+
+  if (r.hasSpikes) {
+    const uint64_t *spikeOffsets =
+        section<uint64_t>(file, table, sections, SPIKE_OFFSETS, n + 1);
+    uint64_t spikeCount =
+        sectionCount(table, sections, SPIKE_SAMPLES);
+    const uint32_t *samples =
+        section<uint32_t>(file, table, sections, SPIKE_SAMPLES, spikeCount);
+    checkOffsets(spikeOffsets, n + 1, spikeCount);
+    r.spikes.resize(n);
+    for (std::size_t c = 0; c < n; ++c) {
+      r.spikes[c].assign(samples + spikeOffsets[c],
+                         samples + spikeOffsets[c + 1]);
+    }
+  }
+  results = std::move(r);
+  return true;
+}
@@ -0,0 +1,37 @@
+#ifndef ANALYSISCACHE_H
+#define ANALYSISCACHE_H
+
+#include "analysis.h"
+#include "rereference.h"
+#include <cstdint>
+#include <string>
+
+// Sidecar file next to a recording that holds its analysis results, so a
+// reopened recording can be shown without being reanalysed. The file is a
+// fixed header, a table of sections (id, element size, offset, count) and
+// the 8-byte aligned sections themselves, all in native byte order, so it
+// is read by mapping it and copying each section out in one pass.
+//
+// The header carries a key over the recording's size and modification time
+// and the re-reference settings, which shape every signal; a file with any
+// other key is ignored. Analysis settings are stored with the results, and
+// AnalysisGraph::restore() reruns whatever they no longer match.
+const uint32_t ANALYSIS_CACHE_VERSION = 1;
+
+std::string analysisCachePath(const std::string &recordingPath);
+
+// Throws std::runtime_error when the recording cannot be inspected
+uint64_t analysisSourceKey(const std::string &recordingPath,
+                           const ReferenceSettings &reference);
+
+// Writes a temporary file and renames it over path, so a reader never sees
+// a partial cache. Throws std::runtime_error on failure.
+void writeAnalysisCache(const std::string &path, uint64_t sourceKey,
+                        const AnalysisResults &results);
+
+// Returns false when there is no cache, or it is from another version or
+// for another key. Throws std::runtime_error when it is malformed.
+bool readAnalysisCache(const std::string &path, uint64_t sourceKey,
+                       AnalysisResults &results);
+
+#endif // ANALYSISCACHE_H
@@ -0,0 +1,80 @@
+// Times QCPGraph::getOptimizedLineData and a full replot on dense traces.
+//
+// Usage: bench_lineopt [maxPoints] [repeats]
+// Runs 10^6, 10^7 and 10^8 points (up to maxPoints), once with uniformly
+// spaced keys like our sample-index traces and once with jittered keys.
+#include <QApplication>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <qcustomplot.h>
+#include <random>
+
+class LineDataProbe : public QCPGraph {
+public:
+  LineDataProbe(QCPAxis *keyAxis, QCPAxis *valueAxis)
+      : QCPGraph(keyAxis, valueAxis) {}
+
+  int optimizedLineDataSize() const {
+    QVector<QCPGraphData> lineData;
+    getOptimizedLineData(&lineData, data()->constBegin(), data()->constEnd());
+    return lineData.size();
+  }
+};
+
+static void fillTrace(QCPGraphDataContainer *container, qint64 count,
+                      bool jittered) {
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<double> noise(-0.05, 0.05);
+  std::uniform_real_distribution<double> jitter(0.5, 1.5);
+
+  QVector<QCPGraphData> points(count);
+  double key = 0;
+  for (qint64 i = 0; i < count; ++i) {
+    points[i].key = key;
+    points[i].value = std::sin(i * 1e-4) + noise(rng);
+    key += jittered ? jitter(rng) : 1.0;
+  }
+  container->set(points, true);
+}
+
+int main(int argc, char *argv[]) {
+  qputenv("QT_QPA_PLATFORM", "offscreen");
+  QApplication app(argc, argv);
+
+  qint64 maxPoints = argc > 1 ? QByteArray(argv[1]).toLongLong() : 100000000;
+  int repeats = argc > 2 ? QByteArray(argv[2]).toInt() : 5;
+
+  QCustomPlot plot;
+  plot.resize(1920, 400);
+  LineDataProbe *graph = new LineDataProbe(plot.xAxis, plot.yAxis);
+
+  std::printf("%-12s %-10s %14s %14s %10s\n", "points", "keys",
+              "lineData ms", "replot ms", "out");
+  for (qint64 count = 1000000; count <= maxPoints; count *= 10) {
+    for (bool jittered : {false, true}) {
+      fillTrace(graph->data().data(), count, jittered);
+      plot.rescaleAxes();
+      plot.replot();
+
+      double bestLineData = 1e300, bestReplot = 1e300;
+      int outCount = 0;
+      for (int r = 0; r < repeats; ++r) {
+        QElapsedTimer timer;
+        timer.start();
+        outCount = graph->optimizedLineDataSize();
+        bestLineData = std::min(bestLineData, timer.nsecsElapsed() / 1e6);
+
+        timer.restart();
+        plot.replot();
+        bestReplot = std::min(bestReplot, timer.nsecsElapsed() / 1e6);
+      }
+      std::printf("%-12lld %-10s %14.2f %14.2f %10d\n",
+                  static_cast<long long>(count),
+                  jittered ? "jittered" : "uniform", bestLineData, bestReplot,
+                  outCount);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,8 @@
+greaterThan(QT_MAJOR_VERSION, 4): QT += core gui widgets printsupport
+CONFIG += c++17 console
+CONFIG -= app_bundle
+TARGET = bench_lineopt
+INCLUDEPATH += ..
+SOURCES += bench_lineopt.cpp \
+           ../qcustomplot.cpp
+HEADERS += ../qcustomplot.h
@@ -0,0 +1,374 @@
+// Times the whole pipeline on a synthetic recording and writes the results
+// as JSON, for tracking regressions from commit to commit.
+//
+// Usage: bench_pipeline [--channels N] [--seconds S] [--rate HZ]
+//                       [--seizures N] [--file path.brw] [--out results.json]
+//                       [--label text] [--repeats N]
+// Without --file a recording is generated in the temp directory and removed
+// afterwards. Stages: generate, read, quality, convert (re-reference and
+// transpose), decimate (to a tenth of the rate), the analysis graph stages,
+// writing the analysis cache and reopening from it without the signals, and
+// a headless replot of one full-resolution channel. The checks compare
+// detections against what was injected; spikes are scored outside the
+// seizure windows.
+#include "analysis.h"
+#include "analysiscache.h"
+#include "brwreader.h"
+#include "channelquality.h"
+#include "constants.h"
+#include "rereference.h"
+#include "resampler.h"
+#include "synthbrw.h"
+#include <QApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <qcustomplot.h>
+#include <string>
+#include <vector>
+
+// Longest delay from an injected spike's onset to its detection
+const double SPIKE_MATCH_SECONDS = 0.005;
+// Every option takes a value
+const char *const OPTIONS[] = {"--channels", "--seconds", "--rate",
+                               "--seizures", "--file",    "--out",
+                               "--label",    "--repeats"};
+
+struct StageResult {
+  std::string name;
+  double seconds;
+  // Input processed, for throughput; zero when it does not apply
+  double megabytes;
+};
+
+static bool overlaps(const std::vector<Region> &regions, double first,
+                     double last) {
+  for (const Region &region : regions) {
+    if (region.start < last && region.stop > first)
+      return true;
+  }
+  return false;
+}
+
+static bool inside(const std::vector<std::pair<double, double>> &windows,
+                   double seconds) {
+  for (const auto &window : windows) {
+    if (seconds >= window.first && seconds < window.second)
+      return true;
+  }
+  return false;
+}
+
+static int usage(const char *program) {
+  std::fprintf(stderr,
+               "Usage: %s [--channels N] [--seconds S] [--rate HZ] "
+               "[--seizures N] [--file path.brw] [--out results.json] "
+               "[--label text] [--repeats N]\n",
+               program);
+  return 2;
+}
+
+static void writeResults(std::FILE *out, const std::string &label,
+                         const SynthSettings &settings,
+                         const std::vector<StageResult> &stages,
+                         const std::vector<std::pair<std::string, double>>
+                             &checks) {
+  std::fprintf(out, "{\n  \"label\": \"%s\",\n", label.c_str());
+  std::fprintf(out,
+               "  \"channels\": %d,\n  \"seconds\": %g,\n  \"rate\": %g,\n",
+               settings.channels, settings.seconds, settings.samplingRate);
+  std::fprintf(out, "  \"stages\": [");
+  for (std::size_t i = 0; i < stages.size(); ++i) {
+    const StageResult &stage = stages[i];
+    std::fprintf(out, "%s\n    {\"name\": \"%s\", \"seconds\": %.6f",
+                 i ? "," : "", stage.name.c_str(), stage.seconds);
+    if (stage.megabytes > 0 && stage.seconds > 0) {
+      std::fprintf(out, ", \"mb_per_s\": %.1f",
+                   stage.megabytes / stage.seconds);
+    }
+    std::fprintf(out, "}");
+  }
+  std::fprintf(out, "\n  ],\n  \"checks\": {");
+  for (std::size_t i = 0; i < checks.size(); ++i) {
+    std::fprintf(out, "%s\n    \"%s\": %g", i ? "," : "",
+                 checks[i].first.c_str(), checks[i].second);
+  }
+  std::fprintf(out, "\n  }\n}\n");
+}
+
+int main(int argc, char *argv[]) {
+  qputenv("QT_QPA_PLATFORM", "offscreen");
+  QApplication app(argc, argv);
+
+  SynthSettings settings;
+  int seizures = 2;
+  int repeats = 5;
+  std::string filePath, outPath, label;
+  for (int i = 1; i < argc; i += 2) {
+    if (std::find_if(std::begin(OPTIONS), std::end(OPTIONS),
+                     [&](const char *option) {
+                       return !std::strcmp(option, argv[i]);
+                     }) == std::end(OPTIONS)) {
+      std::fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return usage(argv[0]);
+    }
+    if (i + 1 == argc) {
+      std::fprintf(stderr, "Missing value for %s\n", argv[i]);
+      return usage(argv[0]);
+    }
+    QByteArray name(argv[i]), value(argv[i + 1]);
+    if (name == "--channels") {
+      settings.channels = value.toInt();
+    } else if (name == "--seconds") {
+      settings.seconds = value.toDouble();
+    } else if (name == "--rate") {
+      settings.samplingRate = value.toDouble();
+    } else if (name == "--seizures") {
+      seizures = value.toInt();
+    } else if (name == "--file") {
+      filePath = value.toStdString();
+    } else if (name == "--out") {
+      outPath = value.toStdString();
+    } else if (name == "--label") {
+      label = value.toStdString();
+    } else if (name == "--repeats") {
+      repeats = std::max(1, value.toInt());
+    }
+  }
+  addEvenSeizures(settings, seizures);
+
+  std::vector<StageResult> stages;
+  std::vector<std::pair<std::string, double>> checks;
+  QElapsedTimer timer;
+
+  try {
+    SynthTruth truth;
+    bool generated = filePath.empty();
+    if (generated) {
+      filePath = QDir::temp().filePath("bench_pipeline.brw").toStdString();
+      timer.start();
+      truth = writeSyntheticBrw(filePath, settings);
+      stages.push_back({"generate", timer.nsecsElapsed() * 1e-9, 0.0});
+    }
+
+    BrwReader reader(filePath);
+    BrwInfo info = reader.info();
+    const int channelCount = info.channelCount();
+    const long long frameCount = reader.availableFrames();
+    settings.channels = channelCount;
+    settings.samplingRate = info.samplingRate;
+    settings.seconds = frameCount / info.samplingRate;
+    const double rawMegabytes =
+        frameCount * channelCount * sizeof(int16_t) / 1e6;
+
+    ReferenceSettings reference;
+    reference.mode = ReferenceMode::CommonAverage;
+    ReReferencer referencer(reference, info);
+    QualityAccumulator qualityPass(info);
+    ResamplingChain decimator(info.samplingRate, info.samplingRate / 10.0,
+                              channelCount);
+
+    std::vector<ChannelData> channels(channelCount);
+    for (int c = 0; c < channelCount; ++c) {
+      channels[c].signal.resize(frameCount);
+      channels[c].name = {info.rows[c], info.cols[c]};
+    }
+
+    // The loader's loop, with each step timed on its own
+    double readSeconds = 0, qualitySeconds = 0, convertSeconds = 0,
+           decimateSeconds = 0;
+    std::vector<int16_t> counts;
+    std::vector<double> frames, decimated;
+    for (long long first = 0; first < frameCount;
+         first += LOADER_BLOCK_FRAMES) {
+      long long blockFrames =
+          std::min<long long>(LOADER_BLOCK_FRAMES, frameCount - first);
+      timer.start();
+      reader.readFrames(first, blockFrames, counts);
+      readSeconds += timer.nsecsElapsed() * 1e-9;
+
+      timer.start();
+      qualityPass.process(counts.data(), blockFrames);
+      qualitySeconds += timer.nsecsElapsed() * 1e-9;
+
+      timer.start();
+      frames.resize(counts.size());
+      referencer.process(counts.data(), first, blockFrames, frames.data());
+      for (long long i = 0; i < blockFrames; ++i) {
+        const double *frame = frames.data() + i * channelCount;
+        for (int c = 0; c < channelCount; ++c) {
+          channels[c].signal[first + i] = frame[c];
+        }
+      }
+      convertSeconds += timer.nsecsElapsed() * 1e-9;
+
+      timer.start();
+      decimated.clear();
+      decimator.process(frames.data(), blockFrames, decimated);
+      decimateSeconds += timer.nsecsElapsed() * 1e-9;
+    }
+    stages.push_back({"read", readSeconds, rawMegabytes});
+    stages.push_back({"quality", qualitySeconds, rawMegabytes});
+    stages.push_back({"convert", convertSeconds, rawMegabytes});
+    stages.push_back({"decimate", decimateSeconds, rawMegabytes * 4});
+
+    QualitySettings qualitySettings;
+    std::vector<ChannelQuality> quality = qualityPass.result(qualitySettings);
+    int masked = 0;
+    for (const ChannelQuality &channel : quality) {
+      masked += !channel.usable;
+    }
+
+    AnalysisGraph analysis;
+    analysis.setSource(std::move(channels), info.samplingRate,
+                       std::move(quality));
+    LowPassSettings lowPass;
+    lowPass.enabled = true;
+    lowPass.cutoffHz = std::min(100.0, info.samplingRate / 4.0);
+    analysis.setLowPass(lowPass);
+    EnvelopeSettings envelope;
+    envelope.enabled = true;
+    analysis.setEnvelope(envelope);
+    const std::vector<ChannelEvents> &events = analysis.events();
+    std::shared_ptr<const SpikeIndex> spikes = analysis.spikes();
+    analysis.ordering();
+    for (const StageRun &run : analysis.takeRuns()) {
+      stages.push_back({run.stage, run.seconds, 0.0});
+    }
+
+    // Reopen as the viewer does while the signals are still loading
+    std::string cachePath = analysisCachePath(filePath);
+    uint64_t sourceKey = analysisSourceKey(filePath, reference);
+    timer.start();
+    writeAnalysisCache(cachePath, sourceKey, analysis.results());
+    stages.push_back({"cache write", timer.nsecsElapsed() * 1e-9, 0.0});
+    timer.start();
+    AnalysisResults cached;
+    bool reopened = readAnalysisCache(cachePath, sourceKey, cached);
+    AnalysisGraph reopen;
+    std::vector<ChannelData> names(cached.names.size());
+    for (std::size_t c = 0; c < names.size(); ++c) {
+      names[c].name = cached.names[c];
+    }
+    reopen.setSource(std::move(names), cached.samplingRate, cached.quality);
+    reopen.setLowPass(lowPass);
+    reopen.setEnvelope(envelope);
+    reopen.restore(cached);
+    bool sameEvents = reopened && reopen.events().size() == events.size();
+    for (std::size_t c = 0; sameEvents && c < events.size(); ++c) {
+      const ChannelEvents &a = reopen.events()[c];
+      sameEvents = a.seizures.size() == events[c].seizures.size() &&
+                   a.se.size() == events[c].se.size();
+    }
+    reopen.spikes();
+    reopen.ordering();
+    stages.push_back({"cache reopen", timer.nsecsElapsed() * 1e-9, 0.0});
+    int rerun = 0;
+    for (const StageRun &run : reopen.takeRuns()) {
+      rerun += run.stage != "order/propagate";
+    }
+    checks.push_back({"cache_events_match", sameEvents ? 1.0 : 0.0});
+    checks.push_back({"cache_stages_rerun", static_cast<double>(rerun)});
+    std::remove(cachePath.c_str());
+
+    // Headless replot of the first channel at full resolution
+    const std::vector<double> &signal = analysis.channels()[0].signal;
+    QVector<double> x(static_cast<int>(signal.size()));
+    for (int i = 0; i < x.size(); ++i) {
+      x[i] = i / info.samplingRate;
+    }
+    QVector<double> y(signal.begin(), signal.end());
+    QCustomPlot plot;
+    plot.resize(1920, 400);
+    QCPGraph *graph = plot.addGraph();
+    graph->setData(x, y, true);
+    plot.rescaleAxes();
+    plot.replot();
+    double bestReplot = 1e300;
+    for (int r = 0; r < repeats; ++r) {
+      timer.start();
+      plot.replot();
+      bestReplot = std::min(bestReplot, timer.nsecsElapsed() * 1e-9);
+    }
+    stages.push_back({"replot", bestReplot, 0.0});
+
+    checks.push_back({"masked_channels", static_cast<double>(masked)});
+    checks.push_back(
+        {"spikes_detected", static_cast<double>(spikes->size())});
+    if (generated) {
+      int expected = 0, found = 0, spurious = 0;
+      for (int c = 0; c < channelCount; ++c) {
+        std::vector<Region> detected = events[c].seizures;
+        detected.insert(detected.end(), events[c].se.begin(),
+                        events[c].se.end());
+        for (const auto &seizure : truth.seizures[c]) {
+          ++expected;
+          found += overlaps(detected, seizure.first, seizure.second);
+        }
+        for (const Region &region : detected) {
+          bool real = false;
+          for (const auto &seizure : truth.seizures[c]) {
+            real = real || (region.start < seizure.second &&
+                            region.stop > seizure.first);
+          }
+          spurious += !real;
+        }
+      }
+      checks.push_back({"seizure_recall",
+                        expected ? static_cast<double>(found) / expected : 1.0});
+      checks.push_back({"spurious_intervals", static_cast<double>(spurious)});
+
+      // Seizure cycles cross the spike threshold too, so spikes are only
+      // scored outside each channel's injected seizure windows. An injected
+      // spike is found when a detection lands within SPIKE_MATCH_SECONDS of
+      // its onset.
+      const long long tolerance = std::max<long long>(
+          1, std::lround(SPIKE_MATCH_SECONDS * info.samplingRate));
+      long long injected = 0, matched = 0, detectedOutside = 0;
+      for (int c = 0; c < channelCount; ++c) {
+        const std::vector<uint32_t> &found = spikes->channelSpikes()[c];
+        for (uint32_t sample : found) {
+          detectedOutside +=
+              !inside(truth.seizures[c], sample / info.samplingRate);
+        }
+        for (long long onset : truth.spikeOnsets[c]) {
+          if (inside(truth.seizures[c], onset / info.samplingRate))
+            continue;
+          ++injected;
+          auto hit = std::lower_bound(found.begin(), found.end(),
+                                      static_cast<uint32_t>(onset));
+          matched += hit != found.end() && *hit < onset + tolerance;
+        }
+      }
+      checks.push_back(
+          {"spikes_injected_outside_seizures", static_cast<double>(injected)});
+      checks.push_back({"spikes_detected_outside_seizures",
+                        static_cast<double>(detectedOutside)});
+      checks.push_back({"spike_recall", injected ? static_cast<double>(matched) /
+                                                       injected
+                                                 : 1.0});
+      std::remove(filePath.c_str());
+    }
+  } catch (const H5::Exception &e) {
+    std::fprintf(stderr, "HDF5 error: %s\n", e.getCDetailMsg());
+    return 1;
+  } catch (const std::exception &e) {
+    std::fprintf(stderr, "Error: %s\n", e.what());
+    return 1;
+  }
+
+  std::FILE *out = outPath.empty() ? stdout : std::fopen(outPath.c_str(), "w");
+  if (!out) {
+    std::fprintf(stderr, "Cannot write %s\n", outPath.c_str());
+    return 1;
+  }
+  writeResults(out, label, settings, stages, checks);
+  if (out != stdout) {
+    std::fclose(out);
+  }
+  return 0;
+}
@@ -0,0 +1,27 @@
+greaterThan(QT_MAJOR_VERSION, 4): QT += core gui widgets printsupport
+CONFIG += c++17 console
+CONFIG -= app_bundle
+TARGET = bench_pipeline
+INCLUDEPATH += .. /opt/homebrew/Cellar/hdf5/1.14.3_1/include
+LIBS += -L/opt/homebrew/Cellar/hdf5/1.14.3_1/lib -lhdf5 -lhdf5_cpp
+SOURCES += bench_pipeline.cpp \
+           synthbrw.cpp \
+           ../qcustomplot.cpp \
+           ../brwreader.cpp \
+           ../filterbank.cpp \
+           ../resampler.cpp \
+           ../fft.cpp \
+           ../envelope.cpp \
+           ../detector.cpp \
+           ../spikeindex.cpp \
+           ../regionindex.cpp \
+           ../propagation.cpp \
+           ../ordering.cpp \
+           ../rereference.cpp \
+           ../channelquality.cpp \
+           ../analysis.cpp \
+           ../analysiscache.cpp \
+           ../taskpool.cpp \
+           ../trace.cpp
+HEADERS += synthbrw.h \
+           ../qcustomplot.h
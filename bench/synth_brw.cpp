@@ -0,0 +1,66 @@
+// Writes a synthetic BRW recording for tests and benchmarks.
+//
+// Usage: synth_brw <out.brw> [--channels N] [--seconds S] [--rate HZ]
+//                  [--seizures N] [--spike-rate HZ] [--dead N] [--seed N]
+#include "synthbrw.h"
+#include <H5Cpp.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static int usage(const char *program) {
+  std::fprintf(stderr, "Usage: %s <out.brw> [--channels N] [--seconds S] "
+                       "[--rate HZ] [--seizures N] [--spike-rate HZ] "
+                       "[--dead N] [--seed N]\n",
+               program);
+  return 2;
+}
+
+int main(int argc, char *argv[]) {
+  // An option (--help included) in place of the path would otherwise be
+  // written to as a file
+  if (argc < 2 || argv[1][0] == '-')
+    return usage(argv[0]);
+
+  SynthSettings settings;
+  int seizures = 2;
+  for (int i = 2; i < argc; i += 2) {
+    const char *name = argv[i];
+    if (i + 1 == argc) {
+      std::fprintf(stderr, "Missing value for %s\n", name);
+      return usage(argv[0]);
+    }
+    double value = std::atof(argv[i + 1]);
+    if (!std::strcmp(name, "--channels")) {
+      settings.channels = static_cast<int>(value);
+    } else if (!std::strcmp(name, "--seconds")) {
+      settings.seconds = value;
+    } else if (!std::strcmp(name, "--rate")) {
+      settings.samplingRate = value;
+    } else if (!std::strcmp(name, "--seizures")) {
+      seizures = static_cast<int>(value);
+    } else if (!std::strcmp(name, "--spike-rate")) {
+      settings.spikeRateHz = value;
+    } else if (!std::strcmp(name, "--dead")) {
+      settings.deadChannels = static_cast<int>(value);
+    } else if (!std::strcmp(name, "--seed")) {
+      settings.seed = static_cast<unsigned>(value);
+    } else {
+      std::fprintf(stderr, "Unknown option %s\n", name);
+      return 2;
+    }
+  }
+  addEvenSeizures(settings, seizures);
+
+  try {
+    SynthTruth truth = writeSyntheticBrw(argv[1], settings);
+    std::printf("Wrote %s: %d channels, %.1f s at %.0f Hz, %d seizures, "
+                "%lld spikes\n",
+                argv[1], settings.channels, settings.seconds,
+                settings.samplingRate, seizures, truth.spikes);
+  } catch (const H5::Exception &e) {
+    std::fprintf(stderr, "HDF5 error: %s\n", e.getCDetailMsg());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,8 @@
+CONFIG += c++17 console
+CONFIG -= app_bundle qt
+TARGET = synth_brw
+INCLUDEPATH += .. /opt/homebrew/Cellar/hdf5/1.14.3_1/include
+LIBS += -L/opt/homebrew/Cellar/hdf5/1.14.3_1/lib -lhdf5 -lhdf5_cpp
+SOURCES += synth_brw.cpp \
+           synthbrw.cpp
+HEADERS += synthbrw.h
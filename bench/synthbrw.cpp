@@ -0,0 +1,228 @@
+#include "synthbrw.h"
+#include <H5Cpp.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace {
+const long long BLOCK_FRAMES = 2048;
+const int MID_CODE = 2048;
+const int MAX_CODE = 4095;
+const double PI = 3.14159265358979323846;
+
+struct Window {
+  long long first;
+  long long last;
+  std::size_t seizure;
+};
+
+struct Electrode {
+  int16_t Row;
+  int16_t Col;
+};
+
+// xorshift64*, one per channel so the output does not depend on the order
+// samples are generated in
+struct Random {
+  uint64_t state;
+
+  explicit Random(uint64_t seed) : state(seed * 0x9E3779B97F4A7C15ull | 1) {}
+  uint64_t next() {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1Dull;
+  }
+  // Uniform in (0, 1)
+  double uniform() {
+    return ((next() >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+  }
+  // Sum of four uniforms, scaled to unit variance
+  double normal() {
+    uint64_t bits = next();
+    double sum = 0.0;
+    for (int i = 0; i < 4; ++i) {
+      sum += static_cast<double>((bits >> (16 * i)) & 0xffff) / 65536.0;
+    }
+    return (sum - 2.0) * std::sqrt(3.0);
+  }
+};
+
+// Spike-and-wave cycle at phase in [0, 1)
+double seizureWave(double phase) {
+  if (phase < 0.1) {
+    return -std::sin(PI * phase / 0.1);
+  }
+  return 0.3 * std::sin(PI * (phase - 0.1) / 0.9);
+}
+
+// Biphasic extracellular spike at x in [0, 1) of its width
+double spikeShape(double x) {
+  if (x < 0.4) {
+    return -std::sin(PI * x / 0.4);
+  }
+  return 0.3 * std::sin(PI * (x - 0.4) / 0.6);
+}
+
+void writeScalar(H5::Group &group, const char *name,
+                 const H5::PredType &type, const void *value) {
+  hsize_t one = 1;
+  H5::DataSpace space(1, &one);
+  group.createDataSet(name, type, space).write(value, type);
+}
+}
+
+int synthGridSide(int channels) {
+  int side = static_cast<int>(std::ceil(std::sqrt(std::max(channels, 1))));
+  while (side * side < channels) {
+    ++side;
+  }
+  return side;
+}
+
+void addEvenSeizures(SynthSettings &settings, int count) {
+  settings.seizures.clear();
+  int side = synthGridSide(settings.channels);
+  double slot = settings.seconds / std::max(count, 1);
+  for (int i = 0; i < count; ++i) {
+    SynthSeizure seizure;
+    seizure.startSeconds = slot * i + slot * 0.25;
+    seizure.durationSeconds = std::min(15.0, slot * 0.5);
+    seizure.originRow = side * (i + 1) / (count + 1);
+    seizure.originCol = side / 3;
+    seizure.cellsPerSecond = std::max(1.0, side / 2.0);
+    settings.seizures.push_back(seizure);
+  }
+}
+
+SynthTruth writeSyntheticBrw(const std::string &path,
+                             const SynthSettings &settings) {
+  const int channels = settings.channels;
+  const double rate = settings.samplingRate;
+  const long long frames = static_cast<long long>(settings.seconds * rate);
+  const int side = synthGridSide(channels);
+  const int live = std::max(0, channels - settings.deadChannels);
+
+  H5::H5File file(path, H5F_ACC_TRUNC);
+  file.createGroup("/3BRecInfo");
+  H5::Group recVars = file.createGroup("/3BRecInfo/3BRecVars");
+  int bitDepth = 12;
+  double maxVolt = 4125.0, minVolt = -4125.0, inversion = 1.0;
+  writeScalar(recVars, "NRecFrames", H5::PredType::NATIVE_LLONG, &frames);
+  writeScalar(recVars, "SamplingRate", H5::PredType::NATIVE_DOUBLE, &rate);
+  writeScalar(recVars, "SignalInversion", H5::PredType::NATIVE_DOUBLE,
+              &inversion);
+  writeScalar(recVars, "MaxVolt", H5::PredType::NATIVE_DOUBLE, &maxVolt);
+  writeScalar(recVars, "MinVolt", H5::PredType::NATIVE_DOUBLE, &minVolt);
+  writeScalar(recVars, "BitDepth", H5::PredType::NATIVE_INT, &bitDepth);
+
+  file.createGroup("/3BRecInfo/3BMeaStreams");
+  H5::Group stream = file.createGroup("/3BRecInfo/3BMeaStreams/Raw");
+  std::vector<Electrode> electrodes(channels);
+  for (int c = 0; c < channels; ++c) {
+    electrodes[c] = {static_cast<int16_t>(c / side + 1),
+                     static_cast<int16_t>(c % side + 1)};
+  }
+  H5::CompType electrodeType(sizeof(Electrode));
+  electrodeType.insertMember("Row", HOFFSET(Electrode, Row),
+                             H5::PredType::NATIVE_INT16);
+  electrodeType.insertMember("Col", HOFFSET(Electrode, Col),
+                             H5::PredType::NATIVE_INT16);
+  hsize_t channelCount = static_cast<hsize_t>(channels);
+  H5::DataSpace channelSpace(1, &channelCount);
+  stream.createDataSet("Chs", electrodeType, channelSpace)
+      .write(electrodes.data(), electrodeType);
+
+  // Per-channel seizure windows, in frames
+  SynthTruth truth;
+  truth.seizures.resize(channels);
+  truth.spikeOnsets.resize(channels);
+  std::vector<std::vector<Window>> windows(channels);
+  for (int c = 0; c < live; ++c) {
+    for (std::size_t s = 0; s < settings.seizures.size(); ++s) {
+      const SynthSeizure &seizure = settings.seizures[s];
+      double distance = std::hypot(c / side - seizure.originRow,
+                                   c % side - seizure.originCol);
+      double onset = seizure.startSeconds + distance / seizure.cellsPerSecond;
+      double offset = std::min(onset + seizure.durationSeconds,
+                               settings.seconds);
+      if (onset >= offset)
+        continue;
+      truth.seizures[c].emplace_back(onset, offset);
+      windows[c].push_back({static_cast<long long>(onset * rate),
+                            static_cast<long long>(offset * rate), s});
+    }
+  }
+
+  const long long spikeFrames =
+      std::max(3LL, static_cast<long long>(std::lround(0.0015 * rate)));
+  std::vector<Random> random;
+  random.reserve(channels);
+  std::vector<long long> nextSpike(channels, frames);
+  for (int c = 0; c < channels; ++c) {
+    random.emplace_back((static_cast<uint64_t>(settings.seed) << 32) + c + 1);
+  }
+  auto drawSpike = [&](int c, long long after) {
+    if (settings.spikeRateHz <= 0.0)
+      return frames;
+    double interval = -std::log(random[c].uniform()) / settings.spikeRateHz;
+    return after + spikeFrames + static_cast<long long>(interval * rate);
+  };
+  for (int c = 0; c < live; ++c) {
+    nextSpike[c] = drawSpike(c, 0) - spikeFrames;
+  }
+  std::vector<long long> spikeStart(channels, -spikeFrames);
+
+  hsize_t rawSize = static_cast<hsize_t>(frames) * channelCount;
+  H5::Group data = file.createGroup("/3BData");
+  H5::DataSpace rawSpace(1, &rawSize);
+  H5::DataSet raw =
+      data.createDataSet("Raw", H5::PredType::NATIVE_INT16, rawSpace);
+
+  std::vector<int16_t> counts;
+  for (long long first = 0; first < frames; first += BLOCK_FRAMES) {
+    long long blockFrames = std::min(BLOCK_FRAMES, frames - first);
+    counts.assign(static_cast<std::size_t>(blockFrames) * channels, MID_CODE);
+    for (long long f = 0; f < blockFrames; ++f) {
+      long long frame = first + f;
+      int16_t *out = counts.data() + f * channels;
+      for (int c = 0; c < live; ++c) {
+        double value = settings.noiseCounts * random[c].normal();
+
+        if (frame == nextSpike[c]) {
+          spikeStart[c] = frame;
+          nextSpike[c] = drawSpike(c, frame);
+          truth.spikeOnsets[c].push_back(frame);
+          ++truth.spikes;
+        }
+        long long intoSpike = frame - spikeStart[c];
+        if (intoSpike < spikeFrames) {
+          value += settings.spikeAmplitudeCounts *
+                   spikeShape((intoSpike + 0.5) / spikeFrames);
+        }
+
+        for (const Window &window : windows[c]) {
+          if (frame < window.first || frame >= window.last)
+            continue;
+          const SynthSeizure &seizure = settings.seizures[window.seizure];
+          double since = (frame - window.first) / rate;
+          double until = (window.last - frame) / rate;
+          double ramp = std::min(1.0, std::min(since, until));
+          double phase = since * seizure.frequencyHz;
+          value += ramp * seizure.amplitudeCounts *
+                   seizureWave(phase - std::floor(phase));
+        }
+        int code = MID_CODE + static_cast<int>(std::lround(value));
+        out[c] = static_cast<int16_t>(std::clamp(code, 0, MAX_CODE));
+      }
+    }
+
+    hsize_t offset = static_cast<hsize_t>(first) * channelCount;
+    hsize_t count = counts.size();
+    H5::DataSpace fileSpace = raw.getSpace();
+    fileSpace.selectHyperslab(H5S_SELECT_SET, &count, &offset);
+    H5::DataSpace memSpace(1, &count);
+    raw.write(counts.data(), H5::PredType::NATIVE_INT16, memSpace, fileSpace);
+  }
+  return truth;
+}
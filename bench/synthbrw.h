@@ -0,0 +1,59 @@
+#ifndef SYNTHBRW_H
+#define SYNTHBRW_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// A seizure that starts at one electrode and spreads outward at a constant
+// speed, so every channel has its own onset.
+struct SynthSeizure {
+  double startSeconds = 10.0;
+  double durationSeconds = 15.0;
+  int originRow = 0;
+  int originCol = 0;
+  double cellsPerSecond = 20.0;
+  double frequencyHz = 8.0;
+  double amplitudeCounts = 120.0;
+};
+
+struct SynthSettings {
+  int channels = 1024;
+  double seconds = 60.0;
+  double samplingRate = 1000.0;
+  // Gaussian background noise
+  double noiseCounts = 4.0;
+  // Poisson spikes on every live channel
+  double spikeRateHz = 2.0;
+  double spikeAmplitudeCounts = 60.0;
+  // The last deadChannels channels are flat
+  int deadChannels = 0;
+  std::vector<SynthSeizure> seizures;
+  unsigned seed = 1;
+};
+
+// What was injected, for checking detections against
+struct SynthTruth {
+  // Per channel, [onset, offset) in seconds
+  std::vector<std::vector<std::pair<double, double>>> seizures;
+  // Per channel, the first frame of every spike
+  std::vector<std::vector<long long>> spikeOnsets;
+  long long spikes = 0;
+};
+
+// Replaces the seizures with count evenly spaced ones, each starting from a
+// different electrode and sweeping the grid in about two seconds.
+void addEvenSeizures(SynthSettings &settings, int count);
+
+// Electrodes are laid out row by row on the smallest square grid that holds
+// every channel, with 1-based rows and columns as in real recordings.
+int synthGridSide(int channels);
+
+// Writes a BRW-compatible HDF5 file: the /3BRecInfo/3BRecVars scalars, the
+// /3BRecInfo/3BMeaStreams/Raw/Chs electrode table and frame-interleaved
+// 12-bit ADC counts in /3BData/Raw. The same settings always give the same
+// file. Throws on HDF5 errors.
+SynthTruth writeSyntheticBrw(const std::string &path,
+                             const SynthSettings &settings);
+
+#endif // SYNTHBRW_H
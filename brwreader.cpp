@@ -0,0 +1,98 @@
+#include "brwreader.h"
+#include <algorithm>
+#include <stdexcept>
+
+BrwReader::BrwReader(const std::string &filePath)
+    : file(filePath, H5F_ACC_RDONLY) {
+  recInfo.nRecFrames =
+      static_cast<long long>(readScalar("/3BRecInfo/3BRecVars/NRecFrames"));
+  recInfo.samplingRate = readScalar("/3BRecInfo/3BRecVars/SamplingRate");
+  recInfo.signalInversion =
+      readScalar("/3BRecInfo/3BRecVars/SignalInversion");
+  recInfo.maxUVolt = readScalar("/3BRecInfo/3BRecVars/MaxVolt");
+  recInfo.minUVolt = readScalar("/3BRecInfo/3BRecVars/MinVolt");
+  recInfo.bitDepth =
+      static_cast<int>(readScalar("/3BRecInfo/3BRecVars/BitDepth"));
+
+  uint64_t qLevel =
+      static_cast<uint64_t>(1) ^ static_cast<uint64_t>(recInfo.bitDepth);
+  double fromQLevelToUVolt =
+      (recInfo.maxUVolt - recInfo.minUVolt) / static_cast<double>(qLevel);
+  recInfo.adcCountsToMV = recInfo.signalInversion * fromQLevelToUVolt;
+  recInfo.mvOffset = recInfo.signalInversion * recInfo.minUVolt;
+
+  readChannels();
+
+  raw = file.openDataSet("/3BData/Raw");
+  H5::DataSpace dataspace = raw.getSpace();
+  if (dataspace.getSimpleExtentNdims() != 1) {
+    throw std::runtime_error("Unexpected number of dimensions in raw data");
+  }
+  dataspace.getSimpleExtentDims(&rawElements, NULL);
+}
+
+double BrwReader::readScalar(const std::string &path) {
+  H5::DataSet dataset = file.openDataSet(path);
+  H5T_class_t type_class = dataset.getTypeClass();
+
+  if (type_class == H5T_INTEGER) {
+    int data;
+    dataset.read(&data, H5::PredType::NATIVE_INT);
+    return static_cast<double>(data);
+  } else if (type_class == H5T_FLOAT) {
+    double data;
+    dataset.read(&data, H5::PredType::NATIVE_DOUBLE);
+    return data;
+  } else {
+    throw std::runtime_error("Unsupported data type");
+  }
+}
+
+void BrwReader::readChannels() {
+  H5::DataSet dataset = file.openDataSet("/3BRecInfo/3BMeaStreams/Raw/Chs");
+
+  H5::DataSpace dataspace = dataset.getSpace();
+  hsize_t dims[2];
+  dataspace.getSimpleExtentDims(dims, NULL);
+
+  H5::CompType mtype(sizeof(int) * 2);
+  mtype.insertMember("Row", 0, H5::PredType::NATIVE_INT);
+  mtype.insertMember("Col", sizeof(int), H5::PredType::NATIVE_INT);
+
+  std::vector<std::pair<int, int>> data(dims[0]);
+  dataset.read(data.data(), mtype);
+
+  recInfo.rows.resize(dims[0]);
+  recInfo.cols.resize(dims[0]);
+  for (size_t i = 0; i < dims[0]; ++i) {
+    recInfo.rows[i] = data[i].first;
+    recInfo.cols[i] = data[i].second;
+  }
+}
+
+long long BrwReader::availableFrames() const {
+  int channels = recInfo.channelCount();
+  if (channels == 0)
+    return 0;
+  return std::min(recInfo.nRecFrames,
+                  static_cast<long long>(rawElements / channels));
+}
+
+void BrwReader::readFrames(long long firstFrame, long long frameCount,
+                           std::vector<int16_t> &counts) {
+  hsize_t channels = static_cast<hsize_t>(recInfo.channelCount());
+  hsize_t offset = static_cast<hsize_t>(firstFrame) * channels;
+  hsize_t count = static_cast<hsize_t>(frameCount) * channels;
+  if (frameCount < 0 || offset + count > rawElements) {
+    throw std::out_of_range("Frame range exceeds raw data");
+  }
+
+  counts.resize(count);
+  if (count == 0)
+    return;
+
+  H5::DataSpace fileSpace = raw.getSpace();
+  fileSpace.selectHyperslab(H5S_SELECT_SET, &count, &offset);
+  H5::DataSpace memSpace(1, &count);
+  raw.read(counts.data(), H5::PredType::NATIVE_INT16, memSpace, fileSpace);
+}
@@ -0,0 +1,59 @@
+#ifndef BRWREADER_H
+#define BRWREADER_H
+
+#include <H5Cpp.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ChannelData {
+  std::vector<double> signal;
+  std::vector<int> name;
+};
+
+// Recording parameters from /3BRecInfo plus the electrode layout.
+struct BrwInfo {
+  long long nRecFrames;
+  double samplingRate;
+  double signalInversion;
+  double maxUVolt;
+  double minUVolt;
+  int bitDepth;
+  double adcCountsToMV;
+  double mvOffset;
+  std::vector<int> rows;
+  std::vector<int> cols;
+
+  int channelCount() const { return static_cast<int>(rows.size()); }
+  double toMilliVolts(int16_t count) const {
+    return (count * adcCountsToMV + mvOffset) / 1000000.0;
+  }
+};
+
+// Streams /3BData/Raw in blocks of frames. The dataset is frame-interleaved:
+// frame i holds one ADC count per channel, in /3BRecInfo/3BMeaStreams/Raw/Chs
+// order.
+class BrwReader {
+public:
+  explicit BrwReader(const std::string &filePath);
+
+  const BrwInfo &info() const { return recInfo; }
+  hsize_t rawSize() const { return rawElements; }
+  long long availableFrames() const;
+
+  // Reads frames [firstFrame, firstFrame + frameCount) as raw ADC counts,
+  // frame-major.
+  void readFrames(long long firstFrame, long long frameCount,
+                  std::vector<int16_t> &counts);
+
+private:
+  double readScalar(const std::string &path);
+  void readChannels();
+
+  H5::H5File file;
+  H5::DataSet raw;
+  BrwInfo recInfo;
+  hsize_t rawElements;
+};
+
+#endif // BRWREADER_H
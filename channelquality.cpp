@@ -0,0 +1,165 @@
+#include "channelquality.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+const int SLICE_CHANNELS = 256;
+const double LINE_FREQUENCIES[] = {50.0, 60.0};
+}
+
+QualityAccumulator::QualityAccumulator(const BrwInfo &info)
+    : channels(info.channelCount()), samplingRate(info.samplingRate),
+      countsToMv(std::abs(info.adcCountsToMV) / 1000000.0) {
+  if (info.bitDepth > 0 && info.bitDepth < 16) {
+    lowCode = 0;
+    highCode = static_cast<int16_t>((1 << info.bitDepth) - 1);
+  } else {
+    lowCode = std::numeric_limits<int16_t>::min();
+    highCode = std::numeric_limits<int16_t>::max();
+  }
+  for (double frequency : LINE_FREQUENCIES) {
+    if (frequency < samplingRate / 2) {
+      lineCoefficients.push_back(
+          2.0 * std::cos(2.0 * M_PI * frequency / samplingRate));
+    }
+  }
+
+  saturated.assign(channels, 0);
+  last.assign(channels, 0);
+  run.assign(channels, 0);
+  longestRun.assign(channels, 0);
+  lineEnergy.assign(lineCoefficients.size() * channels, 0.0);
+  blockEnergy.assign(channels, 0.0);
+}
+
+void QualityAccumulator::processSlice(const int16_t *counts,
+                                      std::size_t frameCount, int first,
+                                      int end) {
+  const int width = end - first;
+  const std::size_t lines = lineCoefficients.size();
+  // Offsets by the block's first frame keep the sums and the Goertzel
+  // filters clear of the large DC level in the counts
+  std::vector<double> origin(counts + first, counts + end);
+  std::vector<double> sums(width, 0.0), power(width, 0.0);
+  std::vector<double> s1(lines * width, 0.0), s2(lines * width, 0.0);
+
+  long long *__restrict sat = saturated.data() + first;
+  int16_t *__restrict previous = last.data() + first;
+  uint32_t *__restrict runs = run.data() + first;
+  uint32_t *__restrict longest = longestRun.data() + first;
+  const bool continued = frames > 0;
+  for (std::size_t f = 0; f < frameCount; ++f) {
+    const int16_t *__restrict in = counts + f * channels + first;
+    if (f == 0 && !continued) {
+      std::copy(in, in + width, previous);
+    }
+    for (int c = 0; c < width; ++c) {
+      int16_t v = in[c];
+      sat[c] += (v <= lowCode) | (v >= highCode);
+      runs[c] = v == previous[c] ? runs[c] + 1 : 1;
+      longest[c] = std::max(longest[c], runs[c]);
+      previous[c] = v;
+    }
+    for (int c = 0; c < width; ++c) {
+      double x = in[c] - origin[c];
+      sums[c] += x;
+      power[c] += x * x;
+    }
+    for (std::size_t k = 0; k < lines; ++k) {
+      const double coefficient = lineCoefficients[k];
+      double *__restrict a = s1.data() + k * width;
+      double *__restrict b = s2.data() + k * width;
+      for (int c = 0; c < width; ++c) {
+        double x = in[c] - origin[c];
+        double next = x + coefficient * a[c] - b[c];
+        b[c] = a[c];
+        a[c] = next;
+      }
+    }
+  }
+
+  const double n = static_cast<double>(frameCount);
+  for (int c = 0; c < width; ++c) {
+    blockEnergy[first + c] += std::max(0.0, power[c] - sums[c] * sums[c] / n);
+  }
+  // A sinusoid of amplitude A gives |X|^2 = (A n / 2)^2, so 2 |X|^2 / n is
+  // its energy over the block
+  for (std::size_t k = 0; k < lines; ++k) {
+    const double coefficient = lineCoefficients[k];
+    for (int c = 0; c < width; ++c) {
+      double a = s1[k * width + c], b = s2[k * width + c];
+      double magnitude = a * a + b * b - coefficient * a * b;
+      lineEnergy[k * channels + first + c] += 2.0 * magnitude / n;
+    }
+  }
+}
+
+void QualityAccumulator::process(const int16_t *counts,
+                                 std::size_t frameCount) {
+  if (frameCount == 0 || channels == 0)
+    return;
+  std::size_t slices = (channels + SLICE_CHANNELS - 1) / SLICE_CHANNELS;
+  parallelFor(slices, [&](std::size_t slice) {
+    int first = static_cast<int>(slice) * SLICE_CHANNELS;
+    processSlice(counts, frameCount, first,
+                 std::min(channels, first + SLICE_CHANNELS));
+  });
+  frames += static_cast<long long>(frameCount);
+}
+
+std::vector<ChannelQuality>
+QualityAccumulator::result(const QualitySettings &settings) const {
+  std::vector<ChannelQuality> quality(channels);
+  if (frames == 0)
+    return quality;
+
+  for (int c = 0; c < channels; ++c) {
+    ChannelQuality &q = quality[c];
+    q.stdMv = std::sqrt(blockEnergy[c] / frames) * countsToMv;
+    q.saturationFraction = static_cast<double>(saturated[c]) / frames;
+    q.longestFlatSeconds =
+        samplingRate > 0 ? longestRun[c] / samplingRate : 0.0;
+    for (std::size_t k = 0; k < lineCoefficients.size(); ++k) {
+      if (blockEnergy[c] > 0) {
+        q.lineNoiseFraction = std::max(
+            q.lineNoiseFraction, lineEnergy[k * channels + c] / blockEnergy[c]);
+      }
+    }
+  }
+  classifyChannels(quality, settings);
+  return quality;
+}
+
+void classifyChannels(std::vector<ChannelQuality> &quality,
+                      const QualitySettings &settings) {
+  std::vector<double> levels;
+  for (const ChannelQuality &q : quality) {
+    if (q.stdMv > 0) {
+      levels.push_back(q.stdMv);
+    }
+  }
+  double median = 0.0;
+  if (!levels.empty()) {
+    auto middle = levels.begin() + levels.size() / 2;
+    std::nth_element(levels.begin(), middle, levels.end());
+    median = *middle;
+  }
+  for (ChannelQuality &q : quality) {
+    q.usable = !settings.enabled ||
+               (q.stdMv > 0 &&
+                q.saturationFraction <= settings.maxSaturationFraction &&
+                q.longestFlatSeconds < settings.maxFlatSeconds &&
+                q.stdMv <= settings.maxNoiseRatio * median &&
+                q.lineNoiseFraction <= settings.maxLineNoiseFraction);
+  }
+}
+
+std::vector<char> usableMask(const std::vector<ChannelQuality> &quality) {
+  std::vector<char> mask(quality.size());
+  for (std::size_t c = 0; c < quality.size(); ++c) {
+    mask[c] = quality[c].usable;
+  }
+  return mask;
+}
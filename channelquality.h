@@ -0,0 +1,74 @@
+#ifndef CHANNELQUALITY_H
+#define CHANNELQUALITY_H
+
+#include "brwreader.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct QualitySettings {
+  bool enabled = true;
+  double maxSaturationFraction = 0.01;
+  double maxFlatSeconds = 0.5;
+  // Channels noisier than this many times the median channel are dropped
+  double maxNoiseRatio = 5.0;
+  // Share of the signal power at 50 or 60 Hz
+  double maxLineNoiseFraction = 0.5;
+};
+
+struct ChannelQuality {
+  double stdMv = 0.0;
+  double saturationFraction = 0.0;
+  double longestFlatSeconds = 0.0;
+  double lineNoiseFraction = 0.0;
+  bool usable = true;
+};
+
+// One entry per channel, nonzero when the channel is usable. An empty mask
+// means every channel is.
+inline bool channelUsable(const std::vector<char> &mask, std::size_t channel) {
+  return mask.empty() || mask[channel];
+}
+
+// Sets usable on every channel from its statistics
+void classifyChannels(std::vector<ChannelQuality> &quality,
+                      const QualitySettings &settings);
+std::vector<char> usableMask(const std::vector<ChannelQuality> &quality);
+
+// Gathers quality statistics from frame-major ADC counts while a recording
+// is loaded. Each block is split into slices of channels that are walked in
+// parallel, so every statistic is a contiguous, branch-free update across
+// channels. Line noise is measured with Goertzel filters restarted on every
+// block.
+class QualityAccumulator {
+public:
+  explicit QualityAccumulator(const BrwInfo &info);
+
+  void process(const int16_t *counts, std::size_t frameCount);
+  // Quality of every channel over the frames seen so far
+  std::vector<ChannelQuality> result(const QualitySettings &settings) const;
+
+private:
+  void processSlice(const int16_t *counts, std::size_t frameCount,
+                    int first, int end);
+
+  int channels;
+  double samplingRate;
+  double countsToMv;
+  int16_t lowCode;
+  int16_t highCode;
+  long long frames = 0;
+  // Goertzel coefficients, 2 cos(w), of the line frequencies below Nyquist
+  std::vector<double> lineCoefficients;
+
+  std::vector<long long> saturated;
+  std::vector<int16_t> last;
+  std::vector<uint32_t> run;
+  std::vector<uint32_t> longestRun;
+  // Per line frequency, then per channel
+  std::vector<double> lineEnergy;
+  // Signal energy about each block's mean
+  std::vector<double> blockEnergy;
+};
+
+#endif // CHANNELQUALITY_H
@@ -120,9 +120,11 @@ void ColorCell::setColor(const QColor &color, qreal strength, qreal opacity) {
   setBrush(QBrush(rgb_color));
 }
 
-void ColorCell::setText(const QString &text) {
+void ColorCell::setText(const QString &text, bool repaint) {
   this->text = text;
-  update();
+  if (repaint) {
+    update();
+  }
 }
 
 void ColorCell::hideSelectedTooltip() { selected_tooltip->hide(); }
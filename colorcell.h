@@ -21,7 +21,8 @@ public:
     void hideSelectedTooltip();
     void hideHoverTooltip();
     void setColor(const QColor &color, qreal strength = 1.0, qreal opacity = 1.0);
-    void setText(const QString &text);
+    // Pass repaint = false when updating many cells and repaint once after
+    void setText(const QString &text, bool repaint = true);
 
     int row, col;
     bool clicked_state;
@@ -0,0 +1,281 @@
+#include "connectivity.h"
+#include "memoryledger.h"
+#include "parallel.h"
+#include "taskpool.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                   \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CONNECTIVITY_SIMD_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define CONNECTIVITY_SIMD_NEON
+#endif
+
+namespace {
+const int TILE_CHANNELS = 64;
+const std::size_t TILE_FRAMES = 256;
+const std::size_t CACHE_ENTRIES = 2;
+
+// Adds the products of 4 rows (from column i) and 8 columns (from column j)
+// over frames [t0, t1) at lag to sums, a 4 x 8 block of a tile with row
+// stride TILE_CHANNELS. The block's sums stay in registers over all frames.
+void accumulateBlock(const float *z, int stride, std::size_t t0,
+                     std::size_t t1, int lag, int maxLag, int i, int j,
+                     float *sums) {
+#if defined(CONNECTIVITY_SIMD_SSE2)
+  __m128 s[4][2];
+  for (int r = 0; r < 4; ++r) {
+    s[r][0] = s[r][1] = _mm_setzero_ps();
+  }
+  for (std::size_t t = t0; t < t1; ++t) {
+    const float *a = z + (t + maxLag) * stride + i;
+    const float *b = z + (t + maxLag + lag) * stride + j;
+    const __m128 b0 = _mm_loadu_ps(b), b1 = _mm_loadu_ps(b + 4);
+    for (int r = 0; r < 4; ++r) {
+      const __m128 ar = _mm_set1_ps(a[r]);
+      s[r][0] = _mm_add_ps(s[r][0], _mm_mul_ps(ar, b0));
+      s[r][1] = _mm_add_ps(s[r][1], _mm_mul_ps(ar, b1));
+    }
+  }
+  for (int r = 0; r < 4; ++r) {
+    float *row = sums + r * TILE_CHANNELS;
+    _mm_storeu_ps(row, _mm_add_ps(_mm_loadu_ps(row), s[r][0]));
+    _mm_storeu_ps(row + 4, _mm_add_ps(_mm_loadu_ps(row + 4), s[r][1]));
+  }
+#elif defined(CONNECTIVITY_SIMD_NEON)
+  float32x4_t s[4][2];
+  for (int r = 0; r < 4; ++r) {
+    s[r][0] = s[r][1] = vdupq_n_f32(0.0f);
+  }
+  for (std::size_t t = t0; t < t1; ++t) {
+    const float *a = z + (t + maxLag) * stride + i;
+    const float *b = z + (t + maxLag + lag) * stride + j;
+    const float32x4_t b0 = vld1q_f32(b), b1 = vld1q_f32(b + 4);
+    for (int r = 0; r < 4; ++r) {
+      s[r][0] = vmlaq_n_f32(s[r][0], b0, a[r]);
+      s[r][1] = vmlaq_n_f32(s[r][1], b1, a[r]);
+    }
+  }
+  for (int r = 0; r < 4; ++r) {
+    float *row = sums + r * TILE_CHANNELS;
+    vst1q_f32(row, vaddq_f32(vld1q_f32(row), s[r][0]));
+    vst1q_f32(row + 4, vaddq_f32(vld1q_f32(row + 4), s[r][1]));
+  }
+#else
+  float s[4][8] = {};
+  for (std::size_t t = t0; t < t1; ++t) {
+    const float *a = z + (t + maxLag) * stride + i;
+    const float *b = z + (t + maxLag + lag) * stride + j;
+    for (int r = 0; r < 4; ++r) {
+      for (int c = 0; c < 8; ++c) {
+        s[r][c] += a[r] * b[c];
+      }
+    }
+  }
+  for (int r = 0; r < 4; ++r) {
+    for (int c = 0; c < 8; ++c) {
+      sums[r * TILE_CHANNELS + c] += s[r][c];
+    }
+  }
+#endif
+}
+
+// Correlations of rows [i0, i1) against the TILE_CHANNELS columns from j0
+// at lag, into acc (TILE_CHANNELS x TILE_CHANNELS). The matrix has stride
+// columns and is padded so whole blocks can always be read.
+void accumulateTile(const float *z, int stride, std::size_t frames, int lag,
+                    int maxLag, int i0, int i1, int j0, float *acc) {
+  std::fill(acc, acc + TILE_CHANNELS * TILE_CHANNELS, 0.0f);
+  for (std::size_t t0 = 0; t0 < frames; t0 += TILE_FRAMES) {
+    std::size_t t1 = std::min(frames, t0 + TILE_FRAMES);
+    for (int i = i0; i < i1; i += 4) {
+      for (int j = 0; j < TILE_CHANNELS; j += 8) {
+        accumulateBlock(z, stride, t0, t1, lag, maxLag, i, j0 + j,
+                        acc + (i - i0) * TILE_CHANNELS + j);
+      }
+    }
+  }
+}
+
+// FNV-1a over the mask, so matrices of different masks never match
+uint64_t hashMask(const std::vector<char> &mask) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (char used : mask) {
+    hash = (hash ^ static_cast<unsigned char>(used != 0)) * 0x100000001b3ull;
+  }
+  return hash;
+}
+}
+
+std::shared_ptr<const ConnectivityMatrix>
+ConnectivityEngine::compute(const std::vector<ChannelData> &channels,
+                            const std::vector<char> &mask,
+                            double samplingRate, double startSeconds,
+                            double stopSeconds, int maxLag,
+                            uint64_t generation) {
+  const uint64_t maskHash = hashMask(mask);
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    for (const auto &entry : cache) {
+      if (entry->generation == generation && entry->maskHash == maskHash &&
+          entry->startSeconds == startSeconds &&
+          entry->stopSeconds == stopSeconds && entry->maxLag == maxLag &&
+          entry->channels == static_cast<int>(channels.size())) {
+        return entry;
+      }
+    }
+  }
+
+  ScopedTrace trace("connectivity");
+  const int total = static_cast<int>(channels.size());
+  if (total == 0 || samplingRate <= 0)
+    throw std::invalid_argument("No channels loaded");
+  // Only usable channels enter the product; index u of the dense matrix is
+  // channel used[u]
+  std::vector<int> used;
+  for (int c = 0; c < total; ++c) {
+    if (channelUsable(mask, c)) {
+      used.push_back(c);
+    }
+  }
+  const int count = static_cast<int>(used.size());
+  if (maxLag < 0 || maxLag > INT16_MAX)
+    throw std::out_of_range("Lag out of range");
+  std::size_t length = channels[0].signal.size();
+  std::size_t first = static_cast<std::size_t>(
+      std::max(0.0, std::floor(startSeconds * samplingRate)));
+  std::size_t last = std::min(
+      length, static_cast<std::size_t>(
+                  std::max(0.0, std::ceil(stopSeconds * samplingRate))));
+  if (last <= first + 1)
+    throw std::invalid_argument("Empty time window");
+  const std::size_t frames = last - first;
+
+  // z-score every channel, scaled so a dot product is a correlation. maxLag
+  // zero frames on each side let shifted windows run off the ends.
+  const int stride =
+      (count + TILE_CHANNELS - 1) / TILE_CHANNELS * TILE_CHANNELS;
+  const std::size_t zBytes = (frames + 2 * maxLag) * stride * sizeof(float);
+  if (overMemoryBudget(MemorySubsystem::Caches, zBytes))
+    throw std::length_error(
+        "Connectivity window needs " +
+        std::to_string(zBytes / (1024 * 1024)) +
+        " MB, over the cache budget; choose a shorter window");
+  std::vector<float> z((frames + 2 * maxLag) * stride, 0.0f);
+  parallelFor(count, [&](std::size_t c) {
+    const std::vector<double> &signal = channels[used[c]].signal;
+    std::size_t end = std::min(last, signal.size());
+    if (end <= first)
+      return;
+    double mean = 0, squares = 0;
+    for (std::size_t t = first; t < end; ++t) {
+      mean += signal[t];
+    }
+    mean /= end - first;
+    for (std::size_t t = first; t < end; ++t) {
+      squares += (signal[t] - mean) * (signal[t] - mean);
+    }
+    if (squares <= 0)
+      return;
+    double scale = 1.0 / std::sqrt(squares);
+    for (std::size_t t = first; t < end; ++t) {
+      z[(t - first + maxLag) * stride + c] =
+          static_cast<float>((signal[t] - mean) * scale);
+    }
+  });
+
+  auto result = std::make_shared<ConnectivityMatrix>();
+  result->channels = total;
+  result->startSeconds = startSeconds;
+  result->stopSeconds = stopSeconds;
+  result->maxLag = maxLag;
+  result->generation = generation;
+  result->maskHash = maskHash;
+  result->correlation.assign(static_cast<std::size_t>(total) * total, 0.0f);
+  if (maxLag > 0) {
+    result->lag.assign(static_cast<std::size_t>(total) * total, 0);
+  }
+
+  // Only tiles on or above the diagonal are computed; the matrix is
+  // mirrored into the lower half.
+  int tiles = (count + TILE_CHANNELS - 1) / TILE_CHANNELS;
+  std::vector<std::pair<int, int>> pairs;
+  for (int a = 0; a < tiles; ++a) {
+    for (int b = a; b < tiles; ++b) {
+      pairs.emplace_back(a, b);
+    }
+  }
+  parallelFor(pairs.size(), [&](std::size_t p) {
+    int i0 = pairs[p].first * TILE_CHANNELS;
+    int i1 = std::min(count, i0 + TILE_CHANNELS);
+    int j0 = pairs[p].second * TILE_CHANNELS;
+    int j1 = std::min(count, j0 + TILE_CHANNELS);
+    // Rows past i1 are padding, computed and then dropped
+    int i4 = i0 + (i1 - i0 + 3) / 4 * 4;
+    std::vector<float> acc(TILE_CHANNELS * TILE_CHANNELS);
+    std::vector<float> best(TILE_CHANNELS * TILE_CHANNELS, 0.0f);
+    std::vector<int16_t> bestLag(TILE_CHANNELS * TILE_CHANNELS, 0);
+    for (int lag = -maxLag; lag <= maxLag; ++lag) {
+      accumulateTile(z.data(), stride, frames, lag, maxLag, i0, i4, j0,
+                     acc.data());
+      for (std::size_t k = 0; k < acc.size(); ++k) {
+        if (lag == -maxLag || std::abs(acc[k]) > std::abs(best[k])) {
+          best[k] = acc[k];
+          bestLag[k] = static_cast<int16_t>(lag);
+        }
+      }
+    }
+    for (int i = i0; i < i1; ++i) {
+      for (int j = j0; j < j1; ++j) {
+        std::size_t k = (i - i0) * TILE_CHANNELS + (j - j0);
+        std::size_t ij = static_cast<std::size_t>(used[i]) * total + used[j];
+        std::size_t ji = static_cast<std::size_t>(used[j]) * total + used[i];
+        result->correlation[ij] = best[k];
+        result->correlation[ji] = best[k];
+        if (maxLag > 0) {
+          result->lag[ij] = bestLag[k];
+          result->lag[ji] = -bestLag[k];
+        }
+      }
+    }
+  });
+
+  // A cancelled parallelFor leaves part of the matrix unfilled
+  if (TaskPool::currentToken().cancelled())
+    throw std::runtime_error("Connectivity cancelled");
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  if (generation != currentGeneration)
+    return result;
+  cache.push_front(result);
+  if (cache.size() > CACHE_ENTRIES) {
+    cache.pop_back();
+  }
+  return result;
+}
+
+std::size_t ConnectivityEngine::memoryBytes() const {
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  std::size_t bytes = 0;
+  for (const auto &entry : cache) {
+    bytes += entry->correlation.capacity() * sizeof(float) +
+             entry->lag.capacity() * sizeof(int16_t);
+  }
+  return bytes;
+}
+
+void ConnectivityEngine::trim(std::size_t maxBytes) {
+  std::size_t bytes = memoryBytes();
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  while (!cache.empty() && bytes > maxBytes) {
+    const ConnectivityMatrix &last = *cache.back();
+    bytes -= last.correlation.capacity() * sizeof(float) +
+             last.lag.capacity() * sizeof(int16_t);
+    cache.pop_back();
+  }
+}
@@ -0,0 +1,66 @@
+#ifndef CONNECTIVITY_H
+#define CONNECTIVITY_H
+
+#include "brwreader.h"
+#include "channelquality.h"
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Pairwise correlation of all channels over one time window. With lags,
+// correlation holds the peak over lags of |r| (keeping its sign) and lag
+// the offset in samples at which channel j best follows channel i. Rows and
+// columns of masked channels are zero.
+struct ConnectivityMatrix {
+  int channels = 0;
+  double startSeconds = 0;
+  double stopSeconds = 0;
+  int maxLag = 0;
+  uint64_t generation = 0;
+  uint64_t maskHash = 0;
+  std::vector<float> correlation; // channels x channels, row-major
+  std::vector<int16_t> lag;       // empty when maxLag == 0
+
+  float at(int i, int j) const { return correlation[i * channels + j]; }
+};
+
+// Computes and caches connectivity matrices. The window is z-scored into a
+// time-major float matrix and every pair of channel tiles is accumulated
+// like a blocked matrix product, with the inner loop running across the
+// channels of a tile. Tile pairs are spread over threads. compute() may run
+// on a pool thread while the GUI clears or trims the cache; it is passed the
+// generation() read when its inputs were taken, and a result from an older
+// generation is returned but not cached. Cached matrices are matched on the
+// window, lag, channel count, mask and generation.
+class ConnectivityEngine {
+public:
+  // Throws if the current task token is cancelled mid-way
+  std::shared_ptr<const ConnectivityMatrix>
+  compute(const std::vector<ChannelData> &channels,
+          const std::vector<char> &mask, double samplingRate,
+          double startSeconds, double stopSeconds, int maxLag,
+          uint64_t generation);
+  uint64_t generation() const {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    return currentGeneration;
+  }
+  // Empties the cache and starts a new generation
+  void clear() {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cache.clear();
+    ++currentGeneration;
+  }
+  std::size_t memoryBytes() const;
+  // Drops the least recently computed matrices until the rest fit in
+  // maxBytes.
+  void trim(std::size_t maxBytes);
+
+private:
+  mutable std::mutex cacheMutex;
+  uint64_t currentGeneration = 0;
+  std::list<std::shared_ptr<const ConnectivityMatrix>> cache;
+};
+
+#endif // CONNECTIVITY_H
@@ -2,5 +2,14 @@
 #define CONSTANTS_H
 
 const int PLOT_COUNT = 4;
+const int MINIMAP_OVERVIEW_POINTS = 2000;
+const int PREVIEW_POINTS = 8192;
+const int INTERACTIVE_FRAME_MS = 33;
+const int REFINE_DELAY_MS = 150;
+const int LOADER_BLOCK_FRAMES = 2048;
+const int MAX_RATE_BINS = 20000;
+const int GRID_SIZE = 64;
+// Highest low-pass cutoff offered, as a fraction of the sampling rate
+const double MAX_CUTOFF_FRACTION = 0.45;
 
 #endif // CONSTANTS_H
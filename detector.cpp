@@ -0,0 +1,115 @@
+#include "detector.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// Sums of the per-sample feature over consecutive blocks of step samples.
+// A window of stepsPerWindow blocks is then the difference of two entries.
+std::vector<double> blockSums(const std::vector<double> &signal, bool lineLength,
+                              std::size_t step) {
+  std::size_t blocks = signal.size() / step;
+  std::vector<double> sums(blocks + 1, 0.0);
+  double running = 0.0;
+  for (std::size_t b = 0; b < blocks; ++b) {
+    const double *samples = signal.data() + b * step;
+    double total = 0.0;
+    if (lineLength) {
+      double last = b == 0 ? samples[0] : samples[-1];
+      for (std::size_t i = 0; i < step; ++i) {
+        total += std::abs(samples[i] - last);
+        last = samples[i];
+      }
+    } else {
+      for (std::size_t i = 0; i < step; ++i) {
+        total += samples[i];
+      }
+    }
+    running += total;
+    sums[b + 1] = running;
+  }
+  return sums;
+}
+}
+
+void computeFeatures(const std::vector<ChannelData> &channels,
+                     const std::vector<char> &mask,
+                     const std::vector<std::vector<double>> &envelopes,
+                     double samplingRate, const DetectionSettings &settings,
+                     DetectionFeatures &features) {
+  features.values.resize(channels.size());
+  if (samplingRate <= 0)
+    return;
+
+  std::size_t step = std::max<std::size_t>(
+      1, std::lround(settings.stepSeconds * samplingRate));
+  std::size_t stepsPerWindow = std::max<std::size_t>(
+      1, std::lround(settings.windowSeconds / settings.stepSeconds));
+  features.stepSeconds = step / samplingRate;
+  features.windowSeconds = stepsPerWindow * features.stepSeconds;
+
+  parallelFor(channels.size(), [&](std::size_t c) {
+    if (!channelUsable(mask, c))
+      return;
+    std::vector<double> &feature = features.values[c];
+    feature.clear();
+    bool hasEnvelope = c < envelopes.size() && !envelopes[c].empty();
+    std::vector<double> sums =
+        blockSums(hasEnvelope ? envelopes[c] : channels[c].signal,
+                  !hasEnvelope, step);
+    if (sums.size() <= stepsPerWindow)
+      return;
+    feature.resize(sums.size() - stepsPerWindow);
+    for (std::size_t w = 0; w < feature.size(); ++w) {
+      feature[w] = sums[w + stepsPerWindow] - sums[w];
+    }
+  });
+}
+
+void detectIntervals(const DetectionFeatures &features,
+                     const std::vector<char> &mask,
+                     const DetectionSettings &settings,
+                     std::vector<ChannelEvents> &events) {
+  events.resize(features.values.size());
+  const double stepSeconds = features.stepSeconds;
+  const double windowSeconds = features.windowSeconds;
+  parallelFor(features.values.size(), [&](std::size_t c) {
+    if (!channelUsable(mask, c))
+      return;
+    ChannelEvents &channelEvents = events[c];
+    channelEvents = ChannelEvents();
+    const std::vector<double> &feature = features.values[c];
+    if (feature.empty())
+      return;
+
+    std::vector<double> sorted(feature);
+    auto middle = sorted.begin() + sorted.size() / 2;
+    std::nth_element(sorted.begin(), middle, sorted.end());
+    double threshold = *middle * settings.thresholdRatio;
+    if (threshold <= 0)
+      return;
+
+    // Join active windows into runs, bridging gaps up to mergeGapSeconds
+    std::vector<Region> runs;
+    for (std::size_t w = 0; w < feature.size(); ++w) {
+      if (feature[w] <= threshold)
+        continue;
+      double begin = w * stepSeconds;
+      double end = begin + windowSeconds;
+      if (!runs.empty() && begin - runs.back().stop <= settings.mergeGapSeconds) {
+        runs.back().stop = end;
+      } else {
+        runs.push_back({begin, end});
+      }
+    }
+
+    for (const Region &run : runs) {
+      double duration = run.stop - run.start;
+      if (duration >= settings.seMinSeconds) {
+        channelEvents.se.push_back(run);
+      } else if (duration >= settings.seizureMinSeconds) {
+        channelEvents.seizures.push_back(run);
+      }
+    }
+  });
+}
@@ -0,0 +1,52 @@
+#ifndef DETECTOR_H
+#define DETECTOR_H
+
+#include "brwreader.h"
+#include "channelquality.h"
+#include "regionindex.h"
+#include <vector>
+
+struct DetectionSettings {
+  double windowSeconds = 1.0;
+  double stepSeconds = 0.5;
+  // A window is active when its feature exceeds the channel's median
+  // feature by this factor.
+  double thresholdRatio = 3.0;
+  double mergeGapSeconds = 5.0;
+  double seizureMinSeconds = 10.0;
+  // Events lasting at least this long are reported as SE
+  double seMinSeconds = 300.0;
+};
+
+struct ChannelEvents {
+  std::vector<Region> seizures;
+  std::vector<Region> se;
+};
+
+// Per-channel window features on the step grid of the settings that
+// produced them. Entry w covers [w * stepSeconds, w * stepSeconds +
+// windowSeconds).
+struct DetectionFeatures {
+  double stepSeconds = 0.0;
+  double windowSeconds = 0.0;
+  std::vector<std::vector<double>> values;
+};
+
+// Computes the window features of the channels in mask, in parallel. The
+// feature is the mean envelope over each window when an envelope is given
+// for a channel, and the signal's line length otherwise. Only
+// windowSeconds and stepSeconds are used; other channels keep their entry.
+void computeFeatures(const std::vector<ChannelData> &channels,
+                     const std::vector<char> &mask,
+                     const std::vector<std::vector<double>> &envelopes,
+                     double samplingRate, const DetectionSettings &settings,
+                     DetectionFeatures &features);
+
+// Turns the features of the channels in mask into seizure and SE intervals
+// (in seconds), in parallel. Other channels keep their entry.
+void detectIntervals(const DetectionFeatures &features,
+                     const std::vector<char> &mask,
+                     const DetectionSettings &settings,
+                     std::vector<ChannelEvents> &events);
+
+#endif // DETECTOR_H
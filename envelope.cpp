@@ -0,0 +1,186 @@
+#include "envelope.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+const int MAX_HILBERT_TAPS = 255;
+const std::size_t ENVELOPE_BLOCK_CHANNELS = 16;
+const std::size_t ENVELOPE_TILE_FRAMES = 256;
+}
+
+EnvelopeBank::EnvelopeBank(EnvelopeMode mode, int window, int channels)
+    : mode(mode), window(std::max(1, window)), channels(channels) {
+  if (mode == EnvelopeMode::Hilbert) {
+    // An odd length keeps the transformer's delay a whole number of frames
+    this->window = std::min(std::max(3, this->window | 1), MAX_HILBERT_TAPS);
+    int center = (this->window - 1) / 2;
+    taps.assign(this->window, 0.0);
+    for (int n = 0; n < this->window; ++n) {
+      int offset = n - center;
+      if (offset % 2 != 0) {
+        double hamming =
+            0.54 - 0.46 * std::cos(2 * M_PI * n / (this->window - 1));
+        taps[n] = 2.0 / (M_PI * offset) * hamming;
+      }
+    }
+  }
+  reset();
+}
+
+int EnvelopeBank::delay() const { return (window - 1) / 2; }
+
+void EnvelopeBank::reset() {
+  std::size_t rows = mode == EnvelopeMode::Hilbert ? 2 * window : window;
+  history.assign(rows * channels, 0.0);
+  sums.assign(channels, 0.0);
+  previous.assign(channels, 0.0);
+  scratch.assign(channels, 0.0);
+  position = 0;
+  filled = 0;
+}
+
+void EnvelopeBank::process(double *frames, std::size_t frameCount) {
+  for (std::size_t i = 0; i < frameCount; ++i) {
+    processFrame(frames + i * channels);
+  }
+}
+
+void EnvelopeBank::processFrame(double *__restrict frame) {
+  double *__restrict slot = history.data() + position * channels;
+  double *__restrict sum = sums.data();
+  if (filled < window) {
+    ++filled;
+  }
+
+  switch (mode) {
+  case EnvelopeMode::Rms: {
+    double scale = 1.0 / filled;
+    for (int k = 0; k < channels; ++k) {
+      double square = frame[k] * frame[k];
+      sum[k] += square - slot[k];
+      slot[k] = square;
+      frame[k] = std::sqrt(std::max(sum[k] * scale, 0.0));
+    }
+    break;
+  }
+  case EnvelopeMode::LineLength: {
+    double *__restrict last = previous.data();
+    if (filled == 1) {
+      std::copy(frame, frame + channels, last);
+    }
+    for (int k = 0; k < channels; ++k) {
+      double step = std::abs(frame[k] - last[k]);
+      last[k] = frame[k];
+      sum[k] += step - slot[k];
+      slot[k] = step;
+      frame[k] = std::max(sum[k], 0.0);
+    }
+    break;
+  }
+  case EnvelopeMode::Hilbert: {
+    // The ring is stored twice over, so the last window frames are always
+    // contiguous and end at row position + window.
+    std::copy(frame, frame + channels, slot);
+    std::copy(frame, frame + channels, slot + window * channels);
+    const double *newest = slot + window * channels;
+    double *__restrict quadrature = scratch.data();
+    std::fill(quadrature, quadrature + channels, 0.0);
+    for (int n = (delay() + 1) % 2; n < window; n += 2) {
+      const double tap = taps[n];
+      const double *__restrict row = newest - n * channels;
+      for (int k = 0; k < channels; ++k) {
+        quadrature[k] += tap * row[k];
+      }
+    }
+    const double *__restrict center = newest - delay() * channels;
+    for (int k = 0; k < channels; ++k) {
+      frame[k] = std::sqrt(center[k] * center[k] +
+                           quadrature[k] * quadrature[k]);
+    }
+    break;
+  }
+  }
+
+  if (++position == window) {
+    position = 0;
+    if (mode != EnvelopeMode::Hilbert) {
+      // Re-add the window once per wrap so rounding in the running sums
+      // cannot accumulate over hours of data.
+      std::fill(sum, sum + channels, 0.0);
+      for (int n = 0; n < window; ++n) {
+        const double *__restrict row = history.data() + n * channels;
+        for (int k = 0; k < channels; ++k) {
+          sum[k] += row[k];
+        }
+      }
+    }
+  }
+}
+
+int envelopeWindowFrames(const EnvelopeSettings &settings,
+                         double samplingRate) {
+  return std::max(1, static_cast<int>(
+                         std::lround(settings.windowSeconds * samplingRate)));
+}
+
+void computeEnvelopes(const std::vector<ChannelData> &channels,
+                      const std::vector<char> &mask,
+                      const EnvelopeSettings &settings, double samplingRate,
+                      std::vector<std::vector<double>> &envelopes) {
+  envelopes.resize(channels.size());
+  std::vector<std::size_t> used;
+  for (std::size_t c = 0; c < channels.size(); ++c) {
+    if (channelUsable(mask, c)) {
+      envelopes[c].clear();
+      used.push_back(c);
+    }
+  }
+  if (!settings.enabled || used.empty())
+    return;
+
+  int window = envelopeWindowFrames(settings, samplingRate);
+  std::size_t blocks =
+      (used.size() + ENVELOPE_BLOCK_CHANNELS - 1) / ENVELOPE_BLOCK_CHANNELS;
+  parallelFor(blocks, [&](std::size_t block) {
+    std::size_t first = block * ENVELOPE_BLOCK_CHANNELS;
+    int count = static_cast<int>(
+        std::min(ENVELOPE_BLOCK_CHANNELS, used.size() - first));
+    std::size_t length = channels[used[first]].signal.size();
+    for (int c = 1; c < count; ++c) {
+      length = std::min(length, channels[used[first + c]].signal.size());
+    }
+    if (length == 0)
+      return;
+
+    EnvelopeBank bank(settings.mode, window, count);
+    std::size_t delay = bank.delay();
+    for (int c = 0; c < count; ++c) {
+      envelopes[used[first + c]].resize(length);
+    }
+
+    // Stage the block through frame-major tiles, holding the last sample
+    // past the end so the delayed tail is flushed out.
+    std::vector<double> tile(ENVELOPE_TILE_FRAMES * count);
+    for (std::size_t start = 0; start < length + delay;
+         start += ENVELOPE_TILE_FRAMES) {
+      std::size_t frames =
+          std::min(ENVELOPE_TILE_FRAMES, length + delay - start);
+      for (int c = 0; c < count; ++c) {
+        const std::vector<double> &signal = channels[used[first + c]].signal;
+        for (std::size_t f = 0; f < frames; ++f) {
+          tile[f * count + c] = signal[std::min(start + f, length - 1)];
+        }
+      }
+      bank.process(tile.data(), frames);
+      for (int c = 0; c < count; ++c) {
+        std::vector<double> &envelope = envelopes[used[first + c]];
+        for (std::size_t f = 0; f < frames; ++f) {
+          if (start + f >= delay) {
+            envelope[start + f - delay] = tile[f * count + c];
+          }
+        }
+      }
+    }
+  });
+}
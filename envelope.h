@@ -0,0 +1,63 @@
+#ifndef ENVELOPE_H
+#define ENVELOPE_H
+
+#include "brwreader.h"
+#include "channelquality.h"
+#include <cstddef>
+#include <vector>
+
+enum class EnvelopeMode { Rms, LineLength, Hilbert };
+
+struct EnvelopeSettings {
+  bool enabled = false;
+  EnvelopeMode mode = EnvelopeMode::Rms;
+  double windowSeconds = 0.25;
+};
+
+// Streaming envelope of many channels in frame-major blocks. Only the last
+// window frames are kept, so memory does not grow with the input. The RMS
+// and line-length modes update running sums in O(1) per sample; the
+// Hilbert mode is a windowed FIR transformer of at most window taps. Like
+// FilterBank, the inner loops run across channels.
+class EnvelopeBank {
+public:
+  EnvelopeBank(EnvelopeMode mode, int window, int channels);
+
+  int channelCount() const { return channels; }
+  int windowFrames() const { return window; }
+  // Output frame i is the envelope around input frame i - delay().
+  int delay() const;
+  void reset();
+  // Replaces each frame with its envelope.
+  void process(double *frames, std::size_t frameCount);
+
+private:
+  void processFrame(double *frame);
+
+  EnvelopeMode mode;
+  int window;
+  int channels;
+  // The last window frames: squares for RMS, absolute differences for line
+  // length and raw samples for Hilbert.
+  std::vector<double> history;
+  std::vector<double> sums;
+  std::vector<double> previous;
+  std::vector<double> taps;
+  std::vector<double> scratch;
+  int position;
+  int filled;
+};
+
+// Window length in frames used for settings at samplingRate.
+int envelopeWindowFrames(const EnvelopeSettings &settings,
+                         double samplingRate);
+
+// Computes the envelope of the channels in mask, aligned with the signal, in
+// parallel over blocks of channels. Other channels keep their entry; when
+// settings are disabled the selected entries are emptied.
+void computeEnvelopes(const std::vector<ChannelData> &channels,
+                      const std::vector<char> &mask,
+                      const EnvelopeSettings &settings, double samplingRate,
+                      std::vector<std::vector<double>> &envelopes);
+
+#endif // ENVELOPE_H
@@ -0,0 +1,62 @@
+#include "fft.h"
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+
+std::shared_ptr<const FftPlan> FftPlan::get(std::size_t size) {
+  static std::mutex mutex;
+  static std::map<std::size_t, std::shared_ptr<const FftPlan>> plans;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  std::shared_ptr<const FftPlan> &plan = plans[size];
+  if (!plan) {
+    plan = std::make_shared<const FftPlan>(size);
+  }
+  return plan;
+}
+
+FftPlan::FftPlan(std::size_t size) : n(size) {
+  if (n == 0 || (n & (n - 1)) != 0) {
+    throw std::invalid_argument("FFT size must be a power of two");
+  }
+
+  int bits = 0;
+  while ((std::size_t(1) << bits) < n) {
+    ++bits;
+  }
+  bitReversed.resize(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    std::size_t reversed = 0;
+    for (int b = 0; b < bits; ++b) {
+      reversed |= ((i >> b) & 1) << (bits - 1 - b);
+    }
+    bitReversed[i] = reversed;
+  }
+
+  twiddles.resize(n / 2);
+  for (std::size_t k = 0; k < n / 2; ++k) {
+    twiddles[k] = std::polar(1.0, -2.0 * M_PI * k / n);
+  }
+}
+
+void FftPlan::forward(std::complex<double> *data) const {
+  for (std::size_t i = 0; i < n; ++i) {
+    if (i < bitReversed[i]) {
+      std::swap(data[i], data[bitReversed[i]]);
+    }
+  }
+
+  for (std::size_t length = 2; length <= n; length <<= 1) {
+    std::size_t half = length / 2;
+    std::size_t stride = n / length;
+    for (std::size_t start = 0; start < n; start += length) {
+      for (std::size_t k = 0; k < half; ++k) {
+        std::complex<double> t = twiddles[k * stride] * data[start + k + half];
+        data[start + k + half] = data[start + k] - t;
+        data[start + k] += t;
+      }
+    }
+  }
+}
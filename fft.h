@@ -0,0 +1,28 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <complex>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Precomputed twiddles and bit-reversal order for an in-place radix-2 FFT.
+// Plans are immutable once built, so one plan can be shared by any number
+// of threads.
+class FftPlan {
+public:
+  // Returns the cached plan for size, which must be a power of two.
+  static std::shared_ptr<const FftPlan> get(std::size_t size);
+
+  explicit FftPlan(std::size_t size);
+
+  std::size_t size() const { return n; }
+  void forward(std::complex<double> *data) const;
+
+private:
+  std::size_t n;
+  std::vector<std::size_t> bitReversed;
+  std::vector<std::complex<double>> twiddles;
+};
+
+#endif // FFT_H
@@ -0,0 +1,174 @@
+#include "filterbank.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+const std::size_t TILE_FRAMES = 64;
+}
+
+std::vector<Biquad> butterworthLowPass(int order, double cutoffHz,
+                                       double samplingRate) {
+  if (order < 1)
+    throw std::invalid_argument("Low-pass order must be at least 1");
+  if (cutoffHz <= 0 || cutoffHz >= samplingRate / 2) {
+    char message[128];
+    std::snprintf(message, sizeof message,
+                  "Low-pass cutoff of %g Hz is not below half the %g Hz "
+                  "sampling rate",
+                  cutoffHz, samplingRate);
+    throw std::invalid_argument(message);
+  }
+
+  std::vector<Biquad> sections;
+
+  // Bilinear transform with the cutoff pre-warped
+  double k = std::tan(M_PI * cutoffHz / samplingRate);
+  for (int i = 0; i < order / 2; ++i) {
+    double q = 1.0 / (2.0 * std::sin(M_PI * (2 * i + 1) / (2.0 * order)));
+    double norm = 1.0 / (1.0 + k / q + k * k);
+    Biquad section;
+    section.b0 = k * k * norm;
+    section.b1 = 2.0 * section.b0;
+    section.b2 = section.b0;
+    section.a1 = 2.0 * (k * k - 1.0) * norm;
+    section.a2 = (1.0 - k / q + k * k) * norm;
+    sections.push_back(section);
+  }
+  if (order % 2 == 1) {
+    double norm = 1.0 / (1.0 + k);
+    Biquad section;
+    section.b0 = k * norm;
+    section.b1 = section.b0;
+    section.b2 = 0.0;
+    section.a1 = (k - 1.0) * norm;
+    section.a2 = 0.0;
+    sections.push_back(section);
+  }
+  return sections;
+}
+
+FilterBank::FilterBank(std::vector<Biquad> sections, int channels)
+    : sections(std::move(sections)), channels(channels) {
+  state.assign(this->sections.size() * 2 * channels, 0.0);
+}
+
+void FilterBank::reset() { std::fill(state.begin(), state.end(), 0.0); }
+
+void FilterBank::prime(const double *frame) {
+  std::vector<double> level(frame, frame + channels);
+  for (std::size_t s = 0; s < sections.size(); ++s) {
+    const Biquad &bq = sections[s];
+    double gain = (bq.b0 + bq.b1 + bq.b2) / (1.0 + bq.a1 + bq.a2);
+    double *s1 = state.data() + s * 2 * channels;
+    double *s2 = s1 + channels;
+    for (int c = 0; c < channels; ++c) {
+      double x = level[c];
+      double y = gain * x;
+      s2[c] = bq.b2 * x - bq.a2 * y;
+      s1[c] = bq.b1 * x - bq.a1 * y + s2[c];
+      level[c] = y;
+    }
+  }
+}
+
+void FilterBank::processFrame(double *frame) {
+  for (std::size_t s = 0; s < sections.size(); ++s) {
+    const Biquad bq = sections[s];
+    double *__restrict x = frame;
+    double *__restrict s1 = state.data() + s * 2 * channels;
+    double *__restrict s2 = s1 + channels;
+    for (int c = 0; c < channels; ++c) {
+      double in = x[c];
+      double out = bq.b0 * in + s1[c];
+      s1[c] = bq.b1 * in - bq.a1 * out + s2[c];
+      s2[c] = bq.b2 * in - bq.a2 * out;
+      x[c] = out;
+    }
+  }
+}
+
+void FilterBank::process(double *frames, std::size_t frameCount) {
+  for (std::size_t f = 0; f < frameCount; ++f) {
+    processFrame(frames + f * channels);
+  }
+}
+
+void FilterBank::processReverse(double *frames, std::size_t frameCount) {
+  for (std::size_t f = frameCount; f-- > 0;) {
+    processFrame(frames + f * channels);
+  }
+}
+
+void filterChannels(FilterBank &bank, const std::vector<double *> &signals,
+                    std::size_t length) {
+  int channels = bank.channelCount();
+  if (length == 0 || static_cast<int>(signals.size()) != channels)
+    return;
+
+  std::vector<double> tile(TILE_FRAMES * channels);
+  for (std::size_t begin = 0; begin < length; begin += TILE_FRAMES) {
+    std::size_t frames = std::min(TILE_FRAMES, length - begin);
+    for (int c = 0; c < channels; ++c) {
+      const double *signal = signals[c] + begin;
+      for (std::size_t f = 0; f < frames; ++f) {
+        tile[f * channels + c] = signal[f];
+      }
+    }
+    if (begin == 0) {
+      bank.prime(tile.data());
+    }
+    bank.process(tile.data(), frames);
+    for (int c = 0; c < channels; ++c) {
+      double *signal = signals[c] + begin;
+      for (std::size_t f = 0; f < frames; ++f) {
+        signal[f] = tile[f * channels + c];
+      }
+    }
+  }
+}
+
+void filterChannelsReverse(FilterBank &bank,
+                           const std::vector<double *> &signals,
+                           std::size_t length) {
+  int channels = bank.channelCount();
+  if (length == 0 || static_cast<int>(signals.size()) != channels)
+    return;
+
+  std::vector<double> tile(TILE_FRAMES * channels);
+  std::size_t end = length;
+  bool primed = false;
+  while (end > 0) {
+    std::size_t begin = end > TILE_FRAMES ? end - TILE_FRAMES : 0;
+    std::size_t frames = end - begin;
+
+    for (int c = 0; c < channels; ++c) {
+      if (!signals[c]) {
+        for (std::size_t f = 0; f < frames; ++f) {
+          tile[f * channels + c] = 0.0;
+        }
+        continue;
+      }
+      const double *signal = signals[c] + begin;
+      for (std::size_t f = 0; f < frames; ++f) {
+        tile[f * channels + c] = signal[f];
+      }
+    }
+    if (!primed) {
+      bank.prime(tile.data() + (frames - 1) * channels);
+      primed = true;
+    }
+    bank.processReverse(tile.data(), frames);
+    for (int c = 0; c < channels; ++c) {
+      if (!signals[c])
+        continue;
+      double *signal = signals[c] + begin;
+      for (std::size_t f = 0; f < frames; ++f) {
+        signal[f] = tile[f * channels + c];
+      }
+    }
+    end = begin;
+  }
+}
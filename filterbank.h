@@ -0,0 +1,65 @@
+#ifndef FILTERBANK_H
+#define FILTERBANK_H
+
+#include <cstddef>
+#include <vector>
+
+// One second-order section in transposed direct form II, normalized so that
+// a0 == 1.
+struct Biquad {
+  double b0, b1, b2;
+  double a1, a2;
+};
+
+struct LowPassSettings {
+  bool enabled = false;
+  double cutoffHz = 100.0;
+  int order = 4;
+  bool zeroPhase = false;
+};
+
+// Throws std::invalid_argument unless order >= 1 and the cutoff lies
+// strictly between zero and half the sampling rate.
+std::vector<Biquad> butterworthLowPass(int order, double cutoffHz,
+                                       double samplingRate);
+
+// Runs a cascade of biquads over many channels at once. Frames are
+// frame-major (all channels of sample i are contiguous), which is how
+// /3BData/Raw is stored; the inner loop runs across channels, so every SIMD
+// lane filters a different channel and there is no dependency between lanes.
+class FilterBank {
+public:
+  FilterBank(std::vector<Biquad> sections, int channels);
+
+  int channelCount() const { return channels; }
+  void reset();
+  // Sets every section to its steady state for a constant input equal to
+  // frame, which avoids the start-up transient of a zero state.
+  void prime(const double *frame);
+  void process(double *frames, std::size_t frameCount);
+  // Same as process, but walks the frames from last to first.
+  void processReverse(double *frames, std::size_t frameCount);
+
+private:
+  void processFrame(double *frame);
+
+  std::vector<Biquad> sections;
+  int channels;
+  // Per section: channels values of s1 followed by channels values of s2
+  std::vector<double> state;
+};
+
+// Runs bank forwards in time over channel-major signals, primed on their
+// first samples, staged through frame-major tiles like the reverse pass.
+void filterChannels(FilterBank &bank, const std::vector<double *> &signals,
+                    std::size_t length);
+
+// Runs bank backwards in time over channel-major signals, e.g. the second
+// pass of a zero-phase filter. Signals are staged through small frame-major
+// tiles so the backward pass vectorizes the same way as the forward one.
+// Null signals are skipped; their lanes filter zeros.
+void filterChannelsReverse(FilterBank &bank,
+                           const std::vector<double *> &signals,
+                           std::size_t length);
+
+#endif // FILTERBANK_H
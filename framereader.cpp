@@ -0,0 +1,193 @@
+#include "framereader.h"
+#include "constants.h"
+#include "memoryledger.h"
+#include "taskpool.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+FrameReader::FrameReader(const std::string &filePath, std::mutex &ioMutex)
+    : ioMutex(ioMutex) {
+  std::lock_guard<std::mutex> lock(ioMutex);
+  reader = std::make_unique<BrwReader>(filePath);
+  recInfo = reader->info();
+  rawElements = reader->rawSize();
+  frames = reader->availableFrames();
+  blockBytes = static_cast<std::size_t>(LOADER_BLOCK_FRAMES) *
+               recInfo.channelCount() * sizeof(int16_t);
+
+  // Half the raw buffer budget; the loader's blocks take the rest
+  std::size_t budget = memoryBudget(MemorySubsystem::RawBuffers);
+  maxBlocks = budget == 0 || blockBytes == 0
+                  ? 64
+                  : std::clamp<std::size_t>(budget / 2 / blockBytes, 2, 64);
+}
+
+FrameReader::~FrameReader() {
+  chargeMemory(MemorySubsystem::RawBuffers,
+               -static_cast<std::ptrdiff_t>(cache.size() * blockBytes));
+  std::lock_guard<std::mutex> lock(ioMutex);
+  reader.reset();
+}
+
+void FrameReader::readFrames(long long firstFrame, long long frameCount,
+                             std::vector<int16_t> &counts) {
+  std::lock_guard<std::mutex> lock(ioMutex);
+  reader->readFrames(firstFrame, frameCount, counts);
+}
+
+FrameReader::Block FrameReader::cachedBlock(long long index) {
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  for (auto it = cache.begin(); it != cache.end(); ++it) {
+    if (it->first == index) {
+      cache.splice(cache.begin(), cache, it);
+      return it->second;
+    }
+  }
+  return nullptr;
+}
+
+FrameReader::Block FrameReader::block(long long index) {
+  if (Block found = cachedBlock(index))
+    return found;
+
+  ScopedTrace trace("read frames");
+  long long first = index * LOADER_BLOCK_FRAMES;
+  long long count = std::min<long long>(LOADER_BLOCK_FRAMES, frames - first);
+  auto counts = std::make_shared<std::vector<int16_t>>();
+  {
+    std::lock_guard<std::mutex> lock(ioMutex);
+    reader->readFrames(first, count, *counts);
+  }
+
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  // Another thread may have read it meanwhile
+  for (const auto &entry : cache) {
+    if (entry.first == index)
+      return entry.second;
+  }
+  cache.emplace_front(index, counts);
+  chargeMemory(MemorySubsystem::RawBuffers,
+               static_cast<std::ptrdiff_t>(blockBytes));
+  while (cache.size() > maxBlocks) {
+    cache.pop_back();
+    chargeMemory(MemorySubsystem::RawBuffers,
+                 -static_cast<std::ptrdiff_t>(blockBytes));
+  }
+  return counts;
+}
+
+void FrameReader::windowFrames(long long frame,
+                               const PlaybackSettings &settings,
+                               long long &first, long long &last) const {
+  long long window = std::max(
+      1LL, std::llround(settings.windowSeconds * recInfo.samplingRate));
+  window = std::min(window, frames);
+  first = std::clamp(frame - window / 2, 0LL, frames - window);
+  last = first + window;
+}
+
+void FrameReader::windowMetric(long long frame,
+                               const PlaybackSettings &settings,
+                               std::vector<double> &values) {
+  const int channels = recInfo.channelCount();
+  values.assign(channels, 0.0);
+  if (frames == 0 || channels == 0)
+    return;
+
+  long long first = 0, last = 0;
+  windowFrames(frame, settings, first, last);
+  std::vector<int64_t> sum(channels, 0), sumSquares(channels, 0);
+  std::vector<int16_t> low(channels, std::numeric_limits<int16_t>::max());
+  std::vector<int16_t> high(channels, std::numeric_limits<int16_t>::min());
+  // The previous frame for line length, which may sit in the block before
+  Block held;
+  const int16_t *previous = nullptr;
+
+  for (long long index = first / LOADER_BLOCK_FRAMES;
+       index <= (last - 1) / LOADER_BLOCK_FRAMES; ++index) {
+    Block data = block(index);
+    long long blockFirst = index * LOADER_BLOCK_FRAMES;
+    long long from = std::max(first, blockFirst);
+    long long to = std::min<long long>(last, blockFirst + LOADER_BLOCK_FRAMES);
+    for (long long f = from; f < to; ++f) {
+      const int16_t *counts = data->data() + (f - blockFirst) * channels;
+      switch (settings.metric) {
+      case FrameMetric::Rms:
+        for (int c = 0; c < channels; ++c) {
+          sum[c] += counts[c];
+          sumSquares[c] += counts[c] * counts[c];
+        }
+        break;
+      case FrameMetric::LineLength:
+        if (previous) {
+          for (int c = 0; c < channels; ++c) {
+            sum[c] += std::abs(counts[c] - previous[c]);
+          }
+        }
+        previous = counts;
+        break;
+      case FrameMetric::PeakToPeak:
+        for (int c = 0; c < channels; ++c) {
+          low[c] = std::min(low[c], counts[c]);
+          high[c] = std::max(high[c], counts[c]);
+        }
+        break;
+      }
+    }
+    held = data;
+  }
+
+  // The conversion is affine, so only its slope applies to these
+  const double scale = std::abs(recInfo.adcCountsToMV) / 1000000.0;
+  const double n = static_cast<double>(last - first);
+  for (int c = 0; c < channels; ++c) {
+    switch (settings.metric) {
+    case FrameMetric::Rms: {
+      double mean = sum[c] / n;
+      double variance = sumSquares[c] / n - mean * mean;
+      values[c] = std::sqrt(std::max(variance, 0.0)) * scale;
+      break;
+    }
+    case FrameMetric::LineLength:
+      // Per second, so the value does not depend on the window
+      values[c] = n > 1 ? sum[c] / (n - 1) * recInfo.samplingRate * scale
+                        : 0.0;
+      break;
+    case FrameMetric::PeakToPeak:
+      values[c] = (high[c] - low[c]) * scale;
+      break;
+    }
+  }
+}
+
+void FrameReader::prefetch(long long frame,
+                           const PlaybackSettings &settings) {
+  if (frames == 0)
+    return;
+  long long first = 0, last = 0;
+  windowFrames(frame, settings, first, last);
+  std::weak_ptr<FrameReader> self = weak_from_this();
+  for (long long index = first / LOADER_BLOCK_FRAMES;
+       index <= (last - 1) / LOADER_BLOCK_FRAMES; ++index) {
+    {
+      std::lock_guard<std::mutex> lock(cacheMutex);
+      if (std::any_of(cache.begin(), cache.end(),
+                      [index](const auto &entry) {
+                        return entry.first == index;
+                      }))
+        continue;
+    }
+    TaskPool::instance().submit(TaskPriority::Prefetch, [self, index]() {
+      if (std::shared_ptr<FrameReader> reader = self.lock()) {
+        try {
+          reader->block(index);
+        } catch (...) {
+          // Left for the next windowMetric to read and report
+        }
+      }
+    });
+  }
+}
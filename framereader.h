@@ -0,0 +1,72 @@
+#ifndef FRAMEREADER_H
+#define FRAMEREADER_H
+
+#include "brwreader.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class FrameMetric { Rms, LineLength, PeakToPeak };
+
+struct PlaybackSettings {
+  FrameMetric metric = FrameMetric::Rms;
+  double windowSeconds = 0.05;
+};
+
+// Serves frame ranges of /3BData/Raw in its native frame-major layout, for
+// grid playback without transposing the recording into channel signals.
+// Blocks of frames are cached as ADC counts, least recently used first out
+// within the raw buffer budget, and metrics are taken in counts and scaled
+// to millivolts at the end, so no converted copy is ever made. Every HDF5
+// call is made under ioMutex, a block at a time, so playback and a running
+// load share the file. Owned through shared_ptr so prefetch tasks can
+// outlive a replaced reader.
+class FrameReader : public std::enable_shared_from_this<FrameReader> {
+public:
+  FrameReader(const std::string &filePath, std::mutex &ioMutex);
+  ~FrameReader();
+  FrameReader(const FrameReader &) = delete;
+  FrameReader &operator=(const FrameReader &) = delete;
+
+  const BrwInfo &info() const { return recInfo; }
+  hsize_t rawSize() const { return rawElements; }
+  long long frameCount() const { return frames; }
+
+  // Uncached, for streaming the whole recording once
+  void readFrames(long long firstFrame, long long frameCount,
+                  std::vector<int16_t> &counts);
+
+  // The metric of every channel, in millivolts, over the window of frames
+  // centred on frame. Missing blocks are read on the calling thread.
+  void windowMetric(long long frame, const PlaybackSettings &settings,
+                    std::vector<double> &values);
+  // Reads the blocks of the window centred on frame on the pool, ahead of
+  // playback
+  void prefetch(long long frame, const PlaybackSettings &settings);
+
+private:
+  using Block = std::shared_ptr<const std::vector<int16_t>>;
+
+  Block cachedBlock(long long index);
+  Block block(long long index);
+  void windowFrames(long long frame, const PlaybackSettings &settings,
+                    long long &first, long long &last) const;
+
+  std::mutex &ioMutex;
+  std::unique_ptr<BrwReader> reader;
+  BrwInfo recInfo;
+  hsize_t rawElements;
+  long long frames;
+  std::size_t blockBytes;
+
+  std::mutex cacheMutex;
+  // Most recently used first
+  std::list<std::pair<long long, Block>> cache;
+  std::size_t maxBlocks;
+};
+
+#endif // FRAMEREADER_H
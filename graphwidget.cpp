@@ -1,17 +1,37 @@
 #include "graphwidget.h"
 #include "constants.h"
+#include "trace.h"
+#include <QApplication>
 #include <algorithm>
 
 GraphWidget::GraphWidget(QWidget *parent)
     : QWidget(parent), activePlotIndex(0), doShowRegions(true),
-      doShowMiniMap(true), lastActivePlotIndex(-1), isRightClickDragging(false),
-      isLeftClickDragging(false), currentDraggingPlotIndex(-1) {
+      doShowMiniMap(true), doShowSpectrograms(false), samplingRate(1.0),
+      lastActivePlotIndex(-1), isRightClickDragging(false),
+      isLeftClickDragging(false), isMinimapDragging(false),
+      minimapDragOffset(0), currentDraggingPlotIndex(-1) {
   layout = new QVBoxLayout(this);
   setupMinimap();
   setupPlotWidgets();
 
   xData.resize(PLOT_COUNT);
   yData.resize(PLOT_COUNT);
+  overviewX.resize(PLOT_COUNT);
+  overviewMin.resize(PLOT_COUNT);
+  overviewMax.resize(PLOT_COUNT);
+  fullData.resize(PLOT_COUNT);
+  previewData.resize(PLOT_COUNT);
+
+  // Gestures render coarse previews at a capped rate and get one full
+  // resolution replot once they settle.
+  interactiveReplotTimer.setSingleShot(true);
+  interactiveReplotTimer.setInterval(INTERACTIVE_FRAME_MS);
+  connect(&interactiveReplotTimer, &QTimer::timeout, this,
+          &GraphWidget::renderInteractiveFrame);
+  refineTimer.setSingleShot(true);
+  refineTimer.setInterval(REFINE_DELAY_MS);
+  connect(&refineTimer, &QTimer::timeout, this, &GraphWidget::refineView);
+
   setupPlotInteractions();
   linkAxes();
 }
@@ -27,19 +47,29 @@ void GraphWidget::setupPlotWidgets() {
     plotWidget->setInteractions(QCP::iRangeDrag | QCP::iRangeZoom);
     plotWidget->axisRect()->setRangeZoom(Qt::Horizontal | Qt::Vertical);
     plotWidget->axisRect()->setRangeDrag(Qt::Horizontal | Qt::Vertical);
-
-    // QCPItemLine *redLine = new QCPItemLine(plotWidget);
-    // redLine->setPen(QPen(Qt::red, 2));
-    // redLines.append(redLine);
+    plotWidget->setNoAntialiasingOnDrag(true);
+    connect(plotWidget, &QCustomPlot::afterReplot, this, [plotWidget]() {
+      if (traceActive()) {
+        uint64_t duration =
+            static_cast<uint64_t>(plotWidget->replotTime() * 1e6);
+        recordTrace("replot", traceNow() - duration, duration,
+                    TraceMetric::ReplotMs);
+      }
+    });
 
     QCPGraph *plot = plotWidget->addGraph();
     QPen pen = plot->pen();
     pen.setColor(Qt::darkBlue);
     plot->setPen(pen);
 
+    // Regions are drawn above the trace, as the per-region items used to be
+    regionOverlays.append(new RegionOverlay(plotWidget->axisRect()));
+    setupSpectrogram(plotWidget);
+
     plots.append(plot);
     plotWidgets.append(plotWidget);
     plotsLayout->addWidget(plotWidget);
+    setupCursorLayer(plotWidget);
 
     // Connect signals for each plot
     connect(plotWidget->xAxis, SIGNAL(rangeChanged(QCPRange)), this,
@@ -51,6 +81,175 @@ void GraphWidget::setupPlotWidgets() {
   layout->addWidget(plotsContainer);
 }
 
+void GraphWidget::setupSpectrogram(QCustomPlot *plotWidget) {
+  // The spectrogram sits under the trace, with frequency on the right axis
+  plotWidget->addLayer("spectrogram", plotWidget->layer("main"),
+                       QCustomPlot::limBelow);
+  QCPColorMap *map =
+      new QCPColorMap(plotWidget->xAxis, plotWidget->yAxis2);
+  map->setLayer("spectrogram");
+  map->setGradient(QCPColorGradient::gpJet);
+  map->setInterpolate(false);
+  map->setVisible(false);
+  plotWidget->yAxis2->setLabel("Hz");
+  spectrograms.append(map);
+}
+
+void GraphWidget::updateSpectrograms() {
+  if (!doShowSpectrograms)
+    return;
+
+  // Every plot shares the x range, so all channels go to the engine as one
+  // batch and only the tiles for the visible span are computed.
+  std::vector<int> channels;
+  for (int i = 0; i < plotWidgets.size(); ++i) {
+    if (!yData[i].isEmpty()) {
+      channels.push_back(i);
+    }
+  }
+  if (channels.empty())
+    return;
+
+  QCPAxis *xAxis = plotWidgets[channels.front()]->xAxis;
+  const QVector<double> &x = xData[channels.front()];
+  double origin = x.first();
+  double step = x.size() > 1 ? (x.last() - x.first()) / (x.size() - 1) : 1.0;
+  std::vector<SpectrogramView> views;
+  spectrogramEngine.compute(channels, (xAxis->range().lower - origin) / step,
+                            (xAxis->range().upper - origin) / step,
+                            xAxis->axisRect()->width(), views);
+
+  for (std::size_t c = 0; c < channels.size(); ++c) {
+    const SpectrogramView &view = views[c];
+    QCPColorMap *map = spectrograms[channels[c]];
+    map->data()->clear();
+    if (view.columns == 0)
+      continue;
+
+    map->data()->setSize(view.columns, view.bins);
+    map->data()->setRange(
+        QCPRange(origin + view.columnSample(0) * step,
+                 origin + view.columnSample(view.columns - 1) * step),
+        QCPRange(0, samplingRate / 2));
+    for (int column = 0; column < view.columns; ++column) {
+      const float *power = view.values.data() + column * view.bins;
+      for (int bin = 0; bin < view.bins; ++bin) {
+        map->data()->setCell(column, bin, power[bin]);
+      }
+    }
+    map->rescaleDataRange(true);
+  }
+}
+
+void GraphWidget::setupCursorLayer(QCustomPlot *plotWidget) {
+  // Playheads, crosshairs and the hover readout change far more often than
+  // the traces, so they get their own paint buffer and are refreshed with
+  // QCPLayer::replot() instead of a full replot.
+  plotWidget->addLayer("cursor", plotWidget->layer("overlay"),
+                       QCustomPlot::limBelow);
+  QCPLayer *cursorLayer = plotWidget->layer("cursor");
+  cursorLayer->setMode(QCPLayer::lmBuffered);
+  cursorLayers.append(cursorLayer);
+
+  QCPItemLine *redLine = new QCPItemLine(plotWidget);
+  redLine->setLayer(cursorLayer);
+  redLine->setSelectable(false);
+  redLine->setPen(QPen(Qt::red, 2));
+  redLine->start->setTypeY(QCPItemPosition::ptAxisRectRatio);
+  redLine->end->setTypeY(QCPItemPosition::ptAxisRectRatio);
+  redLine->start->setCoords(0, 0);
+  redLine->end->setCoords(0, 1);
+  redLine->setVisible(false);
+  redLines.append(redLine);
+
+  QPen crosshairPen(QColor(80, 80, 80), 1, Qt::DashLine);
+
+  QCPItemStraightLine *vertical = new QCPItemStraightLine(plotWidget);
+  vertical->setLayer(cursorLayer);
+  vertical->setSelectable(false);
+  vertical->setPen(crosshairPen);
+  vertical->point1->setTypeY(QCPItemPosition::ptAxisRectRatio);
+  vertical->point2->setTypeY(QCPItemPosition::ptAxisRectRatio);
+  vertical->setVisible(false);
+  crosshairsX.append(vertical);
+
+  QCPItemStraightLine *horizontal = new QCPItemStraightLine(plotWidget);
+  horizontal->setLayer(cursorLayer);
+  horizontal->setSelectable(false);
+  horizontal->setPen(crosshairPen);
+  horizontal->point1->setTypeX(QCPItemPosition::ptAxisRectRatio);
+  horizontal->point2->setTypeX(QCPItemPosition::ptAxisRectRatio);
+  horizontal->setVisible(false);
+  crosshairsY.append(horizontal);
+
+  QCPItemText *readout = new QCPItemText(plotWidget);
+  readout->setLayer(cursorLayer);
+  readout->setSelectable(false);
+  readout->position->setType(QCPItemPosition::ptAxisRectRatio);
+  readout->position->setCoords(1, 0);
+  readout->setPositionAlignment(Qt::AlignRight | Qt::AlignTop);
+  readout->setPadding(QMargins(4, 2, 4, 2));
+  readout->setBrush(QBrush(QColor(255, 255, 255, 200)));
+  readout->setVisible(false);
+  hoverReadouts.append(readout);
+
+  plotWidget->installEventFilter(this);
+}
+
+void GraphWidget::replotCursorLayers() {
+  for (QCPLayer *cursorLayer : cursorLayers) {
+    cursorLayer->replot();
+  }
+}
+
+void GraphWidget::updateCursor(int plotIndex, const QPoint &pos) {
+  QCustomPlot *hovered = plotWidgets[plotIndex];
+  bool inside = hovered->axisRect()->rect().contains(pos);
+  double x = hovered->xAxis->pixelToCoord(pos.x());
+  double y = hovered->yAxis->pixelToCoord(pos.y());
+
+  for (int i = 0; i < plotWidgets.size(); ++i) {
+    bool isHovered = inside && i == plotIndex;
+
+    crosshairsX[i]->point1->setCoords(x, 0);
+    crosshairsX[i]->point2->setCoords(x, 1);
+    crosshairsX[i]->setVisible(inside);
+
+    crosshairsY[i]->point1->setCoords(0, y);
+    crosshairsY[i]->point2->setCoords(1, y);
+    crosshairsY[i]->setVisible(isHovered);
+
+    hoverReadouts[i]->setVisible(isHovered);
+    if (isHovered) {
+      QString text = QString("t = %1").arg(x, 0, 'f', 3);
+      QSharedPointer<QCPGraphDataContainer> data = plots[i]->data();
+      QCPGraphDataContainer::const_iterator it = data->findBegin(x, false);
+      if (it != data->constEnd()) {
+        text += QString("   y = %1").arg(it->value, 0, 'g', 4);
+      }
+      hoverReadouts[i]->setText(text);
+    }
+  }
+  replotCursorLayers();
+}
+
+void GraphWidget::hideCursor() {
+  for (int i = 0; i < plotWidgets.size(); ++i) {
+    crosshairsX[i]->setVisible(false);
+    crosshairsY[i]->setVisible(false);
+    hoverReadouts[i]->setVisible(false);
+  }
+  replotCursorLayers();
+}
+
+bool GraphWidget::eventFilter(QObject *watched, QEvent *event) {
+  if (event->type() == QEvent::Leave &&
+      plotWidgets.contains(qobject_cast<QCustomPlot *>(watched))) {
+    hideCursor();
+  }
+  return QWidget::eventFilter(watched, event);
+}
+
 void GraphWidget::linkAxes() {
   for (int i = 0; i < plotWidgets.size(); ++i) {
     if (i == currentDraggingPlotIndex || currentDraggingPlotIndex == -1)
@@ -59,26 +258,152 @@ void GraphWidget::linkAxes() {
         plotWidgets[currentDraggingPlotIndex]->xAxis->range());
     plotWidgets[i]->yAxis->setRange(
         plotWidgets[currentDraggingPlotIndex]->yAxis->range());
+  }
+  updateMinimap();
+}
+
+std::size_t GraphWidget::plotDataBytes() const {
+  std::size_t bytes = 0;
+  for (int i = 0; i < plots.size(); ++i) {
+    bytes += (xData[i].capacity() + yData[i].capacity() +
+              overviewX[i].capacity() + overviewMin[i].capacity() +
+              overviewMax[i].capacity()) *
+             sizeof(double);
+    if (fullData[i]) {
+      bytes += fullData[i]->size() * sizeof(QCPGraphData);
+    }
+    if (previewData[i]) {
+      bytes += previewData[i]->size() * sizeof(QCPGraphData);
+    }
+  }
+  return bytes;
+}
+
+void GraphWidget::setSpectrogramBudget(std::size_t bytes) {
+  // A few tiles per plot, so a visible spectrogram never thrashes
+  std::size_t floor = 16 * PLOT_COUNT;
+  spectrogramEngine.setMaxTiles(
+      std::max(floor, bytes / spectrogramEngine.tileBytes()));
+}
+
+void GraphWidget::computePreview(int plotIndex) {
+  fullData[plotIndex] = plots[plotIndex]->data();
+  previewData[plotIndex].reset();
+
+  const QCPGraphDataContainer &full = *fullData[plotIndex];
+  int n = full.size();
+  if (n <= 2 * PREVIEW_POINTS)
+    return;
+
+  // Keep each bucket's extremes in sample order so the preview still traces
+  // the signal's shape.
+  QVector<QCPGraphData> points;
+  points.reserve(2 * PREVIEW_POINTS);
+  for (int b = 0; b < PREVIEW_POINTS; ++b) {
+    int begin = static_cast<int>(static_cast<qint64>(b) * n / PREVIEW_POINTS);
+    int end = static_cast<int>(static_cast<qint64>(b + 1) * n / PREVIEW_POINTS);
+    auto extremes = std::minmax_element(
+        full.constBegin() + begin, full.constBegin() + end,
+        [](const QCPGraphData &a, const QCPGraphData &b) {
+          return a.value < b.value;
+        });
+    if (extremes.first->key <= extremes.second->key) {
+      points.append(*extremes.first);
+      points.append(*extremes.second);
+    } else {
+      points.append(*extremes.second);
+      points.append(*extremes.first);
+    }
+  }
+  previewData[plotIndex].reset(new QCPGraphDataContainer);
+  previewData[plotIndex]->set(points, true);
+}
+
+void GraphWidget::selectLevelOfDetail(int plotIndex, bool interactive) {
+  QSharedPointer<QCPGraphDataContainer> target = fullData[plotIndex];
+  if (!target)
+    return;
+
+  const QSharedPointer<QCPGraphDataContainer> &preview =
+      previewData[plotIndex];
+  if (interactive && preview) {
+    // Only fall back to the preview when the visible span holds more raw
+    // points than the whole preview does.
+    QCPRange range = plotWidgets[plotIndex]->xAxis->range();
+    int visible = target->findEnd(range.upper) - target->findBegin(range.lower);
+    if (visible > preview->size()) {
+      target = preview;
+    }
+  }
+  if (plots[plotIndex]->data() != target) {
+    plots[plotIndex]->setData(target);
+  }
+}
+
+void GraphWidget::scheduleInteractiveReplot() {
+  if (!interactiveReplotTimer.isActive()) {
+    interactiveReplotTimer.start();
+  }
+  refineTimer.start();
+}
+
+void GraphWidget::renderInteractiveFrame() {
+  for (int i = 0; i < plotWidgets.size(); ++i) {
+    selectLevelOfDetail(i, true);
+    plotWidgets[i]->setNotAntialiasedElements(QCP::aeAll);
     plotWidgets[i]->replot();
   }
 }
 
+void GraphWidget::refineView() {
+  interactiveReplotTimer.stop();
+  updateSpectrograms();
+  for (int i = 0; i < plotWidgets.size(); ++i) {
+    selectLevelOfDetail(i, false);
+    plotWidgets[i]->setNotAntialiasedElements(QCP::aeNone);
+    plotWidgets[i]->replot(QCustomPlot::rpQueuedReplot);
+  }
+}
+
 void GraphWidget::setupMinimap() {
   minimap = new QCustomPlot(this);
   minimap->setFixedHeight(100);
   minimap->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
   minimap->xAxis->setVisible(false);
   minimap->yAxis->setVisible(false);
-  minimap->setInteractions(QCP::iRangeDrag | QCP::iRangeZoom);
+  minimap->axisRect()->setAutoMargins(QCP::msNone);
+  minimap->axisRect()->setMargins(QMargins(0, 0, 0, 0));
+
+  // The minimap draws the min/max overview envelope of the active plot, not
+  // its samples, so it stays cheap no matter how long the recording is.
+  QPen envelopePen(Qt::darkBlue);
+  QCPGraph *lowerEnvelope = minimap->addGraph();
+  lowerEnvelope->setPen(envelopePen);
+  QCPGraph *upperEnvelope = minimap->addGraph();
+  upperEnvelope->setPen(envelopePen);
+  upperEnvelope->setBrush(QBrush(QColor(0, 0, 139, 80)));
+  upperEnvelope->setChannelFillGraph(lowerEnvelope);
+
+  minimap->addLayer("cursor", minimap->layer("overlay"), QCustomPlot::limBelow);
+  minimapLayer = minimap->layer("cursor");
+  minimapLayer->setMode(QCPLayer::lmBuffered);
 
   minimapRegion = new QCPItemRect(minimap);
+  minimapRegion->setLayer(minimapLayer);
+  minimapRegion->setSelectable(false);
   minimapRegion->setPen(QPen(Qt::blue));
   minimapRegion->setBrush(QBrush(QColor(0, 0, 255, 50)));
-  minimapRegion->topLeft->setType(QCPItemPosition::ptPlotCoords);
-  minimapRegion->bottomRight->setType(QCPItemPosition::ptPlotCoords);
-
-  connect(minimap->xAxis, SIGNAL(rangeChanged(QCPRange)), this,
-          SLOT(updatePlotViews()));
+  minimapRegion->topLeft->setTypeX(QCPItemPosition::ptPlotCoords);
+  minimapRegion->topLeft->setTypeY(QCPItemPosition::ptAxisRectRatio);
+  minimapRegion->bottomRight->setTypeX(QCPItemPosition::ptPlotCoords);
+  minimapRegion->bottomRight->setTypeY(QCPItemPosition::ptAxisRectRatio);
+
+  connect(minimap, &QCustomPlot::mousePress, this,
+          &GraphWidget::onMinimapMousePress);
+  connect(minimap, &QCustomPlot::mouseMove, this,
+          &GraphWidget::onMinimapMouseMove);
+  connect(minimap, &QCustomPlot::mouseRelease, this,
+          &GraphWidget::onMinimapMouseRelease);
 
   layout->addWidget(minimap);
 }
@@ -91,6 +416,7 @@ void GraphWidget::setupPlotInteractions() {
     connect(plot, &QCustomPlot::mouseMove, this, &GraphWidget::onMouseMove);
     connect(plot, &QCustomPlot::mouseRelease, this,
             &GraphWidget::onMouseRelease);
+    connect(plot, &QCustomPlot::mouseWheel, this, &GraphWidget::onMouseWheel);
   }
 }
 
@@ -108,13 +434,23 @@ void GraphWidget::onMousePress(QMouseEvent *event) {
       isLeftClickDragging = true;
       dragStartPosition = event->pos();
       currentDraggingPlotIndex = plotWidgets.indexOf(plot);
+      setActivePlot(currentDraggingPlotIndex);
     }
   }
 }
 
 void GraphWidget::onMouseMove(QMouseEvent *event) {
+  if (!isLeftClickDragging && !isRightClickDragging) {
+    int plotIndex =
+        plotWidgets.indexOf(qobject_cast<QCustomPlot *>(sender()));
+    if (plotIndex != -1) {
+      updateCursor(plotIndex, event->pos());
+    }
+    return;
+  }
   if (isLeftClickDragging) {
     linkAxes();
+    scheduleInteractiveReplot();
     return;
   }
   if (isRightClickDragging && currentDraggingPlotIndex != -1) {
@@ -152,9 +488,7 @@ void GraphWidget::onMouseMove(QMouseEvent *event) {
     yAxis->setRange(yLower, yUpper);
 
     linkAxes();
-
-    // Replot
-    plot->replot();
+    scheduleInteractiveReplot();
 
     // Update drag start position for next move event
     dragStartPosition = event->pos();
@@ -164,7 +498,6 @@ void GraphWidget::onMouseMove(QMouseEvent *event) {
 void GraphWidget::onMouseRelease(QMouseEvent *event) {
   if (event->button() == Qt::RightButton) {
     isRightClickDragging = false;
-    currentDraggingPlotIndex = -1;
 
     // Emit the final range after zooming
     if (currentDraggingPlotIndex != -1) {
@@ -172,12 +505,49 @@ void GraphWidget::onMouseRelease(QMouseEvent *event) {
       emit rightClickedAndDragged(plot->xAxis->range(),
                                   currentDraggingPlotIndex);
     }
+    currentDraggingPlotIndex = -1;
   } else if (event->button() == Qt::LeftButton) {
     isLeftClickDragging = false;
+    // A click that did not move the view selects the region under it
+    if (currentDraggingPlotIndex != -1 &&
+        (event->pos() - dragStartPosition).manhattanLength() <
+            QApplication::startDragDistance()) {
+      emitRegionAt(currentDraggingPlotIndex, event->pos());
+    }
     currentDraggingPlotIndex = -1;
   }
 }
 
+void GraphWidget::emitRegionAt(int plotIndex, const QPoint &pos) {
+  const RegionOverlay *overlay = regionOverlays[plotIndex];
+  if (!overlay->visible())
+    return;
+  double key = plotWidgets[plotIndex]->xAxis->pixelToCoord(pos.x());
+  bool found = false;
+  auto select = [&](const Region &region) {
+    if (!found) {
+      found = true;
+      emit regionClicked(region.start, region.stop, plotIndex);
+    }
+  };
+  overlay->seRegions().forEachOverlapping(key, key, select);
+  overlay->seizureRegions().forEachOverlapping(key, key, select);
+}
+
+void GraphWidget::onMouseWheel(QWheelEvent * /* event */) {
+  // The axis rect zooms and replots itself after this signal, before the
+  // new range can be measured, so that frame draws the preview without
+  // antialiasing. The interactive frame then picks the detail for the new
+  // range.
+  for (int i = 0; i < plotWidgets.size(); ++i) {
+    if (previewData[i] && plots[i]->data() != previewData[i]) {
+      plots[i]->setData(previewData[i]);
+    }
+    plotWidgets[i]->setNotAntialiasedElements(QCP::aeAll);
+  }
+  scheduleInteractiveReplot();
+}
+
 void GraphWidget::simplePlot(const QVector<double> &x, const QVector<double> &y,
                              int plotIndex) {
   if (plotIndex < 0 || plotIndex >= plots.size()) {
@@ -188,15 +558,22 @@ void GraphWidget::simplePlot(const QVector<double> &x, const QVector<double> &y,
   // Store the data
   xData[plotIndex] = x;
   yData[plotIndex] = y;
+  computeOverview(plotIndex);
 
   // Set the data for the plot
   plots[plotIndex]->setData(x, y);
+  computePreview(plotIndex);
+  // A shared copy, so the engine's samples outlive any change to yData
+  auto samples = std::make_shared<const QVector<double>>(yData[plotIndex]);
+  spectrogramEngine.setSignal(plotIndex, samples, samples->constData(),
+                              samples->size());
 
   // Scale the x-axis to fit the data
   plotWidgets[plotIndex]->xAxis->rescale();
 
   // Scale the y-axis to fit the data
   plotWidgets[plotIndex]->yAxis->rescale();
+  updateSpectrograms();
 
   // Replot the widget
   plotWidgets[plotIndex]->replot();
@@ -214,10 +591,12 @@ void GraphWidget::plot(const QVector<double> &x, const QVector<double> &y,
                        const QVector<QVector<double>> &se) {
   xData[plotIndex] = x;
   yData[plotIndex] = y;
+  computeOverview(plotIndex);
 
   auto regions = getRegions(seizures, se);
-  const auto &seizureRegions = regions.first;
-  const auto &seRegions = regions.second;
+  regionOverlays[plotIndex]->setRegions(std::move(regions.first),
+                                        std::move(regions.second));
+  regionOverlays[plotIndex]->setVisible(doShowRegions);
 
   QVector<double> downsampleY =
       downsampleData(x, y, 1000); // Assuming GRAPH_DOWNSAMPLE is 1000
@@ -227,6 +606,10 @@ void GraphWidget::plot(const QVector<double> &x, const QVector<double> &y,
   }
 
   plots[plotIndex]->setData(downsampleX, downsampleY);
+  computePreview(plotIndex);
+  auto samples = std::make_shared<const QVector<double>>(yData[plotIndex]);
+  spectrogramEngine.setSignal(plotIndex, samples, samples->constData(),
+                              samples->size());
 
   QCustomPlot *plot = plotWidgets[plotIndex];
   plot->xAxis->setLabel(xlabel);
@@ -239,82 +622,135 @@ void GraphWidget::plot(const QVector<double> &x, const QVector<double> &y,
   plot->plotLayout()->insertRow(0);
   plot->plotLayout()->addElement(0, 0, titleElement);
 
-  // Add regions
-  for (const auto &region : seRegions) {
-    QCPItemRect *rect = new QCPItemRect(plot);
-    rect->topLeft->setCoords(region.at(0), plot->yAxis->range().upper);
-    rect->bottomRight->setCoords(region.at(1), plot->yAxis->range().lower);
-    rect->setBrush(QBrush(QColor(255, 183, 3, 128)));
-    rect->setPen(Qt::NoPen);
-  }
+  updateSpectrograms();
+  plot->replot();
 
-  for (const auto &region : seizureRegions) {
-    QCPItemRect *rect = new QCPItemRect(plot);
-    rect->topLeft->setCoords(region.at(0), plot->yAxis->range().upper);
-    rect->bottomRight->setCoords(region.at(1), plot->yAxis->range().lower);
-    rect->setBrush(QBrush(QColor(0, 150, 199, 128)));
-    rect->setPen(Qt::NoPen);
+  if (plotIndex == activePlotIndex) {
+    updateMinimap();
   }
+}
 
-  plot->replot();
+void GraphWidget::computeOverview(int plotIndex) {
+  const QVector<double> &x = xData[plotIndex];
+  const QVector<double> &y = yData[plotIndex];
+  QVector<double> &keys = overviewX[plotIndex];
+  QVector<double> &lower = overviewMin[plotIndex];
+  QVector<double> &upper = overviewMax[plotIndex];
+  keys.clear();
+  lower.clear();
+  upper.clear();
+
+  int n = std::min(x.size(), y.size());
+  if (n == 0)
+    return;
 
-  if (plotIndex == 0) {
-    updateMinimap();
+  // One min/max pair per bucket keeps every peak visible in the minimap.
+  int buckets = std::min(n, MINIMAP_OVERVIEW_POINTS);
+  keys.reserve(buckets + 1);
+  lower.reserve(buckets + 1);
+  upper.reserve(buckets + 1);
+  for (int b = 0; b < buckets; ++b) {
+    int begin = static_cast<int>(static_cast<qint64>(b) * n / buckets);
+    int end = static_cast<int>(static_cast<qint64>(b + 1) * n / buckets);
+    auto extremes = std::minmax_element(y.begin() + begin, y.begin() + end);
+    keys.append(x[begin]);
+    lower.append(*extremes.first);
+    upper.append(*extremes.second);
+  }
+  // Close the envelope at the last sample so the minimap spans the full trace
+  keys.append(x[n - 1]);
+  lower.append(lower.last());
+  upper.append(upper.last());
+
+  if (plotIndex == activePlotIndex) {
+    lastActivePlotIndex = -1;
   }
 }
 
+void GraphWidget::setActivePlot(int plotIndex) {
+  if (plotIndex < 0 || plotIndex >= plotWidgets.size() ||
+      plotIndex == activePlotIndex)
+    return;
+  activePlotIndex = plotIndex;
+  updateMinimap();
+}
+
 void GraphWidget::updateMinimap() {
-  // if (!doShowMiniMap)
-  //   return;
-  //
-  // const QVector<double> &activeXData = xData[activePlotIndex];
-  // const QVector<double> &activeYData = yData[activePlotIndex];
-  //
-  // if (activeXData.isEmpty() || activeYData.isEmpty())
-  //   return;
-  //
-  // if (activePlotIndex != lastActivePlotIndex) {
-  //   QVector<double> downsampleY = downsampleData(activeXData, activeYData,
-  //   500); QVector<double> downsampleX(downsampleY.size()); for (int i = 0; i
-  //   < downsampleX.size(); ++i) {
-  //     downsampleX[i] =
-  //         activeXData[i * (activeXData.size() - 1) / (downsampleX.size() -
-  //         1)];
-  //   }
-  //   minimap->graph(0)->setData(downsampleX, downsampleY);
-  //   lastActivePlotIndex = activePlotIndex;
-  // }
-  //
-  // QCustomPlot *activePlot = plotWidgets[activePlotIndex];
-  // QCPRange xRange = activePlot->xAxis->range();
-  //
-  // minimapRegion->topLeft->setCoords(xRange.lower,
-  //                                   minimap->yAxis->range().upper);
-  // minimapRegion->bottomRight->setCoords(xRange.upper,
-  //                                       minimap->yAxis->range().lower);
-  //
-  // minimap->replot();
+  if (!doShowMiniMap)
+    return;
+
+  if (overviewX[activePlotIndex].isEmpty())
+    return;
+
+  QCPRange xRange = plotWidgets[activePlotIndex]->xAxis->range();
+  minimapRegion->topLeft->setCoords(xRange.lower, 0);
+  minimapRegion->bottomRight->setCoords(xRange.upper, 1);
+
+  // The envelope only changes with the active channel; panning and zooming
+  // just move the region on its buffered layer.
+  if (activePlotIndex != lastActivePlotIndex) {
+    minimap->graph(0)->setData(overviewX[activePlotIndex],
+                               overviewMin[activePlotIndex], true);
+    minimap->graph(1)->setData(overviewX[activePlotIndex],
+                               overviewMax[activePlotIndex], true);
+    minimap->rescaleAxes();
+    lastActivePlotIndex = activePlotIndex;
+    minimap->replot();
+  } else {
+    minimapLayer->replot();
+  }
 }
 
 void GraphWidget::updatePlotViews() {
-  QCPRange range = minimap->xAxis->range();
+  QCPRange range(minimapRegion->topLeft->coords().x(),
+                 minimapRegion->bottomRight->coords().x());
   for (QCustomPlot *plot : plotWidgets) {
     plot->xAxis->setRange(range);
-    plot->replot();
+  }
+  scheduleInteractiveReplot();
+  minimapLayer->replot();
+}
+
+void GraphWidget::panMinimapRegion(double lower) {
+  QCPRange bounds = minimap->xAxis->range();
+  double width = plotWidgets[activePlotIndex]->xAxis->range().size();
+  lower = std::max(bounds.lower, std::min(lower, bounds.upper - width));
+  minimapRegion->topLeft->setCoords(lower, 0);
+  minimapRegion->bottomRight->setCoords(lower + width, 1);
+  updatePlotViews();
+}
+
+void GraphWidget::onMinimapMousePress(QMouseEvent *event) {
+  if (event->button() != Qt::LeftButton || overviewX[activePlotIndex].isEmpty())
+    return;
+
+  double key = minimap->xAxis->pixelToCoord(event->pos().x());
+  QCPRange view = plotWidgets[activePlotIndex]->xAxis->range();
+  // Grab the region where it was clicked, or center it on the click
+  minimapDragOffset =
+      view.contains(key) ? key - view.lower : view.size() / 2;
+  isMinimapDragging = true;
+  panMinimapRegion(key - minimapDragOffset);
+}
+
+void GraphWidget::onMinimapMouseMove(QMouseEvent *event) {
+  if (!isMinimapDragging)
+    return;
+  double key = minimap->xAxis->pixelToCoord(event->pos().x());
+  panMinimapRegion(key - minimapDragOffset);
+}
+
+void GraphWidget::onMinimapMouseRelease(QMouseEvent *event) {
+  if (event->button() == Qt::LeftButton) {
+    isMinimapDragging = false;
   }
 }
 
 void GraphWidget::toggleRegions() {
   doShowRegions = !doShowRegions;
-  for (QCustomPlot *plot : plotWidgets) {
-    // Iterate through all items in the plot
-    for (int i = 0; i < plot->itemCount(); ++i) {
-      QCPAbstractItem *item = plot->item(i);
-      if (QCPItemRect *rect = qobject_cast<QCPItemRect *>(item)) {
-        rect->setVisible(doShowRegions);
-      }
-    }
-    plot->replot();
+  for (int i = 0; i < plotWidgets.size(); ++i) {
+    regionOverlays[i]->setVisible(doShowRegions);
+    plotWidgets[i]->replot(QCustomPlot::rpQueuedReplot);
   }
 }
 
@@ -322,28 +758,48 @@ void GraphWidget::toggleRedLines() {
   for (QCPItemLine *line : redLines) {
     line->setVisible(!line->visible());
   }
-  for (QCustomPlot *plot : plotWidgets) {
-    plot->replot();
-  }
+  replotCursorLayers();
 }
 
 void GraphWidget::toggleMiniMap(bool checked) {
   doShowMiniMap = checked;
   minimap->setVisible(checked);
   if (checked) {
+    // Channel changes are skipped while hidden, so reload the envelope
+    lastActivePlotIndex = -1;
     updateMinimap();
   }
 }
 
+void GraphWidget::toggleSpectrograms(bool checked) {
+  doShowSpectrograms = checked;
+  for (int i = 0; i < plotWidgets.size(); ++i) {
+    spectrograms[i]->setVisible(checked);
+    plotWidgets[i]->yAxis2->setVisible(checked);
+    plotWidgets[i]->yAxis2->setRange(0, samplingRate / 2);
+  }
+  updateSpectrograms();
+  for (QCustomPlot *plot : plotWidgets) {
+    plot->replot(QCustomPlot::rpQueuedReplot);
+  }
+}
+
+void GraphWidget::setSamplingRate(double rate) {
+  samplingRate = rate;
+  for (QCustomPlot *plot : plotWidgets) {
+    plot->yAxis2->setRange(0, samplingRate / 2);
+  }
+}
+
 void GraphWidget::updateRedLines(double value, double samplingRate) {
+  if (samplingRate <= 0)
+    return;
   double position = value / samplingRate;
   for (QCPItemLine *line : redLines) {
     line->start->setCoords(position, 0);
     line->end->setCoords(position, 1);
   }
-  for (QCustomPlot *plot : plotWidgets) {
-    plot->replot();
-  }
+  replotCursorLayers();
 }
 
 void GraphWidget::changeViewMode(const QString &mode) {
@@ -356,31 +812,48 @@ void GraphWidget::changeViewMode(const QString &mode) {
   }
 }
 
-std::pair<QVector<QVector<double>>, QVector<QVector<double>>>
+std::pair<RegionIndex, RegionIndex>
 GraphWidget::getRegions(const QVector<QVector<double>> &seizures,
                         const QVector<QVector<double>> &se) {
-  QVector<QVector<double>> seizureRegions, seRegions;
-
+  std::vector<Region> seizureRegions;
+  seizureRegions.reserve(seizures.size());
+  for (const auto &timerange : seizures) {
+    seizureRegions.push_back({timerange.at(0), timerange.at(1)});
+  }
+  std::vector<Region> seRegions;
+  seRegions.reserve(se.size());
   for (const auto &timerange : se) {
-    seRegions.append({timerange.at(0), timerange.at(1)});
+    seRegions.push_back({timerange.at(0), timerange.at(1)});
   }
+  return indexRegions(seizureRegions, std::move(seRegions));
+}
 
-  for (const auto &timerange : seizures) {
-    double start = timerange.at(0), stop = timerange.at(1);
-    bool overlaps = false;
-    for (const auto &seRegion : seRegions) {
-      if ((start <= seRegion.at(0) && seRegion.at(0) <= stop) ||
-          (seRegion.at(0) <= start && start <= seRegion.at(1))) {
-        overlaps = true;
-        break;
-      }
-    }
-    if (!overlaps) {
-      seizureRegions.append({start, stop});
+std::pair<RegionIndex, RegionIndex>
+GraphWidget::indexRegions(const std::vector<Region> &seizures,
+                          std::vector<Region> se) {
+  RegionIndex seIndex(std::move(se));
+
+  // Seizures that overlap an SE region are shown as part of the SE region
+  std::vector<Region> seizureRegions;
+  for (const Region &region : seizures) {
+    if (!seIndex.overlaps(region.start, region.stop)) {
+      seizureRegions.push_back(region);
     }
   }
 
-  return std::make_pair(seizureRegions, seRegions);
+  return std::make_pair(RegionIndex(std::move(seizureRegions)),
+                        std::move(seIndex));
+}
+
+void GraphWidget::setRegions(int plotIndex, const std::vector<Region> &seizures,
+                             const std::vector<Region> &se) {
+  if (plotIndex < 0 || plotIndex >= plots.size())
+    return;
+  auto regions = indexRegions(seizures, se);
+  regionOverlays[plotIndex]->setRegions(std::move(regions.first),
+                                        std::move(regions.second));
+  regionOverlays[plotIndex]->setVisible(doShowRegions);
+  plotWidgets[plotIndex]->replot(QCustomPlot::rpQueuedReplot);
 }
 
 QVector<double> GraphWidget::downsampleData(const QVector<double> &x,
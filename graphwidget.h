@@ -1,7 +1,10 @@
 #ifndef GRAPHWIDGET_H
 #define GRAPHWIDGET_H
 
+#include "regionoverlay.h"
+#include "spectrogram.h"
 #include <QMessageBox>
+#include <QTimer>
 #include <QVBoxLayout>
 #include <QWidget>
 #include <qcustomplot.h>
@@ -16,15 +19,29 @@ public:
             int plotIndex, const QString &shape,
             const QVector<QVector<double>> &seizures,
             const QVector<QVector<double>> &se);
+  void setRegions(int plotIndex, const std::vector<Region> &seizures,
+                  const std::vector<Region> &se);
   void toggleRegions();
   void toggleRedLines();
   void toggleMiniMap(bool checked);
+  void toggleSpectrograms(bool checked);
+  void setSamplingRate(double rate);
   void updateRedLines(double value, double samplingRate);
   void changeViewMode(const QString &mode);
+  void setActivePlot(int plotIndex);
   void simplePlot(const QVector<double> &x, const QVector<double> &y,
                   int graphIndex);
+  // Traces, their data containers, previews and minimap overviews
+  std::size_t plotDataBytes() const;
+  std::size_t spectrogramBytes() const {
+    return spectrogramEngine.memoryBytes();
+  }
+  void setSpectrogramBudget(std::size_t bytes);
   QVector<QCustomPlot *> plotWidgets;
 
+protected:
+  bool eventFilter(QObject *watched, QEvent *event) override;
+
 signals:
   void regionClicked(double start, double stop, int plotIndex);
   void saveSinglePlot();
@@ -37,34 +54,73 @@ private slots:
   void onMousePress(QMouseEvent *event);
   void onMouseMove(QMouseEvent *event);
   void onMouseRelease(QMouseEvent *event);
+  void onMinimapMousePress(QMouseEvent *event);
+  void onMinimapMouseMove(QMouseEvent *event);
+  void onMinimapMouseRelease(QMouseEvent *event);
+  void onMouseWheel(QWheelEvent *event);
+  void renderInteractiveFrame();
+  void refineView();
 
 private:
   QVBoxLayout *layout;
   QCustomPlot *minimap;
   QCPItemRect *minimapRegion;
+  QCPLayer *minimapLayer;
   QWidget *plotsContainer;
   QVBoxLayout *plotsLayout;
+  QVector<QCPLayer *> cursorLayers;
   QVector<QCPItemLine *> redLines;
+  QVector<QCPItemStraightLine *> crosshairsX;
+  QVector<QCPItemStraightLine *> crosshairsY;
+  QVector<QCPItemText *> hoverReadouts;
   QVector<QCPGraph *> plots;
+  QVector<RegionOverlay *> regionOverlays;
+  QVector<QCPColorMap *> spectrograms;
+  SpectrogramEngine spectrogramEngine;
   QVector<QVector<double>> xData;
   QVector<QVector<double>> yData;
+  QVector<QVector<double>> overviewX;
+  QVector<QVector<double>> overviewMin;
+  QVector<QVector<double>> overviewMax;
+  QVector<QSharedPointer<QCPGraphDataContainer>> fullData;
+  QVector<QSharedPointer<QCPGraphDataContainer>> previewData;
+  QTimer interactiveReplotTimer;
+  QTimer refineTimer;
   int activePlotIndex;
   bool doShowRegions;
   bool doShowMiniMap;
+  bool doShowSpectrograms;
+  double samplingRate;
   int lastActivePlotIndex;
 
   bool isRightClickDragging;
   bool isLeftClickDragging;
+  bool isMinimapDragging;
+  double minimapDragOffset;
   QPoint dragStartPosition;
   int currentDraggingPlotIndex;
 
   void setupMinimap();
+  void computeOverview(int plotIndex);
+  void computePreview(int plotIndex);
+  void selectLevelOfDetail(int plotIndex, bool interactive);
+  void scheduleInteractiveReplot();
+  void panMinimapRegion(double lower);
   void setupPlotWidgets();
+  void setupCursorLayer(QCustomPlot *plotWidget);
+  void setupSpectrogram(QCustomPlot *plotWidget);
+  void updateSpectrograms();
+  void replotCursorLayers();
+  void updateCursor(int plotIndex, const QPoint &pos);
+  void hideCursor();
+  void emitRegionAt(int plotIndex, const QPoint &pos);
   void redrawRegions(double start, double stop,
                      const QVector<bool> &plottedChannels);
-  std::pair<QVector<QVector<double>>, QVector<QVector<double>>>
+  std::pair<RegionIndex, RegionIndex>
   getRegions(const QVector<QVector<double>> &seizures,
              const QVector<QVector<double>> &se);
+  std::pair<RegionIndex, RegionIndex>
+  indexRegions(const std::vector<Region> &seizures, std::vector<Region> se);
   void showRegions();
   void hideRegions();
   QVector<double> downsampleData(const QVector<double> &x,
@@ -1,4 +1,5 @@
 #include "gridwidget.h"
+#include "trace.h"
 #include <QAction>
 #include <QContextMenuEvent>
 #include <QGraphicsSceneMouseEvent>
@@ -9,7 +10,8 @@
 
 GridWidget::GridWidget(int rows, int cols, QWidget *parent)
     : QGraphicsView(parent), rows(rows), cols(cols), is_recording_video(false),
-      selected_channel(nullptr), animation_phase(0), opacity(1.0) {
+      selected_channel(nullptr), animation_phase(0), opacity(1.0),
+      propagation_item(nullptr), spread_item(nullptr) {
   scene = new QGraphicsScene(this);
   setScene(scene);
   createGrid();
@@ -30,9 +32,23 @@ void GridWidget::createGrid() {
       cells[i][j] = cell;
     }
   }
+  propagation_item = createOverlay(QColor(20, 20, 20));
+  spread_item = createOverlay(QColor(0, 120, 255));
   resizeGrid();
 }
 
+QGraphicsPathItem *GridWidget::createOverlay(const QColor &color) {
+  QPen pen(color, 2);
+  pen.setCosmetic(true);
+  QGraphicsPathItem *item = new QGraphicsPathItem();
+  item->setPen(pen);
+  item->setZValue(1);
+  item->setVisible(false);
+  item->setAcceptedMouseButtons(Qt::NoButton);
+  scene->addItem(item);
+  return item;
+}
+
 void GridWidget::resizeGrid() {
   QRectF rect = viewport()->rect();
 
@@ -59,6 +75,12 @@ void GridWidget::resizeGrid() {
                           top_left_y + i * cell_size);
     }
   }
+
+  QTransform overlay_transform;
+  overlay_transform.translate(top_left_x, top_left_y);
+  overlay_transform.scale(cell_size, cell_size);
+  propagation_item->setTransform(overlay_transform);
+  spread_item->setTransform(overlay_transform);
 }
 
 void GridWidget::setBackgroundImage(const QString &image_path) {
@@ -112,6 +134,11 @@ void GridWidget::cell_mouse_press_event(QGraphicsSceneMouseEvent *event) {
   }
 }
 
+void GridWidget::paintEvent(QPaintEvent *event) {
+  ScopedTrace trace("grid paint", TraceMetric::FrameMs);
+  QGraphicsView::paintEvent(event);
+}
+
 void GridWidget::resizeEvent(QResizeEvent *event) {
   QGraphicsView::resizeEvent(event);
   resizeGrid();
@@ -146,6 +173,84 @@ void GridWidget::setCellOpacity(qreal opacity) {
   this->opacity = opacity;
 }
 
+void GridWidget::setCellValues(const QVector<qreal> &values,
+                               const QColor &color) {
+  for (int i = 0; i < rows; ++i) {
+    for (int j = 0; j < cols; ++j) {
+      int index = i * cols + j;
+      if (index < masked_cells.size() && masked_cells[index]) {
+        cells[i][j]->setColor(Qt::darkGray, 1.0, opacity);
+        continue;
+      }
+      qreal value = index < values.size() ? values[index] : 0.0;
+      cells[i][j]->setColor(color, value, opacity);
+    }
+  }
+  scene->update();
+}
+
+void GridWidget::setMaskedCells(const QVector<bool> &masked) {
+  // Cells leaving the mask stay blank until the next setCellValues()
+  for (int i = 0; i < rows; ++i) {
+    for (int j = 0; j < cols; ++j) {
+      int index = i * cols + j;
+      bool now = index < masked.size() && masked[index];
+      bool before = index < masked_cells.size() && masked_cells[index];
+      if (now) {
+        cells[i][j]->setColor(Qt::darkGray, 1.0, opacity);
+      } else if (before) {
+        cells[i][j]->setColor(Qt::white, 0.0, opacity);
+      }
+    }
+  }
+  masked_cells = masked;
+  scene->update();
+  update();
+}
+
+void GridWidget::setCellLabels(const QVector<QString> &labels) {
+  for (int i = 0; i < rows; ++i) {
+    for (int j = 0; j < cols; ++j) {
+      int index = i * cols + j;
+      cells[i][j]->setText(index < labels.size() ? labels[index] : QString(),
+                           false);
+    }
+  }
+  scene->update();
+}
+
+void GridWidget::setPropagationLines(const QVector<QLineF> &arrows) {
+  QPainterPath path;
+  for (const QLineF &arrow : arrows) {
+    path.moveTo(arrow.p1());
+    path.lineTo(arrow.p2());
+    // Arrowhead
+    QLineF head(arrow.p2(), arrow.p1());
+    head.setLength(arrow.length() * 0.3);
+    head.setAngle(head.angle() + 25);
+    path.moveTo(arrow.p2());
+    path.lineTo(head.p2());
+    head.setAngle(head.angle() - 50);
+    path.moveTo(arrow.p2());
+    path.lineTo(head.p2());
+  }
+  propagation_item->setPath(path);
+}
+
+void GridWidget::setSpreadLines(const QPolygonF &points) {
+  QPainterPath path;
+  path.addPolygon(points);
+  spread_item->setPath(path);
+}
+
+void GridWidget::showPropagationLines(bool visible) {
+  propagation_item->setVisible(visible);
+}
+
+void GridWidget::showSpreadLines(bool visible) {
+  spread_item->setVisible(visible);
+}
+
 void GridWidget::startAnimation() { animation_timer.start(); }
 
 void GridWidget::stopAnimation() { animation_timer.stop(); }
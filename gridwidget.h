@@ -5,6 +5,7 @@
 #include <QVector>
 #include <QTimer>
 #include <QGraphicsPixmapItem>
+#include <QGraphicsPathItem>
 #include "colorcell.h"
 
 class GridWidget : public QGraphicsView {
@@ -19,6 +20,19 @@ public:
     void startAnimation();
     void stopAnimation();
     void setCellOpacity(qreal opacity);
+    // One strength in [0, 1] per cell, row by row
+    void setCellValues(const QVector<qreal> &values, const QColor &color);
+    // Cells flagged here, row by row, are drawn grey by setCellValues
+    void setMaskedCells(const QVector<bool> &masked);
+    // One label per cell, row by row; an empty vector clears every label.
+    // The scene is repainted once, not once per cell.
+    void setCellLabels(const QVector<QString> &labels);
+    // Overlays in grid units, with x the column and y the row of a cell
+    // centre. Each overlay is one path item, however many lines it holds.
+    void setPropagationLines(const QVector<QLineF> &arrows);
+    void setSpreadLines(const QPolygonF &points);
+    void showPropagationLines(bool visible);
+    void showSpreadLines(bool visible);
 
 signals:
     void cell_clicked(int row, int col);
@@ -26,6 +40,7 @@ signals:
     void save_as_image_requested();
 
 protected:
+    void paintEvent(QPaintEvent *event) override;
     void resizeEvent(QResizeEvent *event) override;
     void contextMenuEvent(QContextMenuEvent *event) override;
     void leaveEvent(QEvent *event) override;
@@ -37,6 +52,7 @@ private:
     void createGrid();
     void resizeGrid();
     void cell_mouse_press_event(QGraphicsSceneMouseEvent *event);
+    QGraphicsPathItem *createOverlay(const QColor &color);
 
     QGraphicsScene *scene;
     int rows, cols;
@@ -48,6 +64,9 @@ private:
     qreal animation_phase;
     QGraphicsPixmapItem *background_image;
     qreal opacity;
+    QVector<bool> masked_cells;
+    QGraphicsPathItem *propagation_item;
+    QGraphicsPathItem *spread_item;
 };
 
 #endif // GRIDWIDGET_H
@@ -1,14 +1,39 @@
 #include "mainwindow.h"
+#include "analysiscache.h"
+#include "brwreader.h"
+#include "channelquality.h"
 #include "constants.h"
+#include "framereader.h"
 #include "graphwidget.h"
 #include "gridwidget.h"
+#include "memoryledger.h"
+#include "resampler.h"
+#include "rereference.h"
+#include "trace.h"
 #include <H5Cpp.h>
+#include <QCheckBox>
+#include <QDialog>
+#include <QDialogButtonBox>
+#include <QDoubleSpinBox>
+#include <QElapsedTimer>
+#include <QFileDialog>
+#include <QFormLayout>
 #include <QGraphicsScene>
 #include <QGraphicsView>
+#include <QHeaderView>
+#include <QInputDialog>
 #include <QLabel>
 #include <QMenuBar>
 #include <QMessageBox>
+#include <QPixmapCache>
+#include <QSpinBox>
+#include <QStatusBar>
+#include <QTableWidget>
 #include <QVBoxLayout>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
 #include <utility>
@@ -19,163 +44,144 @@
 #include <string>
 #include <vector>
 
-struct ChannelData {
-  std::vector<double> signal;
-  std::vector<int> name;
-};
-
 struct ElectrodeInfo {
   int Row;
   int Col;
 };
 
-std::pair<std::vector<int>, std::vector<int>>
-getChs(const std::string &FilePath) {
-  try {
-    H5::H5File file(FilePath, H5F_ACC_RDONLY);
-
-    H5::DataSet dataset = file.openDataSet("/3BRecInfo/3BMeaStreams/Raw/Chs");
-
-    H5::DataSpace dataspace = dataset.getSpace();
-    hsize_t dims[2];
-    int ndims = dataspace.getSimpleExtentDims(dims, NULL);
-
-    H5::CompType mtype(sizeof(int) * 2);
-    mtype.insertMember("Row", 0, H5::PredType::NATIVE_INT);
-    mtype.insertMember("Col", sizeof(int), H5::PredType::NATIVE_INT);
-
-    std::vector<std::pair<int, int>> data(dims[0]);
-
-    dataset.read(data.data(), mtype);
-
-    std::vector<int> rows(dims[0]);
-    std::vector<int> cols(dims[0]);
+namespace {
+// The HDF5 library is not built thread-safe, so one reader at a time
+std::mutex hdf5Mutex;
+// One analysis cache write at a time
+std::mutex cacheMutex;
+
+struct LoadedRecording {
+  std::vector<ChannelData> channels;
+  std::vector<ChannelQuality> quality;
+  double rate = 0.0;
+  QString warning;
+  // Set when the recording was loaded at a lower rate to fit its budget
+  QString notice;
+  QString errorTitle;
+  QString error;
+  // Saved analysis of the recording, when its cache is current
+  std::shared_ptr<AnalysisResults> cached;
+  uint64_t sourceKey = 0;
+};
 
-    for (size_t i = 0; i < dims[0]; ++i) {
-      rows[i] = data[i].first;
-      cols[i] = data[i].second;
+const std::size_t MB = 1024 * 1024;
+
+// Keeps the first and last extreme of each bucket of stride samples, in
+// the order they occur, on an evenly spaced time axis
+void reduceTrace(const std::vector<double> &signal, double rate,
+                 std::size_t stride, QVector<double> &x, QVector<double> &y) {
+  std::size_t buckets = (signal.size() + stride - 1) / stride;
+  x.resize(static_cast<int>(buckets * 2));
+  y.resize(static_cast<int>(buckets * 2));
+  for (std::size_t b = 0; b < buckets; ++b) {
+    std::size_t first = b * stride;
+    std::size_t last = std::min(signal.size(), first + stride);
+    std::size_t low = first, high = first;
+    for (std::size_t j = first; j < last; ++j) {
+      if (signal[j] < signal[low])
+        low = j;
+      if (signal[j] > signal[high])
+        high = j;
     }
-
-    return std::make_pair(std::move(rows), std::move(cols));
-  } catch (H5::Exception &error) {
-    std::cerr << "H5 Exception: ";
-    error.printErrorStack();
-    throw std::runtime_error("Error reading HDF5 file");
-  } catch (std::exception &e) {
-    std::cerr << "Standard exception: " << e.what() << std::endl;
-    throw;
-  } catch (...) {
-    std::cerr << "Unknown exception occurred" << std::endl;
-    throw;
+    x[2 * b] = (first + 0.25 * stride) / rate;
+    x[2 * b + 1] = (first + 0.75 * stride) / rate;
+    y[2 * b] = signal[std::min(low, high)];
+    y[2 * b + 1] = signal[std::max(low, high)];
   }
 }
+}
 
-std::vector<ChannelData> get_cat_envelop(const std::string &FileName) {
+// Reads through the shared frame reader, so grid playback can use the file
+// between blocks
+std::vector<ChannelData> get_cat_envelop(FrameReader &reader,
+                                         const ReferenceSettings &reference,
+                                         const QualitySettings &qualitySettings,
+                                         std::vector<ChannelQuality> &quality,
+                                         QString &warning,
+                                         const CancelToken &cancel) {
+  ScopedTrace trace("load");
   try {
-    H5::H5File file(FileName, H5F_ACC_RDONLY);
-
-    auto readDataset = [&file](const std::string &path) {
-      H5::DataSet dataset = file.openDataSet(path);
-      H5::DataSpace dataspace = dataset.getSpace();
-      H5T_class_t type_class = dataset.getTypeClass();
-
-      if (type_class == H5T_INTEGER) {
-        int data;
-        dataset.read(&data, H5::PredType::NATIVE_INT);
-        return static_cast<double>(data);
-      } else if (type_class == H5T_FLOAT) {
-        double data;
-        dataset.read(&data, H5::PredType::NATIVE_DOUBLE);
-        return data;
-      } else {
-        throw std::runtime_error("Unsupported data type");
-      }
-    };
-
-    long long NRecFrames =
-        static_cast<long long>(readDataset("/3BRecInfo/3BRecVars/NRecFrames"));
-    double sampRate = readDataset("/3BRecInfo/3BRecVars/SamplingRate");
-    double signalInversion =
-        readDataset("/3BRecInfo/3BRecVars/SignalInversion");
-    double maxUVolt = readDataset("/3BRecInfo/3BRecVars/MaxVolt");
-    double minUVolt = readDataset("/3BRecInfo/3BRecVars/MinVolt");
-    int bitDepth =
-        static_cast<int>(readDataset("/3BRecInfo/3BRecVars/BitDepth"));
-
-    uint64_t qLevel =
-        static_cast<uint64_t>(1) ^ static_cast<uint64_t>(bitDepth);
-
-    double fromQLevelToUVolt =
-        (maxUVolt - minUVolt) / static_cast<double>(qLevel);
-    double ADCCountsToMV = signalInversion * fromQLevelToUVolt;
-    double MVOffset = signalInversion * minUVolt;
-
-    auto [Rows, Cols] = getChs(FileName);
-    int total_channels = Rows.size();
-
-    H5::DataSet full_data = file.openDataSet("/3BData/Raw");
-    H5::DataSpace dataspace = full_data.getSpace();
-    int rank = dataspace.getSimpleExtentNdims();
-    std::vector<hsize_t> dims(rank);
-    dataspace.getSimpleExtentDims(dims.data(), NULL);
-
-    // QString debugInfo = QString("Raw data dimensions: %1\n"
-    //                             "NRecFrames: %2\n"
-    //                             "Sampling Rate: %3\n"
-    //                             "Signal Inversion: %4\n"
-    //                             "Max Voltage: %5\n"
-    //                             "Min Voltage: %6\n"
-    //                             "Bit Depth: %7\n"
-    //                             "Q Level: %8\n"
-    //                             "From Q Level to Voltage: %9\n"
-    //                             "ADC Counts to MV: %10\n"
-    //                             "MV Offset: %11\n"
-    //                             "Total channels: %12\n"
-    //                             "Calculated channels: %13")
-    //                         .arg(dims[0])
-    //                         .arg(NRecFrames)
-    //                         .arg(sampRate)
-    //                         .arg(signalInversion)
-    //                         .arg(maxUVolt)
-    //                         .arg(minUVolt)
-    //                         .arg(bitDepth)
-    //                         .arg(qLevel)
-    //                         .arg(fromQLevelToUVolt)
-    //                         .arg(ADCCountsToMV)
-    //                         .arg(MVOffset)
-    //                         .arg(total_channels)
-    //                         .arg(dims[0] / NRecFrames);
-    //
-    // QMessageBox::information(nullptr, "Debug Info", debugInfo);
-
-    if (rank != 1) {
-      throw std::runtime_error("Unexpected number of dimensions in raw data");
+    const BrwInfo &info = reader.info();
+    long long NRecFrames = info.nRecFrames;
+    int total_channels = info.channelCount();
+
+    if (reader.rawSize() != static_cast<hsize_t>(NRecFrames * total_channels)) {
+      warning = QString("Warning: Data size mismatch.\n"
+                        "Expected size: %1\n"
+                        "Actual size: %2")
+                    .arg(NRecFrames * total_channels)
+                    .arg(reader.rawSize());
     }
+    long long frameCount = reader.frameCount();
 
-    if (dims[0] != static_cast<hsize_t>(NRecFrames * total_channels)) {
-      QString warningMsg = QString("Warning: Data size mismatch.\n"
-                                   "Expected size: %1\n"
-                                   "Actual size: %2")
-                               .arg(NRecFrames * total_channels)
-                               .arg(dims[0]);
-      QMessageBox::warning(nullptr, "Size Mismatch", warningMsg);
+    std::vector<ChannelData> channelDataList(total_channels);
+    for (int k = 0; k < total_channels; ++k) {
+      channelDataList[k].signal.resize(frameCount);
+      channelDataList[k].name = {info.rows[k], info.cols[k]};
     }
 
-    std::vector<ChannelData> channelDataList;
-    channelDataList.reserve(total_channels);
+    ReReferencer referencer(reference, info);
+    QualityAccumulator qualityPass(info);
+
+    // Stream the frame-interleaved raw data in blocks, convert and
+    // re-reference each block in its native layout, then scatter it into the
+    // per-channel signals. Filtering is a later analysis stage.
+    // Blocks shrink so the counts and converted frames fit the raw buffer
+    // budget
+    const std::size_t frameBytes =
+        total_channels * (sizeof(int16_t) + sizeof(double));
+    long long blockLimit = LOADER_BLOCK_FRAMES;
+    if (std::size_t budget = memoryBudget(MemorySubsystem::RawBuffers)) {
+      blockLimit = std::clamp<long long>(budget / frameBytes, 64,
+                                         LOADER_BLOCK_FRAMES);
+    }
+    MemoryCharge rawCharge(MemorySubsystem::RawBuffers,
+                           blockLimit * frameBytes);
+    std::vector<int16_t> counts;
+    std::vector<double> frames;
+    uint64_t loadStart = traceNow();
+    for (long long first = 0; first < frameCount; first += blockLimit) {
+      if (cancel.cancelled())
+        return {};
+      long long blockFrames = std::min(blockLimit, frameCount - first);
+      {
+        ScopedTrace readTrace("read block");
+        reader.readFrames(first, blockFrames, counts);
+      }
+      ScopedTrace convertTrace("convert block");
 
-    std::vector<int16_t> all_data(dims[0]);
-    full_data.read(all_data.data(), H5::PredType::NATIVE_INT16);
+      // Channels that are already dead in the first block stay out of the
+      // reference; the final mask covers the whole recording
+      qualityPass.process(counts.data(), blockFrames);
+      if (first == 0) {
+        referencer.setMask(usableMask(qualityPass.result(qualitySettings)));
+      }
 
-    for (int k = 0; k < total_channels; ++k) {
-      ChannelData ch_data;
-      ch_data.signal.reserve(NRecFrames);
+      frames.resize(counts.size());
+      referencer.process(counts.data(), first, blockFrames, frames.data());
 
-      for (long long i = 0; i < NRecFrames; ++i) {
-        double val = static_cast<double>(all_data[i * total_channels + k]);
-        val = (val * ADCCountsToMV + MVOffset) / 1000000.0; // Convert to mV
-        ch_data.signal.push_back(val);
+      for (long long i = 0; i < blockFrames; ++i) {
+        const double *frame = frames.data() + i * total_channels;
+        for (int k = 0; k < total_channels; ++k) {
+          channelDataList[k].signal[first + i] = frame[k];
+        }
       }
+      if (traceActive()) {
+        double megabytes = (first + blockFrames) * total_channels *
+                           sizeof(int16_t) / 1e6;
+        setTraceMetric(TraceMetric::LoadMBps,
+                       megabytes / ((traceNow() - loadStart) * 1e-9));
+      }
+    }
+
+    quality = qualityPass.result(qualitySettings);
+
+    for (auto &ch_data : channelDataList) {
       double mean =
           std::accumulate(ch_data.signal.begin(), ch_data.signal.end(), 0.0) /
           ch_data.signal.size();
@@ -183,40 +189,70 @@ std::vector<ChannelData> get_cat_envelop(const std::string &FileName) {
       for (auto &val : ch_data.signal) {
         val -= mean;
       }
-
-      ch_data.name = {Rows[k], Cols[k]};
-      channelDataList.push_back(std::move(ch_data));
     }
+    referencer.blank(channelDataList);
 
     return channelDataList;
   } catch (H5::Exception &error) {
-    std::string errorMsg = "H5 Exception: ";
+    // Runs on a pool thread, so the caller reports it
     error.printErrorStack();
-    errorMsg += error.getDetailMsg();
-    QMessageBox::critical(nullptr, "HDF5 Error",
-                          QString::fromStdString(errorMsg));
-    throw std::runtime_error("Error reading HDF5 file");
-  } catch (std::exception &e) {
-    QMessageBox::critical(nullptr, "Standard Exception", e.what());
-    throw;
-  } catch (...) {
-    QMessageBox::critical(nullptr, "Unknown Exception",
-                          "An unknown exception occurred");
-    throw;
+    throw std::runtime_error("H5 Exception: " + error.getDetailMsg());
   }
 }
+
+// The reduced-rate counterpart of get_cat_envelop: the same quality pass,
+// re-reference and artifact blanking, with the signals resampled to
+// targetRate as they are read. Returns the achieved rate.
+double loadResampled(FrameReader &reader, const ReferenceSettings &reference,
+                     const QualitySettings &qualitySettings,
+                     double targetRate, std::vector<ChannelData> &channels,
+                     std::vector<ChannelQuality> &quality) {
+  const BrwInfo &info = reader.info();
+  ReReferencer referencer(reference, info);
+  QualityAccumulator qualityPass(info);
+  double rate = resampleToChannels(
+      info, reader.frameCount(),
+      [&](long long first, long long count, std::vector<int16_t> &counts) {
+        reader.readFrames(first, count, counts);
+        qualityPass.process(counts.data(), count);
+        if (first == 0) {
+          referencer.setMask(usableMask(qualityPass.result(qualitySettings)));
+        }
+      },
+      targetRate, channels, &referencer);
+  quality = qualityPass.result(qualitySettings);
+  return rate;
+}
+
 MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
   setWindowTitle("Spatial SE Viewer");
 
   createCentralWidget();
   createRightPane();
   createBottomPane();
+  perfOverlay = new PerfOverlay(mainTabWidget);
+  setMemoryBudgets(defaultMemoryBudgets());
+  memoryTimer = new QTimer(this);
+  memoryTimer->setInterval(1000);
+  connect(memoryTimer, &QTimer::timeout, this,
+          &MainWindow::updateMemoryUsage);
+  memoryTimer->start();
 
   createMenuBar();
 
   setCentralWidget(mainTabWidget);
 }
 
+MainWindow::~MainWindow() {
+  loadToken.cancel();
+  plotToken.cancel();
+  gridToken.cancel();
+  analysisToken.cancel();
+  connectivityToken.cancel();
+  // Running tasks still use the window; queued ones are dropped
+  tasks.wait();
+}
+
 void MainWindow::testGraph() {
   std::string filePath =
       "~/Jake-Squared/Sz_SE_Detection/5_13_24_slice1B_resample_100.brw";
@@ -240,43 +276,1448 @@ void MainWindow::testGraph() {
     return;
   }
 
+  // A new load replaces any that is still running
+  loadToken.cancel();
+  loadToken = CancelToken::create();
+  CancelToken token = loadToken;
+  ReferenceSettings referenceSettings = reference;
+  QualitySettings qualityThresholds = qualitySettings;
+  // The filtered copy doubles what the signals take
+  int copies = lowPass.enabled ? 2 : 1;
+  statusBar()->showMessage("Loading " + checkFile.fileName());
+
+  tasks.submit(
+      TaskPriority::Batch,
+      [this, filePath, referenceSettings, qualityThresholds, copies,
+       token]() {
+        auto loaded = std::make_shared<LoadedRecording>();
+        try {
+          auto frames = std::make_shared<FrameReader>(filePath, hdf5Mutex);
+          loaded->rate = frames->info().samplingRate;
+          // The grid plays from the raw frames while the signals load
+          QMetaObject::invokeMethod(
+              this,
+              [this, frames, token]() {
+                if (!token.cancelled()) {
+                  setFrameSource(frames);
+                }
+              },
+              Qt::QueuedConnection);
+          try {
+            loaded->sourceKey = analysisSourceKey(filePath, referenceSettings);
+            auto cached = std::make_shared<AnalysisResults>();
+            if (readAnalysisCache(analysisCachePath(filePath),
+                                  loaded->sourceKey, *cached)) {
+              loaded->cached = cached;
+              // Shown at once; the signals follow when they are loaded
+              QMetaObject::invokeMethod(
+                  this,
+                  [this, cached, token]() {
+                    if (!token.cancelled()) {
+                      showCachedAnalysis(*cached);
+                    }
+                  },
+                  Qt::QueuedConnection);
+            }
+          } catch (const std::exception &) {
+            // A damaged cache is replaced after this load is analysed
+          }
+          double needed = static_cast<double>(frames->frameCount()) *
+                          frames->info().channelCount() * sizeof(double) *
+                          copies;
+          std::size_t budget = memoryBudget(MemorySubsystem::Channels);
+          if (budget != 0 && needed > budget) {
+            // A reduced-rate copy instead of a load that would not fit,
+            // read through the frame reader so playback keeps the file
+            // between blocks
+            double targetRate = loaded->rate * 0.9 * budget / needed;
+            loaded->rate = loadResampled(*frames, referenceSettings,
+                                         qualityThresholds, targetRate,
+                                         loaded->channels, loaded->quality);
+            loaded->notice =
+                QString("The recording needs %1 MB at full rate, over the "
+                        "%2 MB channel budget, so it was loaded at %3 Hz.")
+                    .arg(needed / MB, 0, 'f', 0)
+                    .arg(budget / MB)
+                    .arg(loaded->rate);
+          } else {
+            loaded->channels =
+                get_cat_envelop(*frames, referenceSettings, qualityThresholds,
+                                loaded->quality, loaded->warning, token);
+          }
+        } catch (const H5::FileIException &e) {
+          loaded->errorTitle = "HDF5 File Error";
+          loaded->error =
+              QString("Failed to open HDF5 file: %1\nError details: %2")
+                  .arg(QString::fromStdString(filePath))
+                  .arg(e.getCDetailMsg());
+        } catch (const std::exception &e) {
+          loaded->errorTitle = "Error";
+          loaded->error = QString("Failed to load data: %1").arg(e.what());
+        }
+        if (token.cancelled())
+          return;
+        QMetaObject::invokeMethod(
+            this,
+            [this, loaded, filePath, token]() {
+              if (token.cancelled())
+                return;
+              if (!loaded->warning.isEmpty()) {
+                QMessageBox::warning(this, "Size Mismatch", loaded->warning);
+              }
+              if (!loaded->notice.isEmpty()) {
+                QMessageBox::information(this, "Memory Budget",
+                                         loaded->notice);
+              }
+              if (!loaded->error.isEmpty()) {
+                statusBar()->clearMessage();
+                QMessageBox::critical(this, loaded->errorTitle,
+                                      loaded->error);
+                return;
+              }
+              cachePath = analysisCachePath(filePath);
+              cacheKey = loaded->sourceKey;
+              loadChannels(std::move(loaded->channels), loaded->rate,
+                           std::move(loaded->quality), loaded->cached.get());
+            },
+            Qt::QueuedConnection);
+      },
+      token);
+}
+
+void MainWindow::loadChannels(std::vector<ChannelData> channelDataList,
+                              double rate,
+                              std::vector<ChannelQuality> channelQuality,
+                              const AnalysisResults *cached) {
+  samplingRate = rate;
+  if (lowPass.enabled && lowPass.cutoffHz >= rate / 2) {
+    // A reduced-rate load can put the cutoff past the new Nyquist rate
+    lowPass.cutoffHz = MAX_CUTOFF_FRACTION * rate;
+    statusBar()->showMessage(
+        QString("Low-pass cutoff lowered to %1 Hz for the %2 Hz signals")
+            .arg(lowPass.cutoffHz)
+            .arg(rate),
+        5000);
+  }
+  int channelCount = static_cast<int>(channelDataList.size());
+  std::size_t frames =
+      channelDataList.empty() ? 0 : channelDataList[0].signal.size();
+  // A fresh graph per recording; a pass still running keeps the old one and
+  // its results are dropped
+  analysisToken.cancel();
+  analysisRunning = false;
+  analysisPending = false;
+  connectivityToken.cancel();
+  analysis = std::make_shared<AnalysisGraph>();
+  // Its versions start over
+  plottedVersion = publishedVersion = rasterVersion = 0;
+  cachedEventsVersion = cachedSpikesVersion = 0;
+  analysis->setSource(std::move(channelDataList), rate,
+                      std::move(channelQuality));
+  if (cached) {
+    // Settings must be in place first so the restored stages can tell
+    // whether they still hold
+    analysis->setQualitySettings(qualitySettings);
+    analysis->setLowPass(lowPass);
+    analysis->setEnvelope(envelope);
+    analysis->setDetection(detection);
+    analysis->setSpikeSettings(spikeSettings);
+    analysis->restore(*cached);
+  }
+  connectivity.clear();
+  plotChannelIds.clear();
+  for (int c = 0; c < PLOT_COUNT && c < channelCount; ++c) {
+    plotChannelIds.push_back(c);
+  }
+  refreshAnalysis();
+  // With a frame source the playhead stays in the recording's own frames
+  if (!frameReader) {
+    playbackRate = rate;
+    progressBar->setRange(0, frames == 0 ? 0 : static_cast<int>(frames) - 1);
+    graphWidget->updateRedLines(progressBar->value(), playbackRate);
+  }
+}
+
+void MainWindow::setFrameSource(std::shared_ptr<FrameReader> frames) {
+  playbackTimer->stop();
+  frameReader = std::move(frames);
+  playbackRate = frameReader->info().samplingRate;
+  progressBar->setRange(
+      0, static_cast<int>(std::max(0LL, frameReader->frameCount() - 1)));
+  progressBar->setValue(0);
+  graphWidget->updateRedLines(0, playbackRate);
+  updateGridFrame();
+}
+
+long long MainWindow::playbackStep() const {
+  double speed = speedCombo->currentText().toDouble();
+  return std::max(1LL, std::llround(speed * playbackRate *
+                                    INTERACTIVE_FRAME_MS / 1000.0));
+}
+
+void MainWindow::togglePlayback() {
+  if (playbackTimer->isActive()) {
+    playbackTimer->stop();
+  } else if (frameReader || !analysis->empty()) {
+    if (progressBar->value() >= progressBar->maximum()) {
+      progressBar->setValue(0);
+    }
+    playbackTimer->start(INTERACTIVE_FRAME_MS);
+  }
+}
+
+void MainWindow::stepPlayhead(long long frames) {
+  long long value = std::clamp<long long>(progressBar->value() + frames, 0,
+                                          progressBar->maximum());
+  progressBar->setValue(static_cast<int>(value));
+  if (value == progressBar->maximum()) {
+    playbackTimer->stop();
+  }
+}
+
+void MainWindow::updateGridFrame() {
+  if (!frameReader || !gridShowsSignal)
+    return;
+
+  // Only the newest playhead position is worth drawing
+  gridToken.cancel();
+  gridToken = CancelToken::create();
+  CancelToken token = gridToken;
+  std::shared_ptr<FrameReader> reader = frameReader;
+  long long frame = progressBar->value();
+  long long ahead =
+      playbackTimer->isActive() ? frame + 4 * playbackStep() : -1;
+  PlaybackSettings settings = playbackSettings;
+  // Bad channels neither paint cells nor skew the normalisation. The mask
+  // only applies once the analysis holds this recording's channels.
+  std::vector<char> mask;
+  if (analysis->mask().size() ==
+      static_cast<std::size_t>(reader->info().channelCount())) {
+    mask = analysis->mask();
+  }
+
+  tasks.submit(
+      TaskPriority::Visible,
+      [this, reader, frame, ahead, settings, mask, token]() {
+        ScopedTrace trace("grid frame");
+        std::vector<double> values;
+        QString error;
+        try {
+          reader->windowMetric(frame, settings, values);
+          if (ahead >= 0) {
+            reader->prefetch(ahead, settings);
+          }
+        } catch (const H5::Exception &e) {
+          error = QString::fromStdString(e.getDetailMsg());
+        } catch (const std::exception &e) {
+          error = e.what();
+        }
+
+        // Relative to the median channel, so background activity sits low
+        // and bursts saturate
+        for (std::size_t c = 0; c < values.size(); ++c) {
+          if (!channelUsable(mask, c)) {
+            values[c] = 0.0;
+          }
+        }
+        std::vector<double> sorted;
+        for (double value : values) {
+          if (value > 0) {
+            sorted.push_back(value);
+          }
+        }
+        double reference = 0.0;
+        if (!sorted.empty()) {
+          auto middle = sorted.begin() + sorted.size() / 2;
+          std::nth_element(sorted.begin(), middle, sorted.end());
+          reference = 4.0 * *middle;
+        }
+        QVector<qreal> strengths(GRID_SIZE * GRID_SIZE, 0.0);
+        const BrwInfo &info = reader->info();
+        for (std::size_t c = 0; c < values.size() && reference > 0; ++c) {
+          int row = info.rows[c] - 1, col = info.cols[c] - 1;
+          if (row >= 0 && row < GRID_SIZE && col >= 0 && col < GRID_SIZE) {
+            strengths[row * GRID_SIZE + col] =
+                std::min(1.0, values[c] / reference);
+          }
+        }
+
+        QMetaObject::invokeMethod(
+            this,
+            [this, strengths, error, token]() {
+              if (token.cancelled())
+                return;
+              if (!error.isEmpty()) {
+                playbackTimer->stop();
+                QMessageBox::critical(this, "Playback Error", error);
+                return;
+              }
+              gridWidget->setCellValues(strengths, Qt::blue);
+            },
+            Qt::QueuedConnection);
+      },
+      token);
+}
+
+void MainWindow::editPlayback() {
+  QDialog dialog(this);
+  dialog.setWindowTitle("Grid Playback");
+  QFormLayout *form = new QFormLayout(&dialog);
+
+  QComboBox *metricCombo = new QComboBox();
+  metricCombo->addItems({"RMS", "Line length", "Peak to peak"});
+  metricCombo->setCurrentIndex(static_cast<int>(playbackSettings.metric));
+  form->addRow("Metric:", metricCombo);
+
+  QDoubleSpinBox *windowBox = new QDoubleSpinBox();
+  windowBox->setRange(1.0, 10000.0);
+  windowBox->setSuffix(" ms");
+  windowBox->setValue(playbackSettings.windowSeconds * 1000.0);
+  form->addRow("Window:", windowBox);
+
+  QDialogButtonBox *buttons =
+      new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
+  connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+  connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+  form->addRow(buttons);
+
+  if (dialog.exec() == QDialog::Accepted) {
+    playbackSettings.metric =
+        static_cast<FrameMetric>(metricCombo->currentIndex());
+    playbackSettings.windowSeconds = windowBox->value() / 1000.0;
+    updateGridFrame();
+  }
+}
+
+void MainWindow::refreshAnalysis() {
+  if (analysis->empty())
+    return;
+  if (analysisRunning) {
+    // Rerun with the settings as they are when this pass is in
+    analysisPending = true;
+    return;
+  }
+
+  // Only the stages downstream of a changed setting do any work here
+  analysis->setQualitySettings(qualitySettings);
+  analysis->setLowPass(lowPass);
+  analysis->setEnvelope(envelope);
+  analysis->setDetection(detection);
+  analysis->setSpikeSettings(spikeSettings);
+
+  // The stages run as one batch task, yielding to visible and prefetch
+  // work. The views leave the graph alone until it is posted back.
+  analysisRunning = true;
+  analysisPending = false;
+  analysisToken = CancelToken::create();
+  CancelToken token = analysisToken;
+  std::shared_ptr<AnalysisGraph> graph = analysis;
+  bool spikes = rasterCreated;
+  bool propagation = doShowPropagation || doShowSpread;
+  statusBar()->showMessage("Running analysis");
+
+  tasks.submit(
+      TaskPriority::Batch,
+      [this, graph, spikes, propagation, token]() {
+        ScopedTrace trace("analysis");
+        QString error, spikeError;
+        try {
+          graph->channelsVersion();
+          graph->eventsVersion();
+          if (propagation) {
+            graph->propagation().computeAll();
+          }
+        } catch (const std::exception &e) {
+          error = e.what();
+        }
+        if (spikes && error.isEmpty()) {
+          try {
+            graph->spikesVersion();
+          } catch (const std::exception &e) {
+            spikeError = e.what();
+          }
+        }
+        QMetaObject::invokeMethod(
+            this,
+            [this, error, spikeError, token]() {
+              if (token.cancelled())
+                return;
+              analysisRunning = false;
+              publishAnalysis(error, spikeError);
+              if (analysisPending) {
+                refreshAnalysis();
+              }
+            },
+            Qt::QueuedConnection);
+      },
+      token);
+}
+
+void MainWindow::publishAnalysis(const QString &error,
+                                 const QString &spikeError) {
+  if (!error.isEmpty()) {
+    statusBar()->clearMessage();
+    QMessageBox::critical(this, "Error",
+                          QString("Analysis failed: %1").arg(error));
+    return;
+  }
+  if (!spikeError.isEmpty()) {
+    // Not retried on every refresh until the raster is created again
+    rasterCreated = false;
+    QMessageBox::critical(this, "Error",
+                          QString("Analysis failed: %1").arg(spikeError));
+  }
+
+  // The outputs are up to date, so these only publish them
   try {
-    H5::H5File file(filePath, H5F_ACC_RDONLY);
+    uint64_t channelsVersion = analysis->channelsVersion();
+    if (channelsVersion != plottedVersion ||
+        analysis->mask() != connectivityMask) {
+      connectivity.clear();
+      connectivityMask = analysis->mask();
+    }
+    if (channelsVersion != plottedVersion) {
+      plottedVersion = channelsVersion;
+      plotChannels();
+    }
+    uint64_t eventsVersion = analysis->eventsVersion();
+    if (eventsVersion != publishedVersion) {
+      publishedVersion = eventsVersion;
+      publishEvents();
+    }
+    if (rasterCreated && analysis->spikesVersion() != rasterVersion) {
+      updateRaster();
+    }
+  } catch (const std::exception &e) {
+    // Not retried on every refresh until the raster is created again
+    rasterCreated = false;
+    QMessageBox::critical(this, "Error",
+                          QString("Analysis failed: %1").arg(e.what()));
+  }
+  updateMaskedCells();
+
+  QStringList ran;
+  for (const StageRun &run : analysis->takeRuns()) {
+    ran << QString("%1 %2 ch %3 s")
+               .arg(QString::fromStdString(run.stage))
+               .arg(run.channels)
+               .arg(run.seconds, 0, 'f', 3);
+  }
+  statusBar()->showMessage(ran.isEmpty() ? "Analysis up to date"
+                                         : "Ran " + ran.join(", "));
+  updateMemoryUsage();
+  saveAnalysisCache();
+}
 
-    auto channelDataList = get_cat_envelop(filePath);
+void MainWindow::showCachedAnalysis(const AnalysisResults &cached) {
+  // Channel names alone place the saved results on the grid
+  std::vector<ChannelData> channels(cached.names.size());
+  for (std::size_t c = 0; c < channels.size(); ++c) {
+    channels[c].name = cached.names[c];
+  }
+  cachePath.clear();
+  loadChannels(std::move(channels), cached.samplingRate, cached.quality,
+               &cached);
+  statusBar()->showMessage("Showing the saved analysis while the signals "
+                           "load");
+}
 
-    // Plot the data for each channel
-    for (size_t i = 0; i < PLOT_COUNT; ++i) {
-      const auto &channelData = channelDataList[i];
+void MainWindow::saveAnalysisCache() {
+  if (cachePath.empty() || analysis->empty())
+    return;
+  uint64_t eventsVersion = analysis->eventsVersion();
+  uint64_t spikesVersion = rasterCreated ? analysis->spikesVersion() : 0;
+  if (eventsVersion == cachedEventsVersion &&
+      spikesVersion == cachedSpikesVersion)
+    return;
+  cachedEventsVersion = eventsVersion;
+  cachedSpikesVersion = spikesVersion;
+
+  auto results = std::make_shared<AnalysisResults>(analysis->results());
+  std::string path = cachePath;
+  uint64_t key = cacheKey;
+  tasks.submit(TaskPriority::Batch, [this, path, key,
+                                                    results]() {
+    try {
+      std::lock_guard<std::mutex> lock(cacheMutex);
+      writeAnalysisCache(path, key, *results);
+    } catch (const std::exception &e) {
+      QString message = QString("Analysis cache not saved: %1").arg(e.what());
+      QMetaObject::invokeMethod(
+          this, [this, message]() { statusBar()->showMessage(message); },
+          Qt::QueuedConnection);
+    }
+  });
+}
+
+void MainWindow::updateMemoryUsage() {
+  // A running pass owns the graph; it is measured once posted back
+  if (!analysisRunning) {
+    setMemoryUsage(MemorySubsystem::Channels, analysis->channelBytes());
+    setMemoryUsage(MemorySubsystem::Analysis, analysis->analysisBytes());
+    if (overMemoryBudget(MemorySubsystem::Analysis)) {
+      // Envelopes are the largest output and the cheapest to rebuild
+      analysis->dropEnvelopes();
+      setMemoryUsage(MemorySubsystem::Analysis, analysis->analysisBytes());
+    }
+  }
+  setMemoryUsage(MemorySubsystem::PlotData, graphWidget->plotDataBytes());
 
-      // Create x-axis data (time)
-      QVector<double> xData(channelData.signal.size());
-      for (size_t j = 0; j < xData.size(); ++j) {
-        xData[j] = static_cast<double>(j);
+  std::size_t cacheBudget = memoryBudget(MemorySubsystem::Caches);
+  if (cacheBudget != 0) {
+    // Spectrogram tiles get half, connectivity matrices the rest
+    graphWidget->setSpectrogramBudget(cacheBudget / 2);
+    connectivity.trim(cacheBudget - graphWidget->spectrogramBytes());
+  }
+  setMemoryUsage(MemorySubsystem::Caches,
+                 connectivity.memoryBytes() + graphWidget->spectrogramBytes());
+
+  // Every QCustomPlot holds a paint buffer and a double-buffered backing
+  // store for its widget
+  std::size_t pixmapBytes = 0;
+  for (QCustomPlot *plot : findChildren<QCustomPlot *>()) {
+    qreal ratio = plot->devicePixelRatioF();
+    pixmapBytes += static_cast<std::size_t>(plot->width() * ratio *
+                                            plot->height() * ratio) *
+                   4 * 2;
+  }
+  std::size_t pixmapBudget = memoryBudget(MemorySubsystem::Pixmaps);
+  if (pixmapBudget != 0) {
+    std::size_t left = pixmapBudget > pixmapBytes ? pixmapBudget - pixmapBytes
+                                                  : 0;
+    QPixmapCache::setCacheLimit(static_cast<int>(left / 1024));
+  }
+  setMemoryUsage(MemorySubsystem::Pixmaps,
+                 pixmapBytes +
+                     static_cast<std::size_t>(QPixmapCache::cacheLimit()) *
+                         1024);
+
+  if (memoryTable && memoryTable->isVisible()) {
+    for (int i = 0; i < MEMORY_SUBSYSTEM_COUNT; ++i) {
+      MemorySubsystem subsystem = static_cast<MemorySubsystem>(i);
+      std::size_t budget = memoryBudget(subsystem);
+      QStringList cells = {
+          memorySubsystemName(subsystem),
+          QString::number(memoryUsage(subsystem) / double(MB), 'f', 1),
+          QString::number(memoryPeak(subsystem) / double(MB), 'f', 1),
+          budget ? QString::number(budget / MB) : QString("none")};
+      for (int column = 0; column < cells.size(); ++column) {
+        QTableWidgetItem *item = memoryTable->item(i, column);
+        if (!item) {
+          item = new QTableWidgetItem();
+          memoryTable->setItem(i, column, item);
+        }
+        item->setText(cells[column]);
+        item->setForeground(column == 1 && overMemoryBudget(subsystem)
+                                ? QBrush(Qt::red)
+                                : QBrush());
       }
+    }
+  }
+}
 
-      // Convert signal data to QVector
-      QVector<double> yData(channelData.signal.begin(),
-                            channelData.signal.end());
+void MainWindow::showMemoryDiagnostics() {
+  if (!memoryDialog) {
+    memoryDialog = new QDialog(this);
+    memoryDialog->setWindowTitle("Memory Diagnostics");
+    QVBoxLayout *layout = new QVBoxLayout(memoryDialog);
+    memoryTable = new QTableWidget(MEMORY_SUBSYSTEM_COUNT, 4);
+    memoryTable->setHorizontalHeaderLabels(
+        {"Subsystem", "Used (MB)", "Peak (MB)", "Budget (MB)"});
+    memoryTable->verticalHeader()->hide();
+    memoryTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    memoryTable->horizontalHeader()->setSectionResizeMode(
+        QHeaderView::ResizeToContents);
+    layout->addWidget(memoryTable);
+    memoryDialog->resize(480, 260);
+  }
+  memoryDialog->show();
+  memoryDialog->raise();
+  memoryDialog->activateWindow();
+  updateMemoryUsage();
+}
 
-      // Plot the data
-      graphWidget->simplePlot(xData, yData, i);
+void MainWindow::updateMaskedCells() {
+  const std::vector<char> &mask = analysis->mask();
+  const std::vector<ChannelData> &channels = analysis->channels();
+  QVector<bool> masked(GRID_SIZE * GRID_SIZE, false);
+  for (size_t c = 0; c < mask.size() && c < channels.size(); ++c) {
+    const std::vector<int> &name = channels[c].name;
+    if (mask[c] || name.size() < 2)
+      continue;
+    int row = name[0] - 1, col = name[1] - 1;
+    if (row >= 0 && row < GRID_SIZE && col >= 0 && col < GRID_SIZE) {
+      masked[row * GRID_SIZE + col] = true;
     }
+  }
+  gridWidget->setMaskedCells(masked);
+  updateGridFrame();
+}
 
-  } catch (const H5::FileIException &e) {
-    QMessageBox::critical(
-        this, "HDF5 File Error",
-        QString("Failed to open HDF5 file: %1\nError details: %2")
-            .arg(QString::fromStdString(filePath))
-            .arg(e.getCDetailMsg()));
-  } catch (const std::exception &e) {
-    QMessageBox::critical(this, "Error",
-                          QString("Failed to load data: %1").arg(e.what()));
+void MainWindow::computeConnectivity() {
+  if (analysis->empty()) {
+    QMessageBox::warning(this, "Connectivity", "No recording is loaded.");
+    return;
+  }
+  if (analysisRunning) {
+    QMessageBox::warning(this, "Connectivity",
+                         "The analysis is still running.");
+    return;
+  }
+  std::shared_ptr<const std::vector<ChannelData>> channels =
+      analysis->channelsSnapshot();
+  if (channels->front().signal.empty()) {
+    QMessageBox::warning(this, "Connectivity",
+                         "The signals are still loading.");
+    return;
+  }
+
+  connectivityToken.cancel();
+  connectivityToken = CancelToken::create();
+  CancelToken token = connectivityToken;
+  std::vector<char> mask = analysis->mask();
+  uint64_t generation = connectivity.generation();
+  double rate = samplingRate;
+  int maxLag = static_cast<int>(
+      std::lround(connectivityLagBox->value() * samplingRate / 1000.0));
+  double start = connectivityStartBox->value();
+  double stop = connectivityStopBox->value();
+  connectivityStatus->setText("Computing...");
+
+  tasks.submit(
+      TaskPriority::Batch,
+      [this, channels, mask, generation, rate, maxLag, start, stop,
+       token]() {
+        QElapsedTimer timer;
+        timer.start();
+        std::vector<double> cellValues;
+        int n = 0, pool = 1, cells = 0;
+        QString error;
+        try {
+          std::shared_ptr<const ConnectivityMatrix> matrix =
+              connectivity.compute(*channels, mask, rate, start, stop,
+                                   maxLag, generation);
+
+          // 4096^2 cells is more than the screen can show; average square
+          // blocks so the map stays around 1024 cells a side
+          n = matrix->channels;
+          pool = (n + 1023) / 1024;
+          cells = (n + pool - 1) / pool;
+          cellValues.resize(static_cast<std::size_t>(cells) * cells);
+          for (int y = 0; y < cells; ++y) {
+            for (int x = 0; x < cells; ++x) {
+              double sum = 0.0;
+              int count = 0;
+              for (int i = y * pool; i < std::min(n, (y + 1) * pool); ++i) {
+                for (int j = x * pool; j < std::min(n, (x + 1) * pool); ++j) {
+                  sum += matrix->at(i, j);
+                  ++count;
+                }
+              }
+              cellValues[static_cast<std::size_t>(y) * cells + x] =
+                  sum / count;
+            }
+          }
+        } catch (const std::exception &e) {
+          error = e.what();
+        }
+        qint64 computeMs = timer.elapsed();
+
+        QMetaObject::invokeMethod(
+            this,
+            [this, cellValues, n, pool, cells, computeMs, error, token]() {
+              if (token.cancelled())
+                return;
+              if (!error.isEmpty()) {
+                connectivityStatus->clear();
+                QMessageBox::critical(
+                    this, "Error",
+                    QString("Failed to compute connectivity: %1").arg(error));
+                return;
+              }
+              QCPColorMapData *data = connectivityMap->data();
+              data->setSize(cells, cells);
+              QCPRange centers(0.5 * (pool - 1),
+                               (cells - 1) * pool + 0.5 * (pool - 1));
+              data->setRange(centers, centers);
+              const double *value = cellValues.data();
+              for (int y = 0; y < cells; ++y) {
+                for (int x = 0; x < cells; ++x) {
+                  data->setCell(x, y, *value++);
+                }
+              }
+              connectivityPlot->rescaleAxes();
+              connectivityPlot->replot(QCustomPlot::rpQueuedReplot);
+              connectivityStatus->setText(
+                  QString("%1 channels, %2 ms").arg(n).arg(computeMs));
+              updateMemoryUsage();
+            },
+            Qt::QueuedConnection);
+      },
+      token);
+}
+
+void MainWindow::publishEvents() {
+  const std::vector<ChannelEvents> &events = analysis->events();
+  for (size_t i = 0; i < plotChannelIds.size(); ++i) {
+    const ChannelEvents &channelEvents = events[plotChannelIds[i]];
+    graphWidget->setRegions(i, channelEvents.seizures, channelEvents.se);
+  }
+
+  PropagationEngine &propagation = analysis->propagation();
+  selectedEvent = propagation.recordingEvents().empty() ? -1 : 0;
+  if (doShowPropagation || doShowSpread) {
+    propagation.computeAll();
+  }
+  updatePropagationOverlay();
+  showOrderCheckbox->setEnabled(selectedEvent != -1);
+  if (orderCombo->currentIndex() != 0) {
+    applyOrder();
+  }
+}
+
+void MainWindow::selectEvent(double start) {
+  if (analysisRunning)
+    return;
+  int event = analysis->propagation().eventAt(start);
+  if (event != -1 && event != selectedEvent) {
+    selectedEvent = event;
+    updatePropagationOverlay();
+    if (orderCombo->currentIndex() != 0) {
+      applyOrder();
+    }
+  }
+}
+
+void MainWindow::togglePropagationLines(bool checked) {
+  doShowPropagation = checked;
+  // A running pass publishes the lines when it is in
+  if (checked && !analysisRunning) {
+    analysis->propagation().computeAll();
+    updatePropagationOverlay();
+  }
+  gridWidget->showPropagationLines(checked);
+}
+
+void MainWindow::toggleSpreadLines(bool checked) {
+  doShowSpread = checked;
+  if (checked && !analysisRunning) {
+    analysis->propagation().computeAll();
+    updatePropagationOverlay();
+  }
+  gridWidget->showSpreadLines(checked);
+}
+
+void MainWindow::updatePropagationOverlay() {
+  QVector<QLineF> arrows;
+  QPolygonF spread;
+  PropagationEngine &propagation = analysis->propagation();
+  if (selectedEvent >= 0 &&
+      selectedEvent < static_cast<int>(propagation.recordingEvents().size())) {
+    // Only the selected event is computed if the cache does not have it yet
+    const Propagation &result = propagation.propagation(selectedEvent);
+    for (const GridVector &vector : result.vectors) {
+      QPointF start(vector.col + 0.5, vector.row + 0.5);
+      arrows.append(QLineF(start, start + QPointF(vector.dCol, vector.dRow)));
+    }
+    for (const auto &point : result.spread) {
+      spread << QPointF(point.second + 0.5, point.first + 0.5);
+    }
+  }
+  gridWidget->setPropagationLines(arrows);
+  gridWidget->setSpreadLines(spread);
+}
+
+void MainWindow::plotChannels() {
+  graphWidget->setSamplingRate(samplingRate);
+  std::shared_ptr<const std::vector<ChannelData>> channels =
+      analysis->channelsSnapshot();
+
+  // Loads still running for the previous selection are stale
+  plotToken.cancel();
+  plotToken = CancelToken::create();
+  CancelToken token = plotToken;
+  double rate = samplingRate;
+
+  for (size_t i = 0; i < PLOT_COUNT && i < plotChannelIds.size(); ++i) {
+    int channel = plotChannelIds[i];
+
+    // The conversion runs on the pool; only the plot update is left for
+    // the GUI thread
+    tasks.submit(
+        TaskPriority::Visible,
+        [this, channels, channel, rate, i, token]() {
+          ScopedTrace trace("plot load");
+          const std::vector<double> &signal = (*channels)[channel].signal;
+          // Still loading behind a saved analysis
+          if (signal.empty())
+            return;
+
+          // Each point costs its x and y plus a QCPGraphData copy. Traces
+          // that would not fit the plot budget are reduced to bucket
+          // extremes instead.
+          const std::size_t pointBytes =
+              2 * sizeof(double) + sizeof(QCPGraphData);
+          std::size_t budget = memoryBudget(MemorySubsystem::PlotData);
+          std::size_t maxPoints =
+              std::max<std::size_t>(budget / (PLOT_COUNT * pointBytes), 2);
+          QVector<double> xData, yData;
+          if (budget != 0 && signal.size() > maxPoints) {
+            std::size_t stride =
+                (2 * signal.size() + maxPoints - 1) / maxPoints;
+            reduceTrace(signal, rate, stride, xData, yData);
+          } else {
+            // Create x-axis data (time in seconds, the unit of detected
+            // regions)
+            xData.resize(static_cast<int>(signal.size()));
+            for (int j = 0; j < xData.size(); ++j) {
+              xData[j] = static_cast<double>(j) / rate;
+            }
+            if (token.cancelled())
+              return;
+            yData = QVector<double>(signal.begin(), signal.end());
+          }
+
+          QMetaObject::invokeMethod(
+              this,
+              [this, xData, yData, channel, i, token]() {
+                if (token.cancelled())
+                  return;
+                graphWidget->simplePlot(xData, yData, static_cast<int>(i));
+                setMemoryUsage(MemorySubsystem::PlotData,
+                               graphWidget->plotDataBytes());
+                // Otherwise the regions are published with the pass
+                if (analysisRunning)
+                  return;
+                const std::vector<ChannelEvents> &events = analysis->events();
+                if (static_cast<size_t>(channel) < events.size()) {
+                  graphWidget->setRegions(static_cast<int>(i),
+                                          events[channel].seizures,
+                                          events[channel].se);
+                }
+              },
+              Qt::QueuedConnection);
+        },
+        token);
+  }
+}
+
+void MainWindow::selectCell(int row, int col) {
+  if (analysisRunning) {
+    statusBar()->showMessage("The analysis is still running");
+    return;
+  }
+  const std::vector<ChannelData> &channels = analysis->channels();
+  for (size_t c = 0; c < channels.size(); ++c) {
+    const std::vector<int> &name = channels[c].name;
+    if (name.size() < 2 || name[0] - 1 != row || name[1] - 1 != col)
+      continue;
+    // The clicked channel goes to the top of the stack
+    std::vector<int> ids = plotChannelIds;
+    ids.erase(std::remove(ids.begin(), ids.end(), static_cast<int>(c)),
+              ids.end());
+    ids.insert(ids.begin(), static_cast<int>(c));
+    if (ids.size() > PLOT_COUNT) {
+      ids.resize(PLOT_COUNT);
+    }
+    if (ids != plotChannelIds) {
+      plotChannelIds = ids;
+      plotChannels();
+    }
+    return;
+  }
+}
+
+void MainWindow::applyOrder() {
+  // Applied again when the running pass publishes its events
+  if (analysisRunning)
+    return;
+  std::vector<int> ids;
+  QVector<QString> labels;
+  int mode = orderCombo->currentIndex();
+  if (mode != 0 && selectedEvent != -1) {
+    const ChannelOrder &order = analysis->ordering().order(
+        selectedEvent, mode == 1 ? OrderMode::Seizure : OrderMode::SE,
+        orderAmount);
+    ids.assign(order.channels.begin(),
+               order.channels.begin() +
+                   std::min<size_t>(PLOT_COUNT, order.channels.size()));
+
+    if (showOrderCheckbox->isChecked()) {
+      labels.resize(GRID_SIZE * GRID_SIZE);
+      for (size_t i = 0; i < order.channels.size(); ++i) {
+        const std::vector<int> &name =
+            analysis->channels()[order.channels[i]].name;
+        if (name.size() < 2)
+          continue;
+        int row = name[0] - 1, col = name[1] - 1;
+        if (row >= 0 && row < GRID_SIZE && col >= 0 && col < GRID_SIZE) {
+          labels[row * GRID_SIZE + col] = QString::number(i + 1);
+        }
+      }
+    }
+  }
+  gridWidget->setCellLabels(labels);
+
+  // Fill the rest of the stack in channel order
+  int channelCount = static_cast<int>(analysis->channels().size());
+  for (int c = 0; ids.size() < PLOT_COUNT && c < channelCount; ++c) {
+    if (std::find(ids.begin(), ids.end(), c) == ids.end()) {
+      ids.push_back(c);
+    }
+  }
+  if (ids != plotChannelIds) {
+    plotChannelIds = ids;
+    plotChannels();
+  }
+}
+
+void MainWindow::setOrderAmount() {
+  bool ok = false;
+  int amount = QInputDialog::getInt(this, "Order Amount",
+                                    "Channels to order:", orderAmount, 1,
+                                    GRID_SIZE * GRID_SIZE, 1, &ok);
+  if (ok) {
+    orderAmount = amount;
+    applyOrder();
+  }
+}
+
+void MainWindow::resampleRecording() {
+  QString sourcePath = QFileDialog::getOpenFileName(
+      this, "Resample Recording", QDir::homePath(), "BRW files (*.brw)");
+  if (sourcePath.isEmpty())
+    return;
+
+  bool ok = false;
+  double targetRate = QInputDialog::getDouble(
+      this, "Resample Recording", "Target sampling rate (Hz):", 100.0, 1.0,
+      100000.0, 2, &ok);
+  if (!ok)
+    return;
+
+  QMessageBox::StandardButton choice = QMessageBox::question(
+      this, "Resample Recording",
+      "Save the resampled recording as a new BRW file?\n"
+      "Choose No to load it as an in-memory analysis copy instead.",
+      QMessageBox::Yes | QMessageBox::No | QMessageBox::Cancel);
+  if (choice == QMessageBox::Cancel)
+    return;
+
+  QString targetPath;
+  if (choice == QMessageBox::Yes) {
+    QFileInfo sourceInfo(sourcePath);
+    QString suggestedPath = sourceInfo.absolutePath() + "/" +
+                            sourceInfo.completeBaseName() +
+                            QString("_resample_%1.brw").arg(targetRate);
+    targetPath = QFileDialog::getSaveFileName(
+        this, "Save Resampled Recording", suggestedPath, "BRW files (*.brw)");
+    if (targetPath.isEmpty())
+      return;
+  }
+  statusBar()->showMessage("Resampling " + sourcePath);
+  ReferenceSettings referenceSettings = reference;
+  QualitySettings qualityThresholds = qualitySettings;
+
+  tasks.submit(
+      TaskPriority::Batch,
+      [this, sourcePath, targetPath, targetRate, referenceSettings,
+       qualityThresholds]() {
+        ScopedTrace trace("resample");
+        auto loaded = std::make_shared<LoadedRecording>();
+        std::shared_ptr<FrameReader> frames;
+        try {
+          if (!targetPath.isEmpty()) {
+            std::lock_guard<std::mutex> lock(hdf5Mutex);
+            loaded->rate =
+                writeResampledBrw(sourcePath.toStdString(),
+                                  targetPath.toStdString(), targetRate);
+          } else {
+            // Through a frame reader, so the file is locked a block at a
+            // time and the reader goes on to serve grid playback
+            frames = std::make_shared<FrameReader>(sourcePath.toStdString(),
+                                                   hdf5Mutex);
+            loaded->rate = loadResampled(*frames, referenceSettings,
+                                         qualityThresholds, targetRate,
+                                         loaded->channels, loaded->quality);
+          }
+        } catch (const H5::Exception &e) {
+          loaded->errorTitle = "HDF5 Error";
+          loaded->error = QString::fromStdString(e.getDetailMsg());
+        } catch (const std::exception &e) {
+          loaded->errorTitle = "Error";
+          loaded->error = QString("Failed to resample: %1").arg(e.what());
+        }
+
+        QMetaObject::invokeMethod(
+            this,
+            [this, loaded, frames, targetPath]() {
+              statusBar()->clearMessage();
+              if (!loaded->error.isEmpty()) {
+                QMessageBox::critical(this, loaded->errorTitle,
+                                      loaded->error);
+                return;
+              }
+              if (!targetPath.isEmpty()) {
+                QMessageBox::information(this, "Resample Recording",
+                                         QString("Wrote %1 at %2 Hz")
+                                             .arg(targetPath)
+                                             .arg(loaded->rate));
+                return;
+              }
+              // Replaces whatever a running load would have shown, and is
+              // not cached since it has no file of its own. The grid still
+              // plays the source at its full rate.
+              loadToken.cancel();
+              cachePath.clear();
+              setFrameSource(frames);
+              loadChannels(std::move(loaded->channels), loaded->rate,
+                           std::move(loaded->quality));
+            },
+            Qt::QueuedConnection);
+      });
+}
+
+void MainWindow::editLowPassFilter() {
+  QDialog dialog(this);
+  dialog.setWindowTitle("Low Pass Filter");
+  QFormLayout *form = new QFormLayout(&dialog);
+
+  QCheckBox *enabledBox = new QCheckBox();
+  enabledBox->setChecked(lowPass.enabled);
+  form->addRow("Enabled:", enabledBox);
+
+  QDoubleSpinBox *cutoffBox = new QDoubleSpinBox();
+  cutoffBox->setRange(0.1, samplingRate > 0
+                               ? MAX_CUTOFF_FRACTION * samplingRate
+                               : 50000.0);
+  cutoffBox->setSuffix(" Hz");
+  cutoffBox->setValue(lowPass.cutoffHz);
+  form->addRow("Cutoff:", cutoffBox);
+
+  QSpinBox *orderBox = new QSpinBox();
+  orderBox->setRange(1, 10);
+  orderBox->setValue(lowPass.order);
+  form->addRow("Order:", orderBox);
+
+  QCheckBox *zeroPhaseBox = new QCheckBox("Forward-backward");
+  zeroPhaseBox->setChecked(lowPass.zeroPhase);
+  form->addRow("Zero phase:", zeroPhaseBox);
+
+  QDialogButtonBox *buttons =
+      new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
+  connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+  connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+  form->addRow(buttons);
+
+  if (dialog.exec() == QDialog::Accepted) {
+    lowPass.enabled = enabledBox->isChecked();
+    lowPass.cutoffHz = cutoffBox->value();
+    lowPass.order = orderBox->value();
+    lowPass.zeroPhase = zeroPhaseBox->isChecked();
+    refreshAnalysis();
+  }
+}
+
+void MainWindow::editReference() {
+  QDialog dialog(this);
+  dialog.setWindowTitle("Re-Reference");
+  QFormLayout *form = new QFormLayout(&dialog);
+
+  QComboBox *modeCombo = new QComboBox();
+  modeCombo->addItems({"None", "Common average", "Common median"});
+  modeCombo->setCurrentIndex(static_cast<int>(reference.mode));
+  form->addRow("Reference:", modeCombo);
+
+  QCheckBox *blankBox = new QCheckBox();
+  blankBox->setChecked(reference.blankArtifacts);
+  form->addRow("Blank artifacts:", blankBox);
+
+  QDoubleSpinBox *thresholdBox = new QDoubleSpinBox();
+  thresholdBox->setRange(0.001, 100.0);
+  thresholdBox->setDecimals(3);
+  thresholdBox->setSuffix(" mV");
+  thresholdBox->setValue(reference.artifactThresholdMv);
+  form->addRow("Artifact threshold:", thresholdBox);
+
+  QDoubleSpinBox *paddingBox = new QDoubleSpinBox();
+  paddingBox->setRange(0.0, 10.0);
+  paddingBox->setDecimals(3);
+  paddingBox->setSuffix(" s");
+  paddingBox->setValue(reference.artifactPaddingSeconds);
+  form->addRow("Artifact padding:", paddingBox);
+
+  QDialogButtonBox *buttons =
+      new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
+  connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+  connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+  form->addRow(buttons);
+
+  if (dialog.exec() == QDialog::Accepted) {
+    reference.mode = static_cast<ReferenceMode>(modeCombo->currentIndex());
+    reference.blankArtifacts = blankBox->isChecked();
+    reference.artifactThresholdMv = thresholdBox->value();
+    reference.artifactPaddingSeconds = paddingBox->value();
+  }
+}
+
+void MainWindow::editChannelQuality() {
+  QDialog dialog(this);
+  dialog.setWindowTitle("Channel Quality");
+  QFormLayout *form = new QFormLayout(&dialog);
+
+  const std::vector<char> &mask = analysis->mask();
+  int masked = static_cast<int>(std::count(mask.begin(), mask.end(), 0));
+  form->addRow(new QLabel(QString("%1 of %2 channels masked")
+                              .arg(masked)
+                              .arg(mask.size())));
+
+  QCheckBox *enabledBox = new QCheckBox();
+  enabledBox->setChecked(qualitySettings.enabled);
+  form->addRow("Mask bad channels:", enabledBox);
+
+  QDoubleSpinBox *saturationBox = new QDoubleSpinBox();
+  saturationBox->setRange(0.0, 100.0);
+  saturationBox->setSuffix(" %");
+  saturationBox->setValue(qualitySettings.maxSaturationFraction * 100.0);
+  form->addRow("Max saturated:", saturationBox);
+
+  QDoubleSpinBox *flatBox = new QDoubleSpinBox();
+  flatBox->setRange(0.001, 3600.0);
+  flatBox->setDecimals(3);
+  flatBox->setSuffix(" s");
+  flatBox->setValue(qualitySettings.maxFlatSeconds);
+  form->addRow("Max flat line:", flatBox);
+
+  QDoubleSpinBox *noiseBox = new QDoubleSpinBox();
+  noiseBox->setRange(1.0, 1000.0);
+  noiseBox->setSuffix(" x median");
+  noiseBox->setValue(qualitySettings.maxNoiseRatio);
+  form->addRow("Max noise:", noiseBox);
+
+  QDoubleSpinBox *lineBox = new QDoubleSpinBox();
+  lineBox->setRange(0.0, 100.0);
+  lineBox->setSuffix(" %");
+  lineBox->setValue(qualitySettings.maxLineNoiseFraction * 100.0);
+  form->addRow("Max 50/60 Hz power:", lineBox);
+
+  QDialogButtonBox *buttons =
+      new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
+  connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+  connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+  form->addRow(buttons);
+
+  if (dialog.exec() == QDialog::Accepted) {
+    qualitySettings.enabled = enabledBox->isChecked();
+    qualitySettings.maxSaturationFraction = saturationBox->value() / 100.0;
+    qualitySettings.maxFlatSeconds = flatBox->value();
+    qualitySettings.maxNoiseRatio = noiseBox->value();
+    qualitySettings.maxLineNoiseFraction = lineBox->value() / 100.0;
+    // The statistics are kept, so new thresholds only reclassify
+    refreshAnalysis();
+  }
+}
+
+void MainWindow::editEnvelope() {
+  QDialog dialog(this);
+  dialog.setWindowTitle("Envelope");
+  QFormLayout *form = new QFormLayout(&dialog);
+
+  QCheckBox *enabledBox = new QCheckBox();
+  enabledBox->setChecked(envelope.enabled);
+  form->addRow("Enabled:", enabledBox);
+
+  QComboBox *modeCombo = new QComboBox();
+  modeCombo->addItems({"RMS", "Line length", "Hilbert"});
+  modeCombo->setCurrentIndex(static_cast<int>(envelope.mode));
+  form->addRow("Mode:", modeCombo);
+
+  QDoubleSpinBox *windowBox = new QDoubleSpinBox();
+  windowBox->setRange(1.0, 60000.0);
+  windowBox->setSuffix(" ms");
+  windowBox->setValue(envelope.windowSeconds * 1000.0);
+  form->addRow("Window:", windowBox);
+
+  QDialogButtonBox *buttons =
+      new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
+  connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+  connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+  form->addRow(buttons);
+
+  if (dialog.exec() == QDialog::Accepted) {
+    envelope.enabled = enabledBox->isChecked();
+    envelope.mode = static_cast<EnvelopeMode>(modeCombo->currentIndex());
+    envelope.windowSeconds = windowBox->value() / 1000.0;
+    refreshAnalysis();
+  }
+}
+
+void MainWindow::editSpikeSettings() {
+  QDialog dialog(this);
+  dialog.setWindowTitle("Raster Settings");
+  QFormLayout *form = new QFormLayout(&dialog);
+
+  QDoubleSpinBox *thresholdBox = new QDoubleSpinBox();
+  thresholdBox->setRange(1.0, 100.0);
+  thresholdBox->setSuffix(" x noise");
+  thresholdBox->setValue(spikeSettings.thresholdSigmas);
+  form->addRow("Threshold:", thresholdBox);
+
+  QDoubleSpinBox *refractoryBox = new QDoubleSpinBox();
+  refractoryBox->setRange(0.0, 1000.0);
+  refractoryBox->setSuffix(" ms");
+  refractoryBox->setValue(spikeSettings.refractorySeconds * 1000.0);
+  form->addRow("Refractory period:", refractoryBox);
+
+  QCheckBox *polarityBox = new QCheckBox("Positive and negative");
+  polarityBox->setChecked(spikeSettings.bothPolarities);
+  form->addRow("Crossings:", polarityBox);
+
+  QDialogButtonBox *buttons =
+      new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
+  connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+  connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+  form->addRow(buttons);
+
+  if (dialog.exec() == QDialog::Accepted) {
+    spikeSettings.thresholdSigmas = thresholdBox->value();
+    spikeSettings.refractorySeconds = refractoryBox->value() / 1000.0;
+    spikeSettings.bothPolarities = polarityBox->isChecked();
+    refreshAnalysis();
+  }
+}
+
+void MainWindow::createRaster() {
+  if (analysis->empty()) {
+    QMessageBox::information(this, "Create Raster",
+                             "Run an analysis before creating a raster.");
+    return;
+  }
+
+  // The spike stage joins the graph from now on
+  rasterCreated = true;
+  refreshAnalysis();
+}
+
+void MainWindow::updateRaster() {
+  std::shared_ptr<const SpikeIndex> spikes = analysis->spikes();
+  rasterVersion = analysis->spikesVersion();
+
+  // Until groups are defined, colour channels by band of electrode rows
+  const std::vector<ChannelData> &channels = analysis->channels();
+  std::vector<int> groups(channels.size());
+  for (size_t c = 0; c < channels.size(); ++c) {
+    groups[c] = channels[c].name.empty() ? 0 : channels[c].name[0] / 8;
+  }
+  rasterPlot->setSpikes(spikes);
+  rasterPlot->setChannelGroups(std::move(groups));
+  secondPlotWidget->xAxis->rescale();
+  secondPlotWidget->yAxis->rescale();
+  updateRates();
+}
+
+void MainWindow::setRasterDownsample() {
+  bool ok = false;
+  int factor = QInputDialog::getInt(
+      this, "Raster Downsample Factor", "Pixel columns per bin:",
+      rasterPlot->columnsPerBin(), 1, 64, 1, &ok);
+  if (ok) {
+    rasterPlot->setColumnsPerBin(factor);
+    secondPlotWidget->replot();
+  }
+}
+
+void MainWindow::toggleRasterColorMode() {
+  rasterPlot->setColorByGroup(!rasterPlot->colorByGroup());
+  secondPlotWidget->replot();
+}
+
+void MainWindow::showBinSizeSlider() {
+  if (!binSizeDialog) {
+    binSizeDialog = new QDialog(this);
+    binSizeDialog->setWindowTitle("Bin Size");
+    QFormLayout *form = new QFormLayout(binSizeDialog);
+
+    // Logarithmic, from 1 ms to 10 s
+    QSlider *slider = new QSlider(Qt::Horizontal);
+    slider->setRange(0, 400);
+    slider->setValue(static_cast<int>(
+        std::lround(100 * std::log10(rateBinSeconds * 1000.0))));
+    binSizeLabel = new QLabel();
+    form->addRow("Bin size:", slider);
+    form->addRow("", binSizeLabel);
+
+    auto apply = [this](int value) {
+      rateBinSeconds = std::pow(10.0, value / 100.0) / 1000.0;
+      binSizeLabel->setText(
+          QString("%1 ms").arg(rateBinSeconds * 1000.0, 0, 'g', 3));
+      updateRates();
+    };
+    connect(slider, &QSlider::valueChanged, this, apply);
+    apply(slider->value());
+  }
+  binSizeDialog->show();
+  binSizeDialog->raise();
+  binSizeDialog->activateWindow();
+}
+
+void MainWindow::updateRates() {
+  if (!rasterCreated || analysisRunning)
+    return;
+  std::shared_ptr<const SpikeIndex> spikes = analysis->spikes();
+  if (spikes->empty())
+    return;
+
+  // Every bin is two lookups in the cumulative counts, so this is cheap
+  // enough to run on every slider step and range change. Wide views are
+  // binned more coarsely so the bins still cover the whole range.
+  QCPRange range = secondPlotWidget->xAxis->range();
+  double bin = std::max(rateBinSeconds, range.size() / MAX_RATE_BINS);
+  if (binSizeLabel) {
+    QString text = QString("%1 ms").arg(rateBinSeconds * 1000.0, 0, 'g', 3);
+    if (bin > rateBinSeconds) {
+      text += QString(" (%1 ms at this zoom)").arg(bin * 1000.0, 0, 'g', 3);
+    }
+    binSizeLabel->setText(text);
+  }
+  double start = std::floor(range.lower / bin) * bin;
+  int bins = std::min(
+      MAX_RATE_BINS + 1,
+      static_cast<int>(std::ceil((range.upper - start) / bin)));
+  std::vector<double> rates;
+  spikes->populationRate(start, bin, std::max(bins, 0), rates);
+  QVector<double> keys(rates.size() + 1), values(rates.size() + 1);
+  double peak = 0;
+  for (size_t b = 0; b < rates.size(); ++b) {
+    keys[b] = start + b * bin;
+    values[b] = rates[b];
+    peak = std::max(peak, rates[b]);
+  }
+  keys.back() = start + rates.size() * bin;
+  values.back() = rates.empty() ? 0 : rates.back();
+  populationRateGraph->setData(keys, values, true);
+  rateAxisRect->axis(QCPAxis::atLeft)->setRange(0, peak > 0 ? peak * 1.1 : 1);
+
+  // Colour each electrode by its rate over the bin under the playhead,
+  // unless the grid is showing the raw signal
+  if (frameReader && gridShowsSignal) {
+    secondPlotWidget->replot(QCustomPlot::rpQueuedReplot);
+    return;
+  }
+  double playhead = playbackRate > 0 ? progressBar->value() / playbackRate : 0;
+  double binStart = std::floor(playhead / rateBinSeconds) * rateBinSeconds;
+  spikes->channelRates(binStart, binStart + rateBinSeconds, rates);
+  double peakRate = rates.empty() ? 0 : *std::max_element(rates.begin(),
+                                                          rates.end());
+  QVector<qreal> strengths(GRID_SIZE * GRID_SIZE, 0.0);
+  const std::vector<ChannelData> &channels = analysis->channels();
+  for (size_t c = 0; c < rates.size() && c < channels.size(); ++c) {
+    const std::vector<int> &name = channels[c].name;
+    if (name.size() < 2 || peakRate <= 0)
+      continue;
+    int row = name[0] - 1, col = name[1] - 1;
+    if (row >= 0 && row < GRID_SIZE && col >= 0 && col < GRID_SIZE) {
+      strengths[row * GRID_SIZE + col] = rates[c] / peakRate;
+    }
+  }
+  gridWidget->setCellValues(strengths, Qt::red);
+
+  secondPlotWidget->replot(QCustomPlot::rpQueuedReplot);
+}
+
+void MainWindow::editDetection() {
+  QDialog dialog(this);
+  dialog.setWindowTitle("Detection");
+  QFormLayout *form = new QFormLayout(&dialog);
+
+  auto addSeconds = [form](const QString &label, double value, double max) {
+    QDoubleSpinBox *box = new QDoubleSpinBox();
+    box->setRange(0.01, max);
+    box->setSuffix(" s");
+    box->setValue(value);
+    form->addRow(label, box);
+    return box;
+  };
+  QDoubleSpinBox *windowBox =
+      addSeconds("Window:", detection.windowSeconds, 600.0);
+  QDoubleSpinBox *stepBox = addSeconds("Step:", detection.stepSeconds, 600.0);
+
+  QDoubleSpinBox *ratioBox = new QDoubleSpinBox();
+  ratioBox->setRange(1.0, 1000.0);
+  ratioBox->setSuffix(" x median");
+  ratioBox->setValue(detection.thresholdRatio);
+  form->addRow("Threshold:", ratioBox);
+
+  QDoubleSpinBox *gapBox =
+      addSeconds("Merge gap:", detection.mergeGapSeconds, 3600.0);
+  QDoubleSpinBox *seizureBox =
+      addSeconds("Min seizure:", detection.seizureMinSeconds, 3600.0);
+  QDoubleSpinBox *seBox = addSeconds("Min SE:", detection.seMinSeconds, 36000.0);
+
+  QDialogButtonBox *buttons =
+      new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
+  connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+  connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+  form->addRow(buttons);
+
+  if (dialog.exec() == QDialog::Accepted) {
+    detection.windowSeconds = windowBox->value();
+    detection.stepSeconds = stepBox->value();
+    detection.thresholdRatio = ratioBox->value();
+    detection.mergeGapSeconds = gapBox->value();
+    detection.seizureMinSeconds = seizureBox->value();
+    detection.seMinSeconds = seBox->value();
+    refreshAnalysis();
+  }
+}
+
+void MainWindow::editMemoryBudgets() {
+  QDialog dialog(this);
+  dialog.setWindowTitle("Memory Budgets");
+  QFormLayout *form = new QFormLayout(&dialog);
+  form->addRow(new QLabel("Zero means no limit."));
+
+  MemoryBudgets budgets = memoryBudgets();
+  QSpinBox *boxes[MEMORY_SUBSYSTEM_COUNT];
+  for (int i = 0; i < MEMORY_SUBSYSTEM_COUNT; ++i) {
+    MemorySubsystem subsystem = static_cast<MemorySubsystem>(i);
+    boxes[i] = new QSpinBox();
+    boxes[i]->setRange(0, 1024 * 1024);
+    boxes[i]->setSuffix(" MB");
+    boxes[i]->setValue(static_cast<int>(budgets[subsystem] / MB));
+    form->addRow(QString(memorySubsystemName(subsystem)) + ":", boxes[i]);
+  }
+
+  QDialogButtonBox *buttons =
+      new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
+  connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+  connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+  form->addRow(buttons);
+
+  if (dialog.exec() == QDialog::Accepted) {
+    for (int i = 0; i < MEMORY_SUBSYSTEM_COUNT; ++i) {
+      budgets.bytes[i] = static_cast<std::size_t>(boxes[i]->value()) * MB;
+    }
+    setMemoryBudgets(budgets);
+    updateMemoryUsage();
   }
 }
 
 void stressTest(GridWidget *gridWidget) { gridWidget->startAnimation(); }
 
+void MainWindow::saveTrace() {
+  QString path = QFileDialog::getSaveFileName(
+      this, "Save Performance Trace", QDir::homePath() + "/mea_trace.json",
+      "Chrome trace (*.json)");
+  if (path.isEmpty())
+    return;
+  try {
+    writeChromeTrace(path.toStdString());
+  } catch (const std::exception &e) {
+    QMessageBox::critical(this, "Error", e.what());
+  }
+}
+
 void MainWindow::createMenuBar() {
   QMenuBar *menuBar = new QMenuBar(this);
   setMenuBar(menuBar);
@@ -293,28 +1734,104 @@ void MainWindow::createMenuBar() {
   stressTestAction->connect(stressTestAction, &QAction::triggered,
                             [this]() { stressTest(gridWidget); });
   fileMenu->addAction(stressTestAction);
+  fileMenu->addSeparator();
+  QAction *recordTraceAction =
+      fileMenu->addAction("Record performance trace");
+  recordTraceAction->setCheckable(true);
+  connect(recordTraceAction, &QAction::toggled, this, [](bool checked) {
+    if (checked) {
+      clearTrace();
+    }
+    setTraceRecording(checked);
+  });
+  QAction *saveTraceAction =
+      fileMenu->addAction("Save performance trace...");
+  connect(saveTraceAction, &QAction::triggered, this,
+          &MainWindow::saveTrace);
 
   QMenu *editMenu = menuBar->addMenu("Edit");
-  editMenu->addAction("Set Low Pass Filter");
-  editMenu->addAction("Set raster downsample factor");
-  editMenu->addAction("Create raster");
+  QAction *lowPassAction = editMenu->addAction("Set Low Pass Filter");
+  connect(lowPassAction, &QAction::triggered, this,
+          &MainWindow::editLowPassFilter);
+  QAction *referenceAction = editMenu->addAction("Set Re-Reference");
+  connect(referenceAction, &QAction::triggered, this,
+          &MainWindow::editReference);
+  QAction *qualityAction = editMenu->addAction("Set Channel Quality");
+  connect(qualityAction, &QAction::triggered, this,
+          &MainWindow::editChannelQuality);
+  QAction *envelopeAction = editMenu->addAction("Set Envelope");
+  connect(envelopeAction, &QAction::triggered, this,
+          &MainWindow::editEnvelope);
+  QAction *detectionAction = editMenu->addAction("Set Detection Thresholds");
+  connect(detectionAction, &QAction::triggered, this,
+          &MainWindow::editDetection);
+  QAction *playbackAction = editMenu->addAction("Set Grid Playback");
+  connect(playbackAction, &QAction::triggered, this,
+          &MainWindow::editPlayback);
+  QAction *memoryBudgetAction = editMenu->addAction("Set Memory Budgets");
+  connect(memoryBudgetAction, &QAction::triggered, this,
+          &MainWindow::editMemoryBudgets);
+  QAction *resampleAction = editMenu->addAction("Resample recording...");
+  connect(resampleAction, &QAction::triggered, this,
+          &MainWindow::resampleRecording);
+  QAction *rasterDownsampleAction =
+      editMenu->addAction("Set raster downsample factor");
+  connect(rasterDownsampleAction, &QAction::triggered, this,
+          &MainWindow::setRasterDownsample);
+  QAction *rasterAction = editMenu->addAction("Create raster");
+  connect(rasterAction, &QAction::triggered, this, &MainWindow::createRaster);
   editMenu->addSeparator();
 
   QMenu *viewMenu = menuBar->addMenu("View");
   viewMenu->addAction("Legend")->setCheckable(true);
-  viewMenu->addAction("Mini-map")->setCheckable(true);
-  viewMenu->addAction("Playheads")->setCheckable(true);
+  QAction *miniMapAction = viewMenu->addAction("Mini-map");
+  miniMapAction->setCheckable(true);
+  miniMapAction->setChecked(true);
+  connect(miniMapAction, &QAction::toggled, graphWidget,
+          &GraphWidget::toggleMiniMap);
+  QAction *playheadAction = viewMenu->addAction("Playheads");
+  playheadAction->setCheckable(true);
+  connect(playheadAction, &QAction::toggled, graphWidget,
+          &GraphWidget::toggleRedLines);
   viewMenu->addAction("Anti-aliasing")->setCheckable(true);
-  viewMenu->addAction("Spread lines")->setCheckable(true);
-  viewMenu->addAction("Propagation lines")->setCheckable(true);
+  QAction *spreadAction = viewMenu->addAction("Spread lines");
+  spreadAction->setCheckable(true);
+  connect(spreadAction, &QAction::toggled, this,
+          &MainWindow::toggleSpreadLines);
+  QAction *propagationAction = viewMenu->addAction("Propagation lines");
+  propagationAction->setCheckable(true);
+  connect(propagationAction, &QAction::toggled, this,
+          &MainWindow::togglePropagationLines);
+  QAction *signalGridAction = viewMenu->addAction("Signal activity on grid");
+  signalGridAction->setCheckable(true);
+  signalGridAction->setChecked(gridShowsSignal);
+  connect(signalGridAction, &QAction::toggled, this, [this](bool checked) {
+    gridShowsSignal = checked;
+    updateGridFrame();
+    updateRates();
+  });
   viewMenu->addAction("Detected events")->setCheckable(true);
   viewMenu->addAction("False color map")->setCheckable(true);
   viewMenu->addSeparator();
   viewMenu->addAction("Seizure regions")->setCheckable(true);
-  viewMenu->addAction("Spectrograms")->setCheckable(true);
+  QAction *spectrogramAction = viewMenu->addAction("Spectrograms");
+  spectrogramAction->setCheckable(true);
+  connect(spectrogramAction, &QAction::toggled, graphWidget,
+          &GraphWidget::toggleSpectrograms);
+  QAction *overlayAction = viewMenu->addAction("Performance overlay");
+  overlayAction->setCheckable(true);
+  connect(overlayAction, &QAction::toggled, perfOverlay,
+          &PerfOverlay::setVisible);
+  QAction *memoryAction = viewMenu->addAction("Memory diagnostics");
+  connect(memoryAction, &QAction::triggered, this,
+          &MainWindow::showMemoryDiagnostics);
   viewMenu->addSeparator();
-  viewMenu->addAction("Set bin size");
-  viewMenu->addAction("Set order amount");
+  QAction *binSizeAction = viewMenu->addAction("Set bin size");
+  connect(binSizeAction, &QAction::triggered, this,
+          &MainWindow::showBinSizeSlider);
+  QAction *orderAmountAction = viewMenu->addAction("Set order amount");
+  connect(orderAmountAction, &QAction::triggered, this,
+          &MainWindow::setOrderAmount);
 }
 
 void MainWindow::createCentralWidget() {
@@ -334,8 +1851,10 @@ void MainWindow::createCentralWidget() {
   QWidget *meaGridWidget = new QWidget();
   QVBoxLayout *meaGridLayout = new QVBoxLayout(meaGridWidget);
 
-  gridWidget = new GridWidget(64, 64);
+  gridWidget = new GridWidget(GRID_SIZE, GRID_SIZE);
   gridWidget->setMinimumHeight(gridWidget->height() + 100);
+  connect(gridWidget, &GridWidget::cell_clicked, this,
+          &MainWindow::selectCell);
 
   QWidget *squareWidget = new QWidget();
   QVBoxLayout *squareLayout = new QVBoxLayout(squareWidget);
@@ -364,6 +1883,31 @@ void MainWindow::createCentralWidget() {
 
   secondPlotWidget = new QCustomPlot();
   rasterPlotLayout->addWidget(secondPlotWidget);
+  secondPlotWidget->setInteractions(QCP::iRangeDrag | QCP::iRangeZoom);
+  secondPlotWidget->xAxis->setLabel("Time (s)");
+  secondPlotWidget->yAxis->setLabel("Channel");
+  rasterPlot = new RasterPlot(secondPlotWidget->xAxis, secondPlotWidget->yAxis);
+
+  // Population rate histogram under the raster, sharing its time axis
+  rateAxisRect = new QCPAxisRect(secondPlotWidget);
+  secondPlotWidget->plotLayout()->addElement(1, 0, rateAxisRect);
+  secondPlotWidget->plotLayout()->setRowStretchFactor(1, 0.3);
+  QCPMarginGroup *rasterMargins = new QCPMarginGroup(secondPlotWidget);
+  secondPlotWidget->axisRect()->setMarginGroup(QCP::msLeft | QCP::msRight,
+                                               rasterMargins);
+  rateAxisRect->setMarginGroup(QCP::msLeft | QCP::msRight, rasterMargins);
+  rateAxisRect->axis(QCPAxis::atLeft)->setLabel("Rate (Hz)");
+  populationRateGraph =
+      secondPlotWidget->addGraph(rateAxisRect->axis(QCPAxis::atBottom),
+                                 rateAxisRect->axis(QCPAxis::atLeft));
+  populationRateGraph->setLineStyle(QCPGraph::lsStepLeft);
+  populationRateGraph->setBrush(QColor(0, 0, 0, 60));
+  connect(secondPlotWidget->xAxis,
+          QOverload<const QCPRange &>::of(&QCPAxis::rangeChanged), this,
+          [this](const QCPRange &range) {
+            rateAxisRect->axis(QCPAxis::atBottom)->setRange(range);
+            updateRates();
+          });
 
   QHBoxLayout *rasterSettingsLayout = new QHBoxLayout();
   rasterSettingsLayout->addWidget(new QLabel("Raster Settings:"));
@@ -371,12 +1915,16 @@ void MainWindow::createCentralWidget() {
   QPushButton *editRasterSettingsButton =
       new QPushButton("Edit Raster Settings");
   rasterSettingsLayout->addWidget(editRasterSettingsButton);
+  connect(editRasterSettingsButton, &QPushButton::clicked, this,
+          &MainWindow::editSpikeSettings);
 
   QPushButton *createGroupsButton = new QPushButton("Create Groups");
   rasterSettingsLayout->addWidget(createGroupsButton);
 
   QPushButton *toggleColorModeButton = new QPushButton("Toggle Color Mode");
   rasterSettingsLayout->addWidget(toggleColorModeButton);
+  connect(toggleColorModeButton, &QPushButton::clicked, this,
+          &MainWindow::toggleRasterColorMode);
 
   rasterPlotLayout->addLayout(rasterSettingsLayout);
 
@@ -386,6 +1934,46 @@ void MainWindow::createCentralWidget() {
 
   // Stats tab
   QWidget *statsTab = new QWidget();
+  QVBoxLayout *statsLayout = new QVBoxLayout(statsTab);
+  QHBoxLayout *connectivityControls = new QHBoxLayout();
+  connectivityControls->addWidget(new QLabel("Connectivity window (s):"));
+  connectivityStartBox = new QDoubleSpinBox();
+  connectivityStartBox->setRange(0.0, 1e6);
+  connectivityStartBox->setDecimals(3);
+  connectivityControls->addWidget(connectivityStartBox);
+  connectivityStopBox = new QDoubleSpinBox();
+  connectivityStopBox->setRange(0.0, 1e6);
+  connectivityStopBox->setDecimals(3);
+  connectivityStopBox->setValue(10.0);
+  connectivityControls->addWidget(connectivityStopBox);
+  connectivityControls->addWidget(new QLabel("Max lag (ms):"));
+  connectivityLagBox = new QSpinBox();
+  connectivityLagBox->setRange(0, 1000);
+  connectivityControls->addWidget(connectivityLagBox);
+  QPushButton *connectivityButton = new QPushButton("Compute Connectivity");
+  connectivityControls->addWidget(connectivityButton);
+  connect(connectivityButton, &QPushButton::clicked, this,
+          &MainWindow::computeConnectivity);
+  connectivityStatus = new QLabel();
+  connectivityControls->addWidget(connectivityStatus);
+  connectivityControls->addStretch();
+  statsLayout->addLayout(connectivityControls);
+
+  connectivityPlot = new QCustomPlot();
+  connectivityPlot->setInteractions(QCP::iRangeDrag | QCP::iRangeZoom);
+  connectivityPlot->xAxis->setLabel("Channel");
+  connectivityPlot->yAxis->setLabel("Channel");
+  connectivityPlot->yAxis->setRangeReversed(true);
+  connectivityMap =
+      new QCPColorMap(connectivityPlot->xAxis, connectivityPlot->yAxis);
+  connectivityMap->setGradient(QCPColorGradient::gpPolar);
+  connectivityMap->setDataRange(QCPRange(-1.0, 1.0));
+  connectivityMap->setInterpolate(false);
+  QCPColorScale *connectivityScale = new QCPColorScale(connectivityPlot);
+  connectivityPlot->plotLayout()->addElement(0, 1, connectivityScale);
+  connectivityScale->axis()->setLabel("Correlation");
+  connectivityMap->setColorScale(connectivityScale);
+  statsLayout->addWidget(connectivityPlot);
 
   mainTabWidget->addTab(mainTab, "Main");
   mainTabWidget->addTab(statsTab, "Stats");
@@ -406,6 +1994,8 @@ void MainWindow::createRightPane() {
   QVBoxLayout *graphLayout = new QVBoxLayout(graphPane);
   graphLayout->setContentsMargins(0, 0, 0, 0);
   graphWidget = new GraphWidget(this);
+  connect(graphWidget, &GraphWidget::regionClicked, this,
+          [this](double start, double, int) { selectEvent(start); });
   graphLayout->addWidget(graphWidget);
   splitter->addWidget(graphPane);
 
@@ -427,6 +2017,10 @@ void MainWindow::createRightPane() {
   orderCombo = new QComboBox();
   orderCombo->addItems({"Default", "Order by Seizure", "Order by SE"});
   settingsTopLayout->addWidget(orderCombo);
+  connect(showOrderCheckbox, &QCheckBox::toggled, this,
+          &MainWindow::applyOrder);
+  connect(orderCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
+          this, &MainWindow::applyOrder);
   QHBoxLayout *controlLayout = new QHBoxLayout();
   settingsLayout->addLayout(controlLayout);
   openButton = new QPushButton(" Open File");
@@ -466,6 +2060,12 @@ void MainWindow::createBottomPane() {
   progressBar = new QSlider(
       Qt::Horizontal); // Replace with EEGScrubberWidget when implemented
   playbackLayout->addWidget(progressBar, 1);
+  connect(progressBar, &QSlider::valueChanged, this, &MainWindow::updateRates);
+  connect(progressBar, &QSlider::valueChanged, this, [this](int value) {
+    graphWidget->updateRedLines(value, playbackRate);
+  });
+  connect(progressBar, &QSlider::valueChanged, this,
+          &MainWindow::updateGridFrame);
 
   skipBackwardButton = new QPushButton("");
   playbackLayout->addWidget(skipBackwardButton);
@@ -490,6 +2090,24 @@ void MainWindow::createBottomPane() {
   playbackLayout->addWidget(speedCombo);
 
   playbackTimer = new QTimer(this);
+  connect(playbackTimer, &QTimer::timeout, this,
+          [this]() { stepPlayhead(playbackStep()); });
+  connect(playPauseButton, &QPushButton::clicked, this,
+          &MainWindow::togglePlayback);
+  // Frame buttons move by one metric window, skips by a second
+  connect(prevFrameButton, &QPushButton::clicked, this, [this]() {
+    stepPlayhead(-std::max(1LL, std::llround(playbackSettings.windowSeconds *
+                                             playbackRate)));
+  });
+  connect(nextFrameButton, &QPushButton::clicked, this, [this]() {
+    stepPlayhead(std::max(1LL, std::llround(playbackSettings.windowSeconds *
+                                            playbackRate)));
+  });
+  connect(skipBackwardButton, &QPushButton::clicked, this, [this]() {
+    stepPlayhead(-std::llround(playbackRate));
+  });
+  connect(skipForwardButton, &QPushButton::clicked, this,
+          [this]() { stepPlayhead(std::llround(playbackRate)); });
 
   // Add bottom pane to right pane layout
   QWidget *mainTab = mainTabWidget->widget(0);
@@ -1,14 +1,33 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include "analysis.h"
+#include "brwreader.h"
+#include "channelquality.h"
+#include "connectivity.h"
+#include "detector.h"
+#include "envelope.h"
+#include "filterbank.h"
+#include "framereader.h"
 #include "graphwidget.h"
 #include "gridwidget.h"
+#include "ordering.h"
+#include "perfoverlay.h"
+#include "propagation.h"
+#include "rereference.h"
+#include "rasterplot.h"
+#include "spikeindex.h"
+#include "taskpool.h"
 #include <QCheckBox>
 #include <QComboBox>
+#include <QDoubleSpinBox>
+#include <QLabel>
 #include <QMainWindow>
 #include <QPushButton>
 #include <QSlider>
+#include <QSpinBox>
 #include <QTabWidget>
+#include <QTableWidget>
 #include <QTimer>
 #include <qcustomplot.h>
 
@@ -17,6 +36,7 @@ class MainWindow : public QMainWindow {
 
 public:
   MainWindow(QWidget *parent = nullptr);
+  ~MainWindow() override;
 
 private:
   void createMenuBar();
@@ -24,6 +44,52 @@ private:
   void createRightPane();
   void createBottomPane();
   void testGraph();
+  void editLowPassFilter();
+  void editReference();
+  void editChannelQuality();
+  void editEnvelope();
+  void editDetection();
+  void editSpikeSettings();
+  void createRaster();
+  void setRasterDownsample();
+  void toggleRasterColorMode();
+  void showBinSizeSlider();
+  void updateRates();
+  void resampleRecording();
+  // cached, when given, is restored into the analysis for the new source
+  void loadChannels(std::vector<ChannelData> channelDataList, double rate,
+                    std::vector<ChannelQuality> channelQuality,
+                    const AnalysisResults *cached = nullptr);
+  void showCachedAnalysis(const AnalysisResults &cached);
+  void saveAnalysisCache();
+  void setFrameSource(std::shared_ptr<FrameReader> frames);
+  // Frames the playhead advances per timer tick at the selected speed
+  long long playbackStep() const;
+  void togglePlayback();
+  void stepPlayhead(long long frames);
+  void updateGridFrame();
+  void editPlayback();
+  // Brings the analysis up to date on the pool and publishes it to the
+  // views when it is done
+  void refreshAnalysis();
+  void publishAnalysis(const QString &error, const QString &spikeError);
+  void updateMaskedCells();
+  void publishEvents();
+  void updateRaster();
+  void selectEvent(double start);
+  void togglePropagationLines(bool checked);
+  void toggleSpreadLines(bool checked);
+  void updatePropagationOverlay();
+  void plotChannels();
+  void selectCell(int row, int col);
+  void applyOrder();
+  void setOrderAmount();
+  void computeConnectivity();
+  void saveTrace();
+  void editMemoryBudgets();
+  void showMemoryDiagnostics();
+  // Refreshes the ledger and evicts or shrinks whatever is over budget
+  void updateMemoryUsage();
 
   QTabWidget *mainTabWidget;
   QTabWidget *tabWidget;
@@ -48,6 +114,67 @@ private:
   GridWidget *gridWidget;
   GraphWidget *graphWidget;
   QCustomPlot *secondPlotWidget;
+  RasterPlot *rasterPlot;
+  QCPAxisRect *rateAxisRect;
+  QCPGraph *populationRateGraph;
+  QDialog *binSizeDialog = nullptr;
+  QLabel *binSizeLabel = nullptr;
+  double rateBinSeconds = 0.1;
+  LowPassSettings lowPass;
+  ReferenceSettings reference;
+  EnvelopeSettings envelope;
+  double samplingRate = 0.0;
+  QualitySettings qualitySettings;
+  DetectionSettings detection;
+  SpikeSettings spikeSettings;
+  // Replaced for every recording, so a pass still running on the previous
+  // one keeps its own graph
+  std::shared_ptr<AnalysisGraph> analysis = std::make_shared<AnalysisGraph>();
+  CancelToken analysisToken;
+  // Set while a pass owns the graph; the views leave it alone until then
+  bool analysisRunning = false;
+  // Settings changed during that pass
+  bool analysisPending = false;
+  CancelToken connectivityToken;
+  // Every task that uses the window, waited for when it closes
+  TaskGroup tasks;
+  CancelToken loadToken;
+  CancelToken plotToken;
+  // Sidecar the analysis is saved to; empty while there is nothing to save
+  std::string cachePath;
+  uint64_t cacheKey = 0;
+  uint64_t cachedEventsVersion = 0;
+  uint64_t cachedSpikesVersion = 0;
+  // Raw frames of the open recording, for grid playback
+  std::shared_ptr<FrameReader> frameReader;
+  PlaybackSettings playbackSettings;
+  // Playhead units per second
+  double playbackRate = 0.0;
+  bool gridShowsSignal = true;
+  CancelToken gridToken;
+  // Output versions the views last showed
+  uint64_t plottedVersion = 0;
+  uint64_t publishedVersion = 0;
+  uint64_t rasterVersion = 0;
+  bool rasterCreated = false;
+  int selectedEvent = -1;
+  bool doShowPropagation = false;
+  bool doShowSpread = false;
+  int orderAmount = 64;
+  // Channel shown in each plot of the stack
+  std::vector<int> plotChannelIds;
+  ConnectivityEngine connectivity;
+  std::vector<char> connectivityMask;
+  QCustomPlot *connectivityPlot;
+  QCPColorMap *connectivityMap;
+  QDoubleSpinBox *connectivityStartBox;
+  QDoubleSpinBox *connectivityStopBox;
+  QSpinBox *connectivityLagBox;
+  QLabel *connectivityStatus;
+  PerfOverlay *perfOverlay;
+  QTimer *memoryTimer;
+  QDialog *memoryDialog = nullptr;
+  QTableWidget *memoryTable = nullptr;
 };
 
 #endif // MAINWINDOW_H
@@ -8,9 +8,56 @@ SOURCES += main.cpp \
            gridwidget.cpp \
            colorcell.cpp \
            qcustomplot.cpp \
-           graphwidget.cpp
+           graphwidget.cpp \
+           regionindex.cpp \
+           regionoverlay.cpp \
+           brwreader.cpp \
+           filterbank.cpp \
+           resampler.cpp \
+           fft.cpp \
+           spectrogram.cpp \
+           envelope.cpp \
+           detector.cpp \
+           spikeindex.cpp \
+           rasterplot.cpp \
+           propagation.cpp \
+           ordering.cpp \
+           connectivity.cpp \
+           rereference.cpp \
+           channelquality.cpp \
+           analysis.cpp \
+           taskpool.cpp \
+           trace.cpp \
+           perfoverlay.cpp \
+           memoryledger.cpp \
+           analysiscache.cpp \
+           framereader.cpp
 HEADERS += mainwindow.h \
            gridwidget.h \
            colorcell.h \
            qcustomplot.h \
-           graphwidget.h
+           graphwidget.h \
+           regionindex.h \
+           regionoverlay.h \
+           brwreader.h \
+           filterbank.h \
+           resampler.h \
+           parallel.h \
+           fft.h \
+           spectrogram.h \
+           envelope.h \
+           detector.h \
+           spikeindex.h \
+           rasterplot.h \
+           propagation.h \
+           ordering.h \
+           connectivity.h \
+           rereference.h \
+           channelquality.h \
+           analysis.h \
+           taskpool.h \
+           trace.h \
+           perfoverlay.h \
+           memoryledger.h \
+           analysiscache.h \
+           framereader.h
@@ -0,0 +1,99 @@
+#include "memoryledger.h"
+#include <atomic>
+#include <unistd.h>
+
+namespace {
+std::atomic<std::size_t> usage[MEMORY_SUBSYSTEM_COUNT];
+std::atomic<std::size_t> peak[MEMORY_SUBSYSTEM_COUNT];
+std::atomic<std::size_t> budget[MEMORY_SUBSYSTEM_COUNT];
+
+const std::size_t MB = 1024 * 1024;
+
+void notePeak(int index, std::size_t bytes) {
+  std::size_t seen = peak[index].load(std::memory_order_relaxed);
+  while (bytes > seen &&
+         !peak[index].compare_exchange_weak(seen, bytes,
+                                            std::memory_order_relaxed)) {
+  }
+}
+}
+
+const char *memorySubsystemName(MemorySubsystem subsystem) {
+  switch (subsystem) {
+  case MemorySubsystem::RawBuffers:
+    return "Raw buffers";
+  case MemorySubsystem::Channels:
+    return "Channel signals";
+  case MemorySubsystem::Analysis:
+    return "Analysis";
+  case MemorySubsystem::PlotData:
+    return "Plot data";
+  case MemorySubsystem::Pixmaps:
+    return "Pixmaps";
+  case MemorySubsystem::Caches:
+    return "Caches";
+  }
+  return "";
+}
+
+MemoryBudgets defaultMemoryBudgets() {
+  long pages = sysconf(_SC_PHYS_PAGES);
+  long pageSize = sysconf(_SC_PAGE_SIZE);
+  std::size_t physical = pages > 0 && pageSize > 0
+                             ? static_cast<std::size_t>(pages) * pageSize
+                             : 8192 * MB;
+  MemoryBudgets budgets;
+  budgets[MemorySubsystem::RawBuffers] = 256 * MB;
+  budgets[MemorySubsystem::Channels] = physical / 2;
+  budgets[MemorySubsystem::Analysis] = physical / 5;
+  budgets[MemorySubsystem::PlotData] = 1024 * MB;
+  budgets[MemorySubsystem::Pixmaps] = 256 * MB;
+  budgets[MemorySubsystem::Caches] = 512 * MB;
+  return budgets;
+}
+
+void setMemoryUsage(MemorySubsystem subsystem, std::size_t bytes) {
+  int index = static_cast<int>(subsystem);
+  usage[index].store(bytes, std::memory_order_relaxed);
+  notePeak(index, bytes);
+}
+
+void chargeMemory(MemorySubsystem subsystem, std::ptrdiff_t bytes) {
+  int index = static_cast<int>(subsystem);
+  std::size_t now =
+      usage[index].fetch_add(static_cast<std::size_t>(bytes),
+                             std::memory_order_relaxed) +
+      static_cast<std::size_t>(bytes);
+  notePeak(index, now);
+}
+
+std::size_t memoryUsage(MemorySubsystem subsystem) {
+  return usage[static_cast<int>(subsystem)].load(std::memory_order_relaxed);
+}
+
+std::size_t memoryPeak(MemorySubsystem subsystem) {
+  return peak[static_cast<int>(subsystem)].load(std::memory_order_relaxed);
+}
+
+void setMemoryBudgets(const MemoryBudgets &budgets) {
+  for (int i = 0; i < MEMORY_SUBSYSTEM_COUNT; ++i) {
+    budget[i].store(budgets.bytes[i], std::memory_order_relaxed);
+  }
+}
+
+MemoryBudgets memoryBudgets() {
+  MemoryBudgets budgets;
+  for (int i = 0; i < MEMORY_SUBSYSTEM_COUNT; ++i) {
+    budgets.bytes[i] = budget[i].load(std::memory_order_relaxed);
+  }
+  return budgets;
+}
+
+std::size_t memoryBudget(MemorySubsystem subsystem) {
+  return budget[static_cast<int>(subsystem)].load(std::memory_order_relaxed);
+}
+
+bool overMemoryBudget(MemorySubsystem subsystem, std::size_t bytes) {
+  std::size_t limit = memoryBudget(subsystem);
+  return limit != 0 && memoryUsage(subsystem) + bytes > limit;
+}
@@ -0,0 +1,72 @@
+#ifndef MEMORYLEDGER_H
+#define MEMORYLEDGER_H
+
+#include <cstddef>
+#include <cstdint>
+
+enum class MemorySubsystem {
+  // Loader block buffers
+  RawBuffers,
+  // Per-channel signals: the source and its filtered copy
+  Channels,
+  // Envelopes, features and spike lists
+  Analysis,
+  // Plot traces and their QCPGraphDataContainers
+  PlotData,
+  // Plot paint buffers and Qt's pixmap cache
+  Pixmaps,
+  // Connectivity matrices and spectrogram tiles
+  Caches
+};
+const int MEMORY_SUBSYSTEM_COUNT = 6;
+
+const char *memorySubsystemName(MemorySubsystem subsystem);
+
+// Bytes per subsystem; zero means no limit
+struct MemoryBudgets {
+  std::size_t bytes[MEMORY_SUBSYSTEM_COUNT] = {};
+
+  std::size_t &operator[](MemorySubsystem subsystem) {
+    return bytes[static_cast<int>(subsystem)];
+  }
+  std::size_t operator[](MemorySubsystem subsystem) const {
+    return bytes[static_cast<int>(subsystem)];
+  }
+};
+
+// Budgets sized from the machine's physical memory
+MemoryBudgets defaultMemoryBudgets();
+
+// Process-wide counters. Owners either set their subsystem's total whenever
+// it changes, or charge and release scoped amounts; both may be used from
+// any thread.
+void setMemoryUsage(MemorySubsystem subsystem, std::size_t bytes);
+void chargeMemory(MemorySubsystem subsystem, std::ptrdiff_t bytes);
+std::size_t memoryUsage(MemorySubsystem subsystem);
+std::size_t memoryPeak(MemorySubsystem subsystem);
+
+void setMemoryBudgets(const MemoryBudgets &budgets);
+MemoryBudgets memoryBudgets();
+std::size_t memoryBudget(MemorySubsystem subsystem);
+// Whether adding bytes to the subsystem would take it over its budget
+bool overMemoryBudget(MemorySubsystem subsystem, std::size_t bytes = 0);
+
+// Charges bytes to a subsystem for its own lifetime
+class MemoryCharge {
+public:
+  MemoryCharge(MemorySubsystem subsystem, std::size_t bytes)
+      : subsystem(subsystem), bytes(bytes) {
+    chargeMemory(subsystem, static_cast<std::ptrdiff_t>(bytes));
+  }
+  ~MemoryCharge() {
+    chargeMemory(subsystem, -static_cast<std::ptrdiff_t>(bytes));
+  }
+  MemoryCharge(const MemoryCharge &) = delete;
+  MemoryCharge &operator=(const MemoryCharge &) = delete;
+
+private:
+  MemorySubsystem subsystem;
+  std::size_t bytes;
+};
+
+#endif // MEMORYLEDGER_H
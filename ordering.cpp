@@ -0,0 +1,77 @@
+#include "ordering.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace {
+const std::size_t ORDER_BLOCK_CHANNELS = 256;
+}
+
+void OrderingEngine::setChannels(std::vector<ChannelEvents> events,
+                                 std::vector<RecordingEvent> recording) {
+  channelEvents = std::move(events);
+  this->recording = std::move(recording);
+  cache.clear();
+}
+
+const ChannelOrder &OrderingEngine::order(int event, OrderMode mode,
+                                          int count) {
+  auto key = std::make_tuple(event, mode, count);
+  auto it = cache.find(key);
+  if (it == cache.end()) {
+    ChannelOrder result;
+    if (event >= 0 && event < static_cast<int>(recording.size())) {
+      result = compute(recording[event], mode, count);
+    } else {
+      result.rank.assign(channelEvents.size(), 0);
+    }
+    it = cache.emplace(key, std::move(result)).first;
+  }
+  return it->second;
+}
+
+ChannelOrder OrderingEngine::compute(const RecordingEvent &event,
+                                     OrderMode mode, int count) const {
+  typedef std::pair<double, int> Onset;
+  std::size_t limit = static_cast<std::size_t>(std::max(0, count));
+
+  // Each block keeps only its own earliest channels, so the final sort only
+  // sees blocks * limit candidates.
+  std::size_t blocks = (channelEvents.size() + ORDER_BLOCK_CHANNELS - 1) /
+                       ORDER_BLOCK_CHANNELS;
+  std::vector<std::vector<Onset>> candidates(blocks);
+  parallelFor(blocks, [&](std::size_t block) {
+    std::size_t first = block * ORDER_BLOCK_CHANNELS;
+    std::size_t last =
+        std::min(first + ORDER_BLOCK_CHANNELS, channelEvents.size());
+    std::vector<Onset> &onsets = candidates[block];
+    for (std::size_t c = first; c < last; ++c) {
+      const ChannelEvents &events = channelEvents[c];
+      double onset = earliestOnset(
+          mode == OrderMode::SE ? events.se : events.seizures, event);
+      if (!std::isinf(onset)) {
+        onsets.emplace_back(onset, static_cast<int>(c));
+      }
+    }
+    std::size_t keep = std::min(limit, onsets.size());
+    std::partial_sort(onsets.begin(), onsets.begin() + keep, onsets.end());
+    onsets.resize(keep);
+  });
+
+  std::vector<Onset> merged;
+  for (const auto &onsets : candidates) {
+    merged.insert(merged.end(), onsets.begin(), onsets.end());
+  }
+  std::size_t keep = std::min(limit, merged.size());
+  std::partial_sort(merged.begin(), merged.begin() + keep, merged.end());
+
+  ChannelOrder result;
+  result.rank.assign(channelEvents.size(), 0);
+  result.channels.reserve(keep);
+  for (std::size_t i = 0; i < keep; ++i) {
+    result.channels.push_back(merged[i].second);
+    result.rank[merged[i].second] = static_cast<int>(i + 1);
+  }
+  return result;
+}
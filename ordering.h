@@ -0,0 +1,37 @@
+#ifndef ORDERING_H
+#define ORDERING_H
+
+#include "propagation.h"
+#include <map>
+#include <tuple>
+#include <vector>
+
+enum class OrderMode { Seizure, SE };
+
+struct ChannelOrder {
+  // Channels taking part in the event, earliest onset first
+  std::vector<int> channels;
+  // 1-based position of every channel in channels, 0 when absent
+  std::vector<int> rank;
+};
+
+// Orders channels by their onset in a recording event. Orders are cached
+// per event, mode and length, so switching back and forth is a lookup.
+class OrderingEngine {
+public:
+  void setChannels(std::vector<ChannelEvents> events,
+                   std::vector<RecordingEvent> recording);
+
+  // The count earliest channels of event under mode.
+  const ChannelOrder &order(int event, OrderMode mode, int count);
+
+private:
+  ChannelOrder compute(const RecordingEvent &event, OrderMode mode,
+                       int count) const;
+
+  std::vector<ChannelEvents> channelEvents;
+  std::vector<RecordingEvent> recording;
+  std::map<std::tuple<int, OrderMode, int>, ChannelOrder> cache;
+};
+
+#endif // ORDERING_H
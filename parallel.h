@@ -0,0 +1,16 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "taskpool.h"
+#include <cstddef>
+#include <functional>
+
+// Runs fn(i) for every i in [0, count) on the shared task pool, at the
+// priority of the calling task. Indices are handed out one at a time, so
+// uneven jobs balance themselves.
+template <typename Fn> void parallelFor(std::size_t count, Fn fn) {
+  TaskPool::instance().parallelFor(
+      count, std::function<void(std::size_t)>(std::ref(fn)));
+}
+
+#endif // PARALLEL_H
@@ -0,0 +1,47 @@
+#include "perfoverlay.h"
+#include "trace.h"
+#include <QEvent>
+
+PerfOverlay::PerfOverlay(QWidget *parent) : QLabel(parent) {
+  setAttribute(Qt::WA_TransparentForMouseEvents);
+  setStyleSheet("background-color: rgba(0, 0, 0, 160); color: white;"
+                "padding: 4px; font-family: monospace;");
+  parent->installEventFilter(this);
+  connect(&timer, &QTimer::timeout, this, &PerfOverlay::refresh);
+  timer.setInterval(250);
+  hide();
+}
+
+bool PerfOverlay::eventFilter(QObject *watched, QEvent *event) {
+  if (watched == parentWidget() && event->type() == QEvent::Resize) {
+    place();
+  }
+  return QLabel::eventFilter(watched, event);
+}
+
+void PerfOverlay::showEvent(QShowEvent *event) {
+  setTraceMetrics(true);
+  refresh();
+  timer.start();
+  QLabel::showEvent(event);
+}
+
+void PerfOverlay::hideEvent(QHideEvent *event) {
+  timer.stop();
+  setTraceMetrics(false);
+  QLabel::hideEvent(event);
+}
+
+void PerfOverlay::refresh() {
+  setText(QString("frame  %1 ms\nreplot %2 ms\nload   %3 MB/s")
+              .arg(traceMetric(TraceMetric::FrameMs), 0, 'f', 2)
+              .arg(traceMetric(TraceMetric::ReplotMs), 0, 'f', 2)
+              .arg(traceMetric(TraceMetric::LoadMBps), 0, 'f', 1));
+  place();
+  raise();
+}
+
+void PerfOverlay::place() {
+  adjustSize();
+  move(parentWidget()->width() - width() - 8, 8);
+}
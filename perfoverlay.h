@@ -0,0 +1,28 @@
+#ifndef PERFOVERLAY_H
+#define PERFOVERLAY_H
+
+#include <QLabel>
+#include <QTimer>
+
+// A label pinned to the top-right corner of its parent that shows the trace
+// metrics: grid frame time, replot time and load throughput. Metrics are
+// collected only while it is shown.
+class PerfOverlay : public QLabel {
+  Q_OBJECT
+
+public:
+  explicit PerfOverlay(QWidget *parent);
+
+protected:
+  bool eventFilter(QObject *watched, QEvent *event) override;
+  void showEvent(QShowEvent *event) override;
+  void hideEvent(QHideEvent *event) override;
+
+private:
+  void refresh();
+  void place();
+
+  QTimer timer;
+};
+
+#endif // PERFOVERLAY_H
@@ -0,0 +1,181 @@
+#include "propagation.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+
+namespace {
+const int TILE_ELECTRODES = 8;
+const int SPREAD_STEPS = 8;
+const double VECTOR_LENGTH = TILE_ELECTRODES * 0.4;
+
+struct PlaneFit {
+  double sumRow = 0, sumCol = 0, sumTime = 0;
+  double sumRowRow = 0, sumColCol = 0, sumRowCol = 0;
+  double sumRowTime = 0, sumColTime = 0;
+  int count = 0;
+
+  void add(double row, double col, double time) {
+    sumRow += row;
+    sumCol += col;
+    sumTime += time;
+    sumRowRow += row * row;
+    sumColCol += col * col;
+    sumRowCol += row * col;
+    sumRowTime += row * time;
+    sumColTime += col * time;
+    ++count;
+  }
+
+  // Least-squares gradient (s per electrode) of time = a*row + b*col + c
+  bool gradient(double &a, double &b) const {
+    if (count < 3)
+      return false;
+    double n = count;
+    double rr = sumRowRow - sumRow * sumRow / n;
+    double cc = sumColCol - sumCol * sumCol / n;
+    double rc = sumRowCol - sumRow * sumCol / n;
+    double rt = sumRowTime - sumRow * sumTime / n;
+    double ct = sumColTime - sumCol * sumTime / n;
+    double det = rr * cc - rc * rc;
+    if (std::abs(det) < 1e-9)
+      return false;
+    a = (rt * cc - ct * rc) / det;
+    b = (ct * rr - rt * rc) / det;
+    return a != 0 || b != 0;
+  }
+};
+}
+
+double earliestOnset(const std::vector<Region> &regions,
+                     const RecordingEvent &event) {
+  // The regions' stops are sorted as well, since they do not overlap
+  auto it = std::lower_bound(
+      regions.begin(), regions.end(), event.start,
+      [](const Region &region, double time) { return region.stop < time; });
+  if (it != regions.end() && it->start <= event.stop)
+    return it->start;
+  return std::numeric_limits<double>::infinity();
+}
+
+std::vector<RecordingEvent>
+groupEvents(const std::vector<ChannelEvents> &events) {
+  std::vector<RecordingEvent> all;
+  for (const ChannelEvents &channel : events) {
+    for (const Region &region : channel.seizures) {
+      all.push_back({region.start, region.stop});
+    }
+    for (const Region &region : channel.se) {
+      all.push_back({region.start, region.stop});
+    }
+  }
+  std::sort(all.begin(), all.end(),
+            [](const RecordingEvent &a, const RecordingEvent &b) {
+              return a.start < b.start;
+            });
+
+  std::vector<RecordingEvent> merged;
+  for (const RecordingEvent &event : all) {
+    if (!merged.empty() && event.start <= merged.back().stop) {
+      merged.back().stop = std::max(merged.back().stop, event.stop);
+    } else {
+      merged.push_back(event);
+    }
+  }
+  return merged;
+}
+
+void PropagationEngine::setChannels(
+    std::vector<ChannelEvents> events,
+    std::vector<std::pair<int, int>> positions) {
+  channelEvents = std::move(events);
+  this->positions = std::move(positions);
+  recording = groupEvents(channelEvents);
+  cache.assign(recording.size(), Propagation());
+  cached.assign(recording.size(), 0);
+}
+
+int PropagationEngine::eventAt(double seconds) const {
+  auto it = std::upper_bound(
+      recording.begin(), recording.end(), seconds,
+      [](double time, const RecordingEvent &event) {
+        return time < event.start;
+      });
+  if (it == recording.begin())
+    return -1;
+  --it;
+  return seconds <= it->stop ? static_cast<int>(it - recording.begin()) : -1;
+}
+
+const Propagation &PropagationEngine::propagation(int event) {
+  if (!cached[event]) {
+    cache[event] = compute(recording[event]);
+    cached[event] = 1;
+  }
+  return cache[event];
+}
+
+void PropagationEngine::computeAll() {
+  std::vector<std::size_t> pending;
+  for (std::size_t e = 0; e < recording.size(); ++e) {
+    if (!cached[e]) {
+      pending.push_back(e);
+    }
+  }
+  parallelFor(pending.size(), [&](std::size_t i) {
+    cache[pending[i]] = compute(recording[pending[i]]);
+  });
+  for (std::size_t e : pending) {
+    cached[e] = 1;
+  }
+}
+
+Propagation PropagationEngine::compute(const RecordingEvent &event) const {
+  Propagation result;
+  std::size_t channels = std::min(channelEvents.size(), positions.size());
+  result.onsets.assign(channelEvents.size(),
+                       std::numeric_limits<double>::quiet_NaN());
+
+  std::map<std::pair<int, int>, PlaneFit> tiles;
+  std::vector<std::pair<double, std::size_t>> recruited;
+  for (std::size_t c = 0; c < channels; ++c) {
+    double onset = std::min(earliestOnset(channelEvents[c].seizures, event),
+                            earliestOnset(channelEvents[c].se, event));
+    if (std::isinf(onset))
+      continue;
+
+    result.onsets[c] = onset;
+    recruited.emplace_back(onset, c);
+    int row = positions[c].first, col = positions[c].second;
+    tiles[{row / TILE_ELECTRODES, col / TILE_ELECTRODES}].add(row, col,
+                                                              onset);
+  }
+
+  // Onsets grow along the gradient, so it points the way the event spreads
+  for (const auto &tile : tiles) {
+    const PlaneFit &fit = tile.second;
+    double a, b;
+    if (!fit.gradient(a, b))
+      continue;
+    double norm = std::hypot(a, b);
+    result.vectors.push_back({fit.sumRow / fit.count, fit.sumCol / fit.count,
+                              a / norm * VECTOR_LENGTH,
+                              b / norm * VECTOR_LENGTH});
+  }
+
+  std::sort(recruited.begin(), recruited.end());
+  for (int step = 0; step < SPREAD_STEPS; ++step) {
+    std::size_t first = recruited.size() * step / SPREAD_STEPS;
+    std::size_t last = recruited.size() * (step + 1) / SPREAD_STEPS;
+    if (first == last)
+      continue;
+    double row = 0, col = 0;
+    for (std::size_t i = first; i < last; ++i) {
+      row += positions[recruited[i].second].first;
+      col += positions[recruited[i].second].second;
+    }
+    result.spread.emplace_back(row / (last - first), col / (last - first));
+  }
+  return result;
+}
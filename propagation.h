@@ -0,0 +1,67 @@
+#ifndef PROPAGATION_H
+#define PROPAGATION_H
+
+#include "detector.h"
+#include <utility>
+#include <vector>
+
+// A stretch of the recording during which at least one channel has a
+// seizure or SE region; overlapping channel regions form one event.
+struct RecordingEvent {
+  double start;
+  double stop;
+};
+
+std::vector<RecordingEvent>
+groupEvents(const std::vector<ChannelEvents> &events);
+
+// Earliest start among the sorted, non-overlapping regions that overlap
+// event, or infinity when there is none.
+double earliestOnset(const std::vector<Region> &regions,
+                     const RecordingEvent &event);
+
+// A point on the electrode grid and a displacement from it, in electrodes.
+struct GridVector {
+  double row, col;
+  double dRow, dCol;
+};
+
+struct Propagation {
+  // Onset time (s) of every channel, NaN where the channel has no region
+  // in the event.
+  std::vector<double> onsets;
+  // Direction of spread fitted over each tile of the grid
+  std::vector<GridVector> vectors;
+  // Centroids of successive groups of recruited channels, earliest first
+  std::vector<std::pair<double, double>> spread;
+};
+
+// Onset maps and propagation vectors per recording event. Results are
+// computed on first use and cached, so selecting another event only costs
+// that event.
+class PropagationEngine {
+public:
+  // positions[c] is the zero-based (row, col) of channel c on the grid.
+  void setChannels(std::vector<ChannelEvents> events,
+                   std::vector<std::pair<int, int>> positions);
+
+  const std::vector<RecordingEvent> &recordingEvents() const {
+    return recording;
+  }
+  // Index of the event containing seconds, or -1.
+  int eventAt(double seconds) const;
+  const Propagation &propagation(int event);
+  // Fills the cache for every event, in parallel over events.
+  void computeAll();
+
+private:
+  Propagation compute(const RecordingEvent &event) const;
+
+  std::vector<ChannelEvents> channelEvents;
+  std::vector<std::pair<int, int>> positions;
+  std::vector<RecordingEvent> recording;
+  std::vector<Propagation> cache;
+  std::vector<char> cached;
+};
+
+#endif // PROPAGATION_H
@@ -25,6 +25,14 @@
 
 #include "qcustomplot.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define QCP_SIMD_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#  include <arm_neon.h>
+#  define QCP_SIMD_NEON
+#endif
+
 
 /* including file 'src/vector2d.cpp'       */
 /* modified 2022-11-06T12:45:56, size 7973 */
@@ -21681,6 +21689,114 @@ void QCPGraph::drawImpulsePlot(QCPPainter *painter, const QVector<QPointF> &line
   }
 }
 
+/*! \internal
+
+  Returns the first data point in [\a first, \a last) whose key is not smaller than \a boundary.
+  Since keys are sorted, this is used by \ref getOptimizedLineData instead of testing every point
+  of a pixel interval.
+
+  \a hint is the expected number of points before the boundary. For uniformly sampled
+  (implicit-key) data the previous pixel interval predicts it exactly, so only two keys are
+  compared. Otherwise the search gallops forward from \a first and stays logarithmic in the number
+  of points per pixel.
+*/
+static inline const QCPGraphData *qcpIntervalEnd(const QCPGraphData *first, const QCPGraphData *last, double boundary, std::ptrdiff_t hint)
+{
+  const std::ptrdiff_t available = last-first;
+  if (hint > 0 && hint <= available && first[hint-1].key < boundary && (hint == available || !(first[hint].key < boundary)))
+    return first+hint;
+  if (first == last || !(first->key < boundary))
+    return first;
+  
+  const QCPGraphData *low = first; // known to be before the boundary
+  const QCPGraphData *high = last;
+  std::ptrdiff_t step = qMax(hint, std::ptrdiff_t(1));
+  while (last-low > step)
+  {
+    const QCPGraphData *probe = low+step;
+    if (!(probe->key < boundary))
+    {
+      high = probe;
+      break;
+    }
+    low = probe;
+    step *= 2;
+  }
+  return std::partition_point(low+1, high, [boundary](const QCPGraphData &data) { return data.key < boundary; });
+}
+
+/*! \internal
+
+  Returns via \a minValue and \a maxValue the value range of the non-empty data points [\a first,
+  \a last). Like the scalar tracking in \ref getOptimizedLineData it starts from the first value
+  and ignores NaN values after it.
+
+  QCPGraphData is a plain pair of doubles, so each point is loaded as one 128 bit vector and
+  reduced with SSE2 or NEON where available; only the value lane of the result is used.
+*/
+static inline void qcpValueRange(const QCPGraphData *first, const QCPGraphData *last, double &minValue, double &maxValue)
+{
+  Q_STATIC_ASSERT(sizeof(QCPGraphData) == 2*sizeof(double));
+  minValue = first->value;
+  maxValue = first->value;
+  const QCPGraphData *it = first+1;
+#if defined(QCP_SIMD_SSE2)
+  // _mm_min_pd(a, b) yields b unless a < b, which keeps the accumulator when a is NaN
+  __m128d min0 = _mm_set1_pd(minValue), min1 = min0;
+  __m128d max0 = min0, max1 = min0;
+  for (; last-it >= 4; it += 4)
+  {
+    const __m128d a = _mm_loadu_pd(&it[0].key);
+    const __m128d b = _mm_loadu_pd(&it[1].key);
+    const __m128d c = _mm_loadu_pd(&it[2].key);
+    const __m128d d = _mm_loadu_pd(&it[3].key);
+    min0 = _mm_min_pd(a, min0); max0 = _mm_max_pd(a, max0);
+    min1 = _mm_min_pd(b, min1); max1 = _mm_max_pd(b, max1);
+    min0 = _mm_min_pd(c, min0); max0 = _mm_max_pd(c, max0);
+    min1 = _mm_min_pd(d, min1); max1 = _mm_max_pd(d, max1);
+  }
+  for (; it != last; ++it)
+  {
+    const __m128d a = _mm_loadu_pd(&it->key);
+    min0 = _mm_min_pd(a, min0);
+    max0 = _mm_max_pd(a, max0);
+  }
+  min0 = _mm_min_pd(min1, min0);
+  max0 = _mm_max_pd(max1, max0);
+  minValue = _mm_cvtsd_f64(_mm_unpackhi_pd(min0, min0));
+  maxValue = _mm_cvtsd_f64(_mm_unpackhi_pd(max0, max0));
+#elif defined(QCP_SIMD_NEON)
+  // select on explicit comparisons, since vminq/vminnmq treat NaN differently from the scalar path
+  float64x2_t min0 = vdupq_n_f64(minValue), min1 = min0;
+  float64x2_t max0 = min0, max1 = min0;
+  for (; last-it >= 2; it += 2)
+  {
+    const float64x2_t a = vld1q_f64(&it[0].key);
+    const float64x2_t b = vld1q_f64(&it[1].key);
+    min0 = vbslq_f64(vcltq_f64(a, min0), a, min0); max0 = vbslq_f64(vcgtq_f64(a, max0), a, max0);
+    min1 = vbslq_f64(vcltq_f64(b, min1), b, min1); max1 = vbslq_f64(vcgtq_f64(b, max1), b, max1);
+  }
+  for (; it != last; ++it)
+  {
+    const float64x2_t a = vld1q_f64(&it->key);
+    min0 = vbslq_f64(vcltq_f64(a, min0), a, min0);
+    max0 = vbslq_f64(vcgtq_f64(a, max0), a, max0);
+  }
+  min0 = vbslq_f64(vcltq_f64(min1, min0), min1, min0);
+  max0 = vbslq_f64(vcgtq_f64(max1, max0), max1, max0);
+  minValue = vgetq_lane_f64(min0, 1);
+  maxValue = vgetq_lane_f64(max0, 1);
+#else
+  for (; it != last; ++it)
+  {
+    if (it->value < minValue)
+      minValue = it->value;
+    else if (it->value > maxValue)
+      maxValue = it->value;
+  }
+#endif
+}
+
 /*! \internal
 
   Returns via \a lineData the data points that need to be visualized for this graph when plotting
@@ -21712,59 +21828,44 @@ void QCPGraph::getOptimizedLineData(QVector<QCPGraphData> *lineData, const QCPGr
   
   if (mAdaptiveSampling && dataCount >= maxCount) // use adaptive sampling only if there are at least two points per pixel on average
   {
-    QCPGraphDataContainer::const_iterator it = begin;
-    double minValue = it->value;
-    double maxValue = it->value;
-    QCPGraphDataContainer::const_iterator currentIntervalFirstPoint = it;
+    // the container stores its points contiguously, so each pixel interval is located with
+    // qcpIntervalEnd and reduced with qcpValueRange instead of walking it point by point
+    const QCPGraphData *it = &*begin;
+    const QCPGraphData *last = it+dataCount;
     int reversedFactor = keyAxis->pixelOrientation(); // is used to calculate keyEpsilon pixel into the correct direction
     int reversedRound = reversedFactor==-1 ? 1 : 0; // is used to switch between floor (normal) and ceil (reversed) rounding of currentIntervalStartKey
-    double currentIntervalStartKey = keyAxis->pixelToCoord(int(keyAxis->coordToPixel(begin->key)+reversedRound));
+    double currentIntervalStartKey = keyAxis->pixelToCoord(int(keyAxis->coordToPixel(it->key)+reversedRound));
     double lastIntervalEndKey = currentIntervalStartKey;
     double keyEpsilon = qAbs(currentIntervalStartKey-keyAxis->pixelToCoord(keyAxis->coordToPixel(currentIntervalStartKey)+1.0*reversedFactor)); // interval of one pixel on screen when mapped to plot key coordinates
     bool keyEpsilonVariable = keyAxis->scaleType() == QCPAxis::stLogarithmic; // indicates whether keyEpsilon needs to be updated after every interval (for log axes)
-    int intervalDataCount = 1;
-    ++it; // advance iterator to second data point because adaptive sampling works in 1 point retrospect
-    while (it != end)
+    std::ptrdiff_t intervalHint = 0; // expected number of points after the first one of the next interval
+    lineData->reserve(2*maxCount);
+    while (it != last)
     {
-      if (it->key < currentIntervalStartKey+keyEpsilon) // data point is still within same pixel, so skip it and expand value span of this cluster if necessary
+      const QCPGraphData *intervalEnd = qcpIntervalEnd(it+1, last, currentIntervalStartKey+keyEpsilon, intervalHint);
+      const std::ptrdiff_t intervalDataCount = intervalEnd-it;
+      if (intervalDataCount >= 2) // pixel has multiple data points, consolidate them to a cluster
       {
-        if (it->value < minValue)
-          minValue = it->value;
-        else if (it->value > maxValue)
-          maxValue = it->value;
-        ++intervalDataCount;
-      } else // new pixel interval started
+        double minValue, maxValue;
+        qcpValueRange(it, intervalEnd, minValue, maxValue);
+        if (lastIntervalEndKey < currentIntervalStartKey-keyEpsilon) // last point is further away, so first point of this cluster must be at a real data point
+          lineData->append(QCPGraphData(currentIntervalStartKey+keyEpsilon*0.2, it->value));
+        lineData->append(QCPGraphData(currentIntervalStartKey+keyEpsilon*0.25, minValue));
+        lineData->append(QCPGraphData(currentIntervalStartKey+keyEpsilon*0.75, maxValue));
+        if (intervalEnd != last && intervalEnd->key > currentIntervalStartKey+keyEpsilon*2) // new pixel starts further away from this cluster, so make sure the last point of the cluster is at a real data point
+          lineData->append(QCPGraphData(currentIntervalStartKey+keyEpsilon*0.8, (intervalEnd-1)->value));
+      } else
+        lineData->append(QCPGraphData(it->key, it->value));
+      lastIntervalEndKey = (intervalEnd-1)->key;
+      intervalHint = intervalDataCount-1;
+      it = intervalEnd;
+      if (it != last)
       {
-        if (intervalDataCount >= 2) // last pixel had multiple data points, consolidate them to a cluster
-        {
-          if (lastIntervalEndKey < currentIntervalStartKey-keyEpsilon) // last point is further away, so first point of this cluster must be at a real data point
-            lineData->append(QCPGraphData(currentIntervalStartKey+keyEpsilon*0.2, currentIntervalFirstPoint->value));
-          lineData->append(QCPGraphData(currentIntervalStartKey+keyEpsilon*0.25, minValue));
-          lineData->append(QCPGraphData(currentIntervalStartKey+keyEpsilon*0.75, maxValue));
-          if (it->key > currentIntervalStartKey+keyEpsilon*2) // new pixel started further away from previous cluster, so make sure the last point of the cluster is at a real data point
-            lineData->append(QCPGraphData(currentIntervalStartKey+keyEpsilon*0.8, (it-1)->value));
-        } else
-          lineData->append(QCPGraphData(currentIntervalFirstPoint->key, currentIntervalFirstPoint->value));
-        lastIntervalEndKey = (it-1)->key;
-        minValue = it->value;
-        maxValue = it->value;
-        currentIntervalFirstPoint = it;
         currentIntervalStartKey = keyAxis->pixelToCoord(int(keyAxis->coordToPixel(it->key)+reversedRound));
         if (keyEpsilonVariable)
           keyEpsilon = qAbs(currentIntervalStartKey-keyAxis->pixelToCoord(keyAxis->coordToPixel(currentIntervalStartKey)+1.0*reversedFactor));
-        intervalDataCount = 1;
       }
-      ++it;
     }
-    // handle last interval:
-    if (intervalDataCount >= 2) // last pixel had multiple data points, consolidate them to a cluster
-    {
-      if (lastIntervalEndKey < currentIntervalStartKey-keyEpsilon) // last point wasn't a cluster, so first point of this cluster must be at a real data point
-        lineData->append(QCPGraphData(currentIntervalStartKey+keyEpsilon*0.2, currentIntervalFirstPoint->value));
-      lineData->append(QCPGraphData(currentIntervalStartKey+keyEpsilon*0.25, minValue));
-      lineData->append(QCPGraphData(currentIntervalStartKey+keyEpsilon*0.75, maxValue));
-    } else
-      lineData->append(QCPGraphData(currentIntervalFirstPoint->key, currentIntervalFirstPoint->value));
     
   } else // don't use adaptive sampling algorithm, transfer points one-to-one from the data container into the output
   {
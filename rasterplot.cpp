@@ -0,0 +1,149 @@
+#include "rasterplot.h"
+#include <algorithm>
+#include <cmath>
+
+RasterPlot::RasterPlot(QCPAxis *keyAxis, QCPAxis *valueAxis)
+    : QCPAbstractPlottable(keyAxis, valueAxis), binColumns(1),
+      byGroup(false), bitmapFirstRow(0), bitmapLastRow(-1),
+      bitmapFlipped(false), bitmapDirty(true) {
+  setPen(QPen(Qt::black));
+}
+
+void RasterPlot::setSpikes(std::shared_ptr<const SpikeIndex> index) {
+  spikes = std::move(index);
+  updateColors();
+}
+
+void RasterPlot::setColumnsPerBin(int columns) {
+  binColumns = std::max(1, columns);
+  bitmapDirty = true;
+}
+
+void RasterPlot::setChannelGroups(std::vector<int> groups) {
+  this->groups = std::move(groups);
+  updateColors();
+}
+
+void RasterPlot::setColorByGroup(bool enabled) {
+  byGroup = enabled;
+  updateColors();
+}
+
+void RasterPlot::updateColors() {
+  int channels = spikes ? spikes->channelCount() : 0;
+  colors.assign(channels, mPen.color().rgba());
+  if (byGroup) {
+    for (int c = 0; c < channels && c < static_cast<int>(groups.size());
+         ++c) {
+      // Spread the hues so neighbouring group ids stay distinguishable
+      colors[c] = QColor::fromHsv((groups[c] * 67) % 360, 220, 200).rgba();
+    }
+  }
+  bitmapDirty = true;
+}
+
+double RasterPlot::selectTest(const QPointF & /* pos */,
+                              bool /* onlySelectable */,
+                              QVariant * /* details */) const {
+  return -1;
+}
+
+QCPRange RasterPlot::getKeyRange(bool &foundRange,
+                                 QCP::SignDomain /* inSignDomain */) const {
+  foundRange = spikes && !spikes->empty();
+  if (!foundRange)
+    return QCPRange();
+  return QCPRange(spikes->sampleOffsets().front() / spikes->rate(),
+                  spikes->sampleOffsets().back() / spikes->rate());
+}
+
+QCPRange RasterPlot::getValueRange(bool &foundRange,
+                                   QCP::SignDomain /* inSignDomain */,
+                                   const QCPRange & /* inKeyRange */) const {
+  foundRange = spikes && spikes->channelCount() > 0;
+  if (!foundRange)
+    return QCPRange();
+  return QCPRange(-0.5, spikes->channelCount() - 0.5);
+}
+
+void RasterPlot::draw(QCPPainter *painter) {
+  QCPAxis *keyAxis = mKeyAxis.data();
+  QCPAxis *valueAxis = mValueAxis.data();
+  if (!keyAxis || !valueAxis || !spikes || spikes->empty())
+    return;
+
+  QCPRange keys = keyAxis->range();
+  QCPRange values = valueAxis->range();
+  int firstRow = std::max(0, static_cast<int>(std::ceil(values.lower - 0.5)));
+  int lastRow = std::min(spikes->channelCount() - 1,
+                         static_cast<int>(std::floor(values.upper + 0.5)));
+  if (firstRow > lastRow)
+    return;
+
+  QRectF target(QPointF(keyAxis->coordToPixel(keys.lower),
+                        valueAxis->coordToPixel(firstRow - 0.5)),
+                QPointF(keyAxis->coordToPixel(keys.upper),
+                        valueAxis->coordToPixel(lastRow + 0.5)));
+  // Image rows run top to bottom, which is the reverse of a normal value axis
+  bool flipped = target.top() > target.bottom();
+  target = target.normalized();
+
+  // Several channels share a pixel row once there are more rows than pixels
+  int columns = std::max(1, static_cast<int>(target.width()) / binColumns);
+  int rows = std::max(1, std::min(lastRow - firstRow + 1,
+                                  static_cast<int>(target.height())));
+  if (bitmapDirty || bitmap.width() != columns || bitmap.height() != rows ||
+      bitmapKeys != keys || bitmapFirstRow != firstRow ||
+      bitmapLastRow != lastRow || bitmapFlipped != flipped) {
+    renderBitmap(keys, firstRow, lastRow, columns, rows, flipped);
+  }
+
+  painter->save();
+  painter->setRenderHint(QPainter::SmoothPixmapTransform, false);
+  painter->drawImage(target, bitmap);
+  painter->restore();
+}
+
+void RasterPlot::renderBitmap(const QCPRange &keys, int firstRow, int lastRow,
+                              int columns, int rows, bool flipped) {
+  bitmap = QImage(columns, rows, QImage::Format_ARGB32_Premultiplied);
+  bitmap.fill(Qt::transparent);
+  bitmapKeys = keys;
+  bitmapFirstRow = firstRow;
+  bitmapLastRow = lastRow;
+  bitmapFlipped = flipped;
+  bitmapDirty = false;
+
+  double rate = spikes->rate();
+  double firstSample = std::max(0.0, keys.lower * rate);
+  double lastSample = std::max(0.0, keys.upper * rate);
+  if (lastSample <= firstSample)
+    return;
+
+  double columnScale = columns / (lastSample - firstSample);
+  double rowScale = static_cast<double>(rows) / (lastRow - firstRow + 1);
+  uint32_t first = static_cast<uint32_t>(
+      std::min(firstSample, static_cast<double>(UINT32_MAX)));
+  uint32_t last = static_cast<uint32_t>(
+      std::min(std::ceil(lastSample), static_cast<double>(UINT32_MAX)));
+
+  uchar *bits = bitmap.bits();
+  const auto stride = bitmap.bytesPerLine();
+  spikes->forEachInRange(first, last, [&](uint16_t channel, uint32_t sample) {
+    if (channel < firstRow || channel > lastRow)
+      return;
+    int column = std::min(
+        columns - 1, static_cast<int>((sample - firstSample) * columnScale));
+    int row = static_cast<int>((channel - firstRow) * rowScale);
+    if (flipped) {
+      row = rows - 1 - row;
+    }
+    reinterpret_cast<QRgb *>(bits + row * stride)[column] = colors[channel];
+  });
+}
+
+void RasterPlot::drawLegendIcon(QCPPainter *painter, const QRectF &rect) const {
+  painter->setPen(Qt::NoPen);
+  painter->setBrush(mPen.color());
+  painter->drawRect(rect.adjusted(rect.width() / 3, 0, -rect.width() / 3, 0));
+}
@@ -0,0 +1,59 @@
+#ifndef RASTERPLOT_H
+#define RASTERPLOT_H
+
+#include "spikeindex.h"
+#include <QImage>
+#include <memory>
+#include <qcustomplot.h>
+#include <vector>
+
+// Plots a SpikeIndex with time on the key axis and channel on the value
+// axis. Instead of one scatter point per spike, the spikes in view are
+// binned into an ARGB32 image with one pixel per (row, pixel column),
+// transparent when empty and the channel's colour when occupied, which is
+// drawn in one call. The image is only rebuilt when the view or the
+// settings change.
+class RasterPlot : public QCPAbstractPlottable {
+public:
+  RasterPlot(QCPAxis *keyAxis, QCPAxis *valueAxis);
+
+  void setSpikes(std::shared_ptr<const SpikeIndex> index);
+  // Pixel columns merged into one bin; coarser bins are cheaper to draw.
+  void setColumnsPerBin(int columns);
+  int columnsPerBin() const { return binColumns; }
+  void setChannelGroups(std::vector<int> groups);
+  void setColorByGroup(bool enabled);
+  bool colorByGroup() const { return byGroup; }
+
+  double selectTest(const QPointF &pos, bool onlySelectable,
+                    QVariant *details = nullptr) const override;
+  QCPRange getKeyRange(bool &foundRange,
+                       QCP::SignDomain inSignDomain = QCP::sdBoth) const override;
+  QCPRange getValueRange(bool &foundRange,
+                         QCP::SignDomain inSignDomain = QCP::sdBoth,
+                         const QCPRange &inKeyRange = QCPRange()) const override;
+
+protected:
+  void draw(QCPPainter *painter) override;
+  void drawLegendIcon(QCPPainter *painter, const QRectF &rect) const override;
+
+private:
+  void updateColors();
+  void renderBitmap(const QCPRange &keys, int firstRow, int lastRow,
+                    int columns, int rows, bool flipped);
+
+  std::shared_ptr<const SpikeIndex> spikes;
+  int binColumns;
+  std::vector<int> groups;
+  bool byGroup;
+  std::vector<QRgb> colors;
+
+  QImage bitmap;
+  QCPRange bitmapKeys;
+  int bitmapFirstRow;
+  int bitmapLastRow;
+  bool bitmapFlipped;
+  bool bitmapDirty;
+};
+
+#endif // RASTERPLOT_H
@@ -0,0 +1,39 @@
+#include "regionindex.h"
+#include <algorithm>
+#include <utility>
+
+RegionIndex::RegionIndex(std::vector<Region> regions)
+    : regions(std::move(regions)) {
+  std::sort(this->regions.begin(), this->regions.end(),
+            [](const Region &a, const Region &b) { return a.start < b.start; });
+
+  maxStop.reserve(this->regions.size());
+  for (const Region &region : this->regions) {
+    maxStop.push_back(maxStop.empty() ? region.stop
+                                      : std::max(maxStop.back(), region.stop));
+  }
+}
+
+bool RegionIndex::overlaps(double lower, double upper) const {
+  bool found = false;
+  std::size_t end = firstStartingAfter(upper);
+  for (std::size_t i = firstCandidate(lower); i < end && !found; ++i) {
+    found = regions[i].stop >= lower;
+  }
+  return found;
+}
+
+std::size_t RegionIndex::firstCandidate(double lower) const {
+  // Everything before this index ends before lower
+  return std::lower_bound(maxStop.begin(), maxStop.end(), lower) -
+         maxStop.begin();
+}
+
+std::size_t RegionIndex::firstStartingAfter(double upper) const {
+  return std::upper_bound(
+             regions.begin(), regions.end(), upper,
+             [](double value, const Region &region) {
+               return value < region.start;
+             }) -
+         regions.begin();
+}
@@ -0,0 +1,45 @@
+#ifndef REGIONINDEX_H
+#define REGIONINDEX_H
+
+#include <cstddef>
+#include <vector>
+
+struct Region {
+  double start;
+  double stop;
+};
+
+// Regions of one channel sorted by start time. A running maximum of the stop
+// times lets range queries binary search even when regions overlap.
+class RegionIndex {
+public:
+  RegionIndex() = default;
+  explicit RegionIndex(std::vector<Region> regions);
+
+  bool empty() const { return regions.empty(); }
+  std::size_t size() const { return regions.size(); }
+  const std::vector<Region> &all() const { return regions; }
+
+  bool overlaps(double lower, double upper) const;
+
+  // Calls fn(region) for every region intersecting [lower, upper], in order
+  // of start time.
+  template <typename Fn>
+  void forEachOverlapping(double lower, double upper, Fn fn) const {
+    std::size_t end = firstStartingAfter(upper);
+    for (std::size_t i = firstCandidate(lower); i < end; ++i) {
+      if (regions[i].stop >= lower) {
+        fn(regions[i]);
+      }
+    }
+  }
+
+private:
+  std::size_t firstCandidate(double lower) const;
+  std::size_t firstStartingAfter(double upper) const;
+
+  std::vector<Region> regions;
+  std::vector<double> maxStop;
+};
+
+#endif // REGIONINDEX_H
@@ -0,0 +1,64 @@
+#include "regionoverlay.h"
+#include <algorithm>
+
+RegionOverlay::RegionOverlay(QCPAxisRect *axisRect)
+    : QCPLayerable(axisRect->parentPlot()), axisRect(axisRect),
+      seizureBrush(QColor(0, 150, 199, 128)),
+      seBrush(QColor(255, 183, 3, 128)) {}
+
+void RegionOverlay::setRegions(RegionIndex seizures, RegionIndex se) {
+  this->seizures = std::move(seizures);
+  this->se = std::move(se);
+}
+
+QRect RegionOverlay::clipRect() const { return axisRect->rect(); }
+
+void RegionOverlay::applyDefaultAntialiasingHint(QCPPainter *painter) const {
+  applyAntialiasingHint(painter, mAntialiased, QCP::aeOther);
+}
+
+void RegionOverlay::draw(QCPPainter *painter) {
+  painter->setPen(Qt::NoPen);
+  drawRegions(painter, se, seBrush);
+  drawRegions(painter, seizures, seizureBrush);
+}
+
+void RegionOverlay::drawRegions(QCPPainter *painter, const RegionIndex &index,
+                                const QBrush &brush) {
+  if (index.empty())
+    return;
+
+  QCPAxis *xAxis = axisRect->axis(QCPAxis::atBottom);
+  QCPRange range = xAxis->range();
+  QRect rect = axisRect->rect();
+  painter->setBrush(brush);
+
+  bool pending = false;
+  double left = 0, right = 0;
+  auto flush = [&]() {
+    painter->drawRect(QRectF(QPointF(left, rect.top()),
+                             QPointF(right, rect.bottom() + 1)));
+  };
+
+  index.forEachOverlapping(range.lower, range.upper, [&](const Region &region) {
+    double x1 = xAxis->coordToPixel(region.start);
+    double x2 = xAxis->coordToPixel(region.stop);
+    if (x1 > x2)
+      std::swap(x1, x2);
+    x1 = std::max(x1, static_cast<double>(rect.left()) - 1);
+    x2 = std::min(x2, static_cast<double>(rect.right()) + 1);
+
+    if (pending && x1 <= right + 1 && x2 >= left - 1) {
+      left = std::min(left, x1);
+      right = std::max(right, x2);
+      return;
+    }
+    if (pending)
+      flush();
+    left = x1;
+    right = x2;
+    pending = true;
+  });
+  if (pending)
+    flush();
+}
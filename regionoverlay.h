@@ -0,0 +1,34 @@
+#ifndef REGIONOVERLAY_H
+#define REGIONOVERLAY_H
+
+#include "regionindex.h"
+#include <qcustomplot.h>
+
+// Draws the seizure and SE regions of one plot. Only regions intersecting
+// the visible key range are emitted, and regions that land on the same
+// pixels are merged into one rectangle.
+class RegionOverlay : public QCPLayerable {
+public:
+  explicit RegionOverlay(QCPAxisRect *axisRect);
+
+  void setRegions(RegionIndex seizures, RegionIndex se);
+  const RegionIndex &seizureRegions() const { return seizures; }
+  const RegionIndex &seRegions() const { return se; }
+
+protected:
+  QRect clipRect() const override;
+  void applyDefaultAntialiasingHint(QCPPainter *painter) const override;
+  void draw(QCPPainter *painter) override;
+
+private:
+  void drawRegions(QCPPainter *painter, const RegionIndex &index,
+                   const QBrush &brush);
+
+  QCPAxisRect *axisRect;
+  RegionIndex seizures;
+  RegionIndex se;
+  QBrush seizureBrush;
+  QBrush seBrush;
+};
+
+#endif // REGIONOVERLAY_H
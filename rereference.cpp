@@ -0,0 +1,147 @@
+#include "rereference.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+// Time constant of the reference baseline used for artifact flagging
+const double BASELINE_SECONDS = 1.0;
+
+// Maps a signed count to an unsigned key with the same order
+inline unsigned orderKey(int16_t count) {
+  return static_cast<uint16_t>(count) ^ 0x8000u;
+}
+}
+
+ReReferencer::ReReferencer(const ReferenceSettings &settings,
+                           const BrwInfo &info)
+    : settings(settings), channels(info.channelCount()),
+      weights(channels, 1), referenced(channels),
+      countsToMv(info.adcCountsToMV / 1000000.0),
+      offsetMv(info.mvOffset / 1000000.0) {
+  padding = static_cast<long long>(
+      std::ceil(settings.artifactPaddingSeconds * info.samplingRate));
+  baselineAlpha = info.samplingRate > 0
+                      ? 1.0 / (BASELINE_SECONDS * info.samplingRate)
+                      : 1.0;
+}
+
+void ReReferencer::setMask(const std::vector<char> &mask) {
+  int count = 0;
+  for (int c = 0; c < channels; ++c) {
+    count += c >= static_cast<int>(mask.size()) || mask[c];
+  }
+  // With nothing left, fall back to every channel
+  for (int c = 0; c < channels; ++c) {
+    weights[c] = count == 0 || c >= static_cast<int>(mask.size()) || mask[c];
+  }
+  referenced = count == 0 ? channels : count;
+}
+
+int ReReferencer::selectCount(const int16_t *frame, std::size_t rank) {
+  // highCounts already holds the histogram of the high bytes
+  unsigned high = 0;
+  while (rank >= highCounts[high]) {
+    rank -= highCounts[high++];
+  }
+  std::memset(lowCounts, 0, sizeof(lowCounts));
+  for (int c = 0; c < channels; ++c) {
+    unsigned key = orderKey(frame[c]);
+    if ((key >> 8) == high && weights[c]) {
+      ++lowCounts[key & 0xff];
+    }
+  }
+  unsigned low = 0;
+  while (rank >= lowCounts[low]) {
+    rank -= lowCounts[low++];
+  }
+  return static_cast<int16_t>(((high << 8) | low) ^ 0x8000u);
+}
+
+double ReReferencer::referenceCount(const int16_t *frame) {
+  if (settings.mode != ReferenceMode::CommonMedian) {
+    long long sum = 0;
+    for (int c = 0; c < channels; ++c) {
+      sum += frame[c] * weights[c];
+    }
+    return static_cast<double>(sum) / referenced;
+  }
+
+  std::memset(highCounts, 0, sizeof(highCounts));
+  for (int c = 0; c < channels; ++c) {
+    highCounts[orderKey(frame[c]) >> 8] += weights[c];
+  }
+  std::size_t half = referenced / 2;
+  if (referenced % 2 == 1) {
+    return selectCount(frame, half);
+  }
+  return 0.5 * (selectCount(frame, half - 1) + selectCount(frame, half));
+}
+
+void ReReferencer::flag(long long frame) {
+  long long first = std::max(0LL, frame - padding);
+  long long last = frame + padding + 1;
+  if (!windows.empty() && first <= windows.back().second) {
+    windows.back().second = std::max(windows.back().second, last);
+  } else {
+    windows.emplace_back(first, last);
+  }
+}
+
+void ReReferencer::process(const int16_t *counts, long long firstFrame,
+                           std::size_t frameCount, double *frames) {
+  const bool subtract = settings.mode != ReferenceMode::None;
+  const double scale = countsToMv;
+  for (std::size_t f = 0; f < frameCount; ++f) {
+    const int16_t *__restrict in = counts + f * channels;
+    double *__restrict out = frames + f * channels;
+    if (!subtract && !settings.blankArtifacts) {
+      for (int c = 0; c < channels; ++c) {
+        out[c] = in[c] * scale + offsetMv;
+      }
+      continue;
+    }
+
+    double reference = channels > 0 ? referenceCount(in) : 0.0;
+    if (settings.blankArtifacts) {
+      double level = reference * scale + offsetMv;
+      if (!primed) {
+        baseline = level;
+        primed = true;
+      }
+      if (std::abs(level - baseline) > settings.artifactThresholdMv) {
+        flag(firstFrame + static_cast<long long>(f));
+      } else {
+        baseline += baselineAlpha * (level - baseline);
+      }
+    }
+
+    if (subtract) {
+      for (int c = 0; c < channels; ++c) {
+        out[c] = (in[c] - reference) * scale;
+      }
+    } else {
+      for (int c = 0; c < channels; ++c) {
+        out[c] = in[c] * scale + offsetMv;
+      }
+    }
+  }
+}
+
+void ReReferencer::blank(std::vector<ChannelData> &channelData,
+                         double frameScale) const {
+  for (ChannelData &channel : channelData) {
+    long long length = static_cast<long long>(channel.signal.size());
+    for (const auto &window : windows) {
+      long long first =
+          static_cast<long long>(std::floor(window.first * frameScale));
+      long long last = std::min(
+          static_cast<long long>(std::ceil(window.second * frameScale)),
+          length);
+      if (first < last) {
+        std::fill(channel.signal.begin() + first,
+                  channel.signal.begin() + last, 0.0);
+      }
+    }
+  }
+}
@@ -0,0 +1,68 @@
+#ifndef REREFERENCE_H
+#define REREFERENCE_H
+
+#include "brwreader.h"
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+enum class ReferenceMode { None, CommonAverage, CommonMedian };
+
+struct ReferenceSettings {
+  ReferenceMode mode = ReferenceMode::None;
+  bool blankArtifacts = false;
+  // A frame is an artifact when its common reference leaves the running
+  // baseline by more than this
+  double artifactThresholdMv = 1.0;
+  double artifactPaddingSeconds = 0.01;
+};
+
+// Converts frame-major ADC counts to millivolts and subtracts a per-frame
+// common reference in the same pass. The reference is taken in counts, where
+// the mean is an integer sum and the median a two-level byte histogram, and
+// the conversion is affine, so each frame costs a couple of contiguous
+// sweeps over its channels. Frames whose reference jumps away from its
+// running baseline are collected as artifact windows for blank().
+class ReReferencer {
+public:
+  ReReferencer(const ReferenceSettings &settings, const BrwInfo &info);
+
+  // Leaves channels with a zero mask entry out of the reference. They are
+  // still converted and re-referenced.
+  void setMask(const std::vector<char> &mask);
+  // Converts frameCount frames starting at recording frame firstFrame.
+  // Blocks must be passed in order.
+  void process(const int16_t *counts, long long firstFrame,
+               std::size_t frameCount, double *frames);
+  // Padded, merged [first, last) frame ranges flagged so far
+  const std::vector<std::pair<long long, long long>> &artifacts() const {
+    return windows;
+  }
+  // Zeroes the artifact windows in channel-major signals. frameScale maps
+  // recording frames to signal samples, for signals at another rate.
+  void blank(std::vector<ChannelData> &channels,
+             double frameScale = 1.0) const;
+
+private:
+  double referenceCount(const int16_t *frame);
+  int selectCount(const int16_t *frame, std::size_t rank);
+  void flag(long long frame);
+
+  ReferenceSettings settings;
+  int channels;
+  // 1 for channels in the reference
+  std::vector<int16_t> weights;
+  int referenced;
+  double countsToMv;
+  double offsetMv;
+  long long padding;
+  double baselineAlpha;
+  double baseline = 0.0;
+  bool primed = false;
+  uint32_t highCounts[256];
+  uint32_t lowCounts[256];
+  std::vector<std::pair<long long, long long>> windows;
+};
+
+#endif // REREFERENCE_H
@@ -0,0 +1,343 @@
+#include "resampler.h"
+#include "constants.h"
+#include "taskpool.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+namespace {
+// Decimation factor and filter half-length of the cheap leading stages
+const int PRE_DECIMATION = 4;
+const int PRE_DECIMATION_HALF_TAPS = 8;
+// Fraction of the output Nyquist frequency kept by the anti-aliasing filter
+const double PASSBAND_FRACTION = 0.9;
+
+long long floorDiv(long long a, long long b) {
+  long long q = a / b;
+  return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+} // namespace
+
+PolyphaseResampler::PolyphaseResampler(int up, int down, int channels,
+                                       int halfTaps)
+    : up(up), down(down), channels(channels), bufferFirst(0), inputFrames(0),
+      nextOutput(0) {
+  int g = std::gcd(up, down);
+  this->up = up / g;
+  this->down = down / g;
+
+  // Blackman-windowed sinc at the lower of the two Nyquist frequencies,
+  // scaled by up to make up for the zeros of the implicit up-sampling.
+  // halfTaps is counted in samples of the slower of input and output.
+  int factor = std::max(this->up, this->down);
+  int length = 2 * halfTaps * factor + 1;
+  double cutoff = PASSBAND_FRACTION * 0.5 / factor;
+  center = (length - 1) / 2;
+  taps.resize(length);
+  for (int j = 0; j < length; ++j) {
+    double t = j - center;
+    double sinc = t == 0 ? 2 * cutoff
+                         : std::sin(2 * M_PI * cutoff * t) / (M_PI * t);
+    double window = 0.42 - 0.5 * std::cos(2 * M_PI * j / (length - 1)) +
+                    0.08 * std::cos(4 * M_PI * j / (length - 1));
+    taps[j] = sinc * window;
+  }
+  double sum = std::accumulate(taps.begin(), taps.end(), 0.0);
+  for (double &tap : taps) {
+    tap *= this->up / sum;
+  }
+
+  padFrames = length / this->up + 1;
+  bufferFirst = -padFrames;
+}
+
+void PolyphaseResampler::chooseRatio(double sourceRate, double targetRate,
+                                     int &up, int &down, int maxUp) {
+  up = 1;
+  down = 1;
+  double bestError = std::numeric_limits<double>::max();
+  for (int u = 1; u <= maxUp; ++u) {
+    long long d = std::llround(sourceRate * u / targetRate);
+    if (d < 1 || d > std::numeric_limits<int>::max())
+      continue;
+    double error = std::abs(sourceRate * u / d - targetRate);
+    if (error < bestError - 1e-9) {
+      bestError = error;
+      up = u;
+      down = static_cast<int>(d);
+    }
+  }
+  int g = std::gcd(up, down);
+  up /= g;
+  down /= g;
+}
+
+long long PolyphaseResampler::outputFrames(long long inputFrames) const {
+  return (inputFrames * up + down - 1) / down;
+}
+
+void PolyphaseResampler::append(const double *frames, std::size_t frameCount) {
+  if (inputFrames == 0 && frameCount > 0) {
+    // Hold the first frame before the start so the filter sees no step
+    for (long long i = 0; i < padFrames; ++i) {
+      buffer.insert(buffer.end(), frames, frames + channels);
+    }
+  }
+  buffer.insert(buffer.end(), frames, frames + frameCount * channels);
+  inputFrames += frameCount;
+  if (frameCount > 0) {
+    lastFrame.assign(frames + (frameCount - 1) * channels,
+                     frames + frameCount * channels);
+  }
+}
+
+void PolyphaseResampler::produce(long long lastInput, long long outputLimit,
+                                 std::vector<double> &out) {
+  const long long length = static_cast<long long>(taps.size());
+  for (; nextOutput < outputLimit; ++nextOutput) {
+    long long position = nextOutput * down + center;
+    long long newest = position / up;
+    if (newest > lastInput)
+      break;
+
+    std::size_t offset = out.size();
+    out.resize(offset + channels, 0.0);
+    double *__restrict y = out.data() + offset;
+    for (long long j = position % up, i = newest; j < length; j += up, --i) {
+      const double coefficient = taps[j];
+      const double *__restrict x =
+          buffer.data() + (i - bufferFirst) * channels;
+      for (int c = 0; c < channels; ++c) {
+        y[c] += coefficient * x[c];
+      }
+    }
+  }
+
+  // Drop input frames that no later output frame reaches back to
+  long long oldest = floorDiv(nextOutput * down + center - (length - 1), up);
+  if (oldest > bufferFirst) {
+    buffer.erase(buffer.begin(), buffer.begin() + (oldest - bufferFirst) *
+                                                      channels);
+    bufferFirst = oldest;
+  }
+}
+
+void PolyphaseResampler::process(const double *frames, std::size_t frameCount,
+                                 std::vector<double> &out) {
+  append(frames, frameCount);
+  produce(inputFrames - 1, outputFrames(inputFrames), out);
+}
+
+void PolyphaseResampler::finish(std::vector<double> &out) {
+  if (inputFrames == 0)
+    return;
+  for (long long i = 0; i < padFrames; ++i) {
+    buffer.insert(buffer.end(), lastFrame.begin(), lastFrame.end());
+  }
+  produce(inputFrames - 1 + padFrames, outputFrames(inputFrames), out);
+}
+
+ResamplingChain::ResamplingChain(double sourceRate, double targetRate,
+                                 int channels)
+    : channels(channels), rate(sourceRate) {
+  while (rate / PRE_DECIMATION >= 2 * targetRate) {
+    stages.emplace_back(1, PRE_DECIMATION, channels, PRE_DECIMATION_HALF_TAPS);
+    rate /= PRE_DECIMATION;
+  }
+  int up, down;
+  PolyphaseResampler::chooseRatio(rate, targetRate, up, down);
+  stages.emplace_back(up, down, channels);
+  rate = rate * stages.back().upFactor() / stages.back().downFactor();
+  scratch.resize(stages.size());
+}
+
+long long ResamplingChain::outputFrames(long long inputFrames) const {
+  for (const PolyphaseResampler &stage : stages) {
+    inputFrames = stage.outputFrames(inputFrames);
+  }
+  return inputFrames;
+}
+
+void ResamplingChain::run(std::size_t firstStage, const double *frames,
+                          std::size_t frameCount, std::vector<double> &out) {
+  for (std::size_t s = firstStage; s < stages.size(); ++s) {
+    bool last = s + 1 == stages.size();
+    std::vector<double> &target = last ? out : scratch[s];
+    if (!last)
+      target.clear();
+    std::size_t offset = target.size();
+    stages[s].process(frames, frameCount, target);
+    frames = target.data() + offset;
+    frameCount = (target.size() - offset) / channels;
+  }
+}
+
+void ResamplingChain::process(const double *frames, std::size_t frameCount,
+                              std::vector<double> &out) {
+  run(0, frames, frameCount, out);
+}
+
+void ResamplingChain::finish(std::vector<double> &out) {
+  // Flush each stage in turn and push its tail through the later ones
+  for (std::size_t s = 0; s < stages.size(); ++s) {
+    if (s + 1 == stages.size()) {
+      stages[s].finish(out);
+    } else {
+      std::vector<double> tail;
+      stages[s].finish(tail);
+      run(s + 1, tail.data(), tail.size() / channels, out);
+    }
+  }
+}
+
+namespace {
+FrameSource readerSource(BrwReader &reader) {
+  return [&reader](long long first, long long count,
+                   std::vector<int16_t> &counts) {
+    reader.readFrames(first, count, counts);
+  };
+}
+
+// Feeds the whole recording through resampler block by block and hands each
+// batch of output frames to sink. Counts are converted by referencer when
+// given, else to millivolts or left as counts.
+void resampleStream(const BrwInfo &info, long long frameCount,
+                    const FrameSource &read, ResamplingChain &resampler,
+                    bool toMilliVolts, ReReferencer *referencer,
+                    const std::function<void(const std::vector<double> &)> &sink) {
+  std::vector<int16_t> counts;
+  std::vector<double> frames;
+  std::vector<double> out;
+  const CancelToken &cancel = TaskPool::currentToken();
+
+  for (long long first = 0; first < frameCount;
+       first += LOADER_BLOCK_FRAMES) {
+    if (cancel.cancelled())
+      throw std::runtime_error("Resampling cancelled");
+    long long blockFrames =
+        std::min<long long>(LOADER_BLOCK_FRAMES, frameCount - first);
+    read(first, blockFrames, counts);
+
+    frames.resize(counts.size());
+    if (referencer) {
+      referencer->process(counts.data(), first, blockFrames, frames.data());
+    } else {
+      for (std::size_t i = 0; i < counts.size(); ++i) {
+        frames[i] = toMilliVolts ? info.toMilliVolts(counts[i]) : counts[i];
+      }
+    }
+
+    out.clear();
+    resampler.process(frames.data(), blockFrames, out);
+    sink(out);
+  }
+  out.clear();
+  resampler.finish(out);
+  sink(out);
+}
+} // namespace
+
+double resampleToChannels(const std::string &sourcePath, double targetRate,
+                          std::vector<ChannelData> &channels) {
+  BrwReader reader(sourcePath);
+  return resampleToChannels(reader.info(), reader.availableFrames(),
+                            readerSource(reader), targetRate, channels);
+}
+
+double resampleToChannels(const BrwInfo &info, long long frameCount,
+                          const FrameSource &read, double targetRate,
+                          std::vector<ChannelData> &channels,
+                          ReReferencer *referencer) {
+  int channelCount = info.channelCount();
+
+  ResamplingChain resampler(info.samplingRate, targetRate, channelCount);
+
+  channels.assign(channelCount, ChannelData());
+  long long outputFrames = resampler.outputFrames(frameCount);
+  for (int k = 0; k < channelCount; ++k) {
+    channels[k].signal.reserve(outputFrames);
+    channels[k].name = {info.rows[k], info.cols[k]};
+  }
+
+  auto scatter = [&](const std::vector<double> &out) {
+    std::size_t frames = out.size() / channelCount;
+    for (std::size_t i = 0; i < frames; ++i) {
+      const double *frame = out.data() + i * channelCount;
+      for (int k = 0; k < channelCount; ++k) {
+        channels[k].signal.push_back(frame[k]);
+      }
+    }
+  };
+  resampleStream(info, frameCount, read, resampler, true, referencer,
+                 scatter);
+
+  for (auto &channel : channels) {
+    if (channel.signal.empty())
+      continue;
+    double mean =
+        std::accumulate(channel.signal.begin(), channel.signal.end(), 0.0) /
+        channel.signal.size();
+    for (auto &val : channel.signal) {
+      val -= mean;
+    }
+  }
+  if (referencer) {
+    referencer->blank(channels, resampler.outputRate() / info.samplingRate);
+  }
+
+  return resampler.outputRate();
+}
+
+double writeResampledBrw(const std::string &sourcePath,
+                         const std::string &targetPath, double targetRate) {
+  BrwReader reader(sourcePath);
+  const BrwInfo &info = reader.info();
+  hsize_t channelCount = info.channelCount();
+
+  ResamplingChain resampler(info.samplingRate, targetRate, channelCount);
+  long long outputFrames = resampler.outputFrames(reader.availableFrames());
+  double outputRate = resampler.outputRate();
+
+  H5::H5File source(sourcePath, H5F_ACC_RDONLY);
+  H5::H5File target(targetPath, H5F_ACC_TRUNC);
+  if (H5Ocopy(source.getId(), "/3BRecInfo", target.getId(), "/3BRecInfo",
+              H5P_DEFAULT, H5P_DEFAULT) < 0) {
+    throw std::runtime_error("Could not copy /3BRecInfo");
+  }
+  target.openDataSet("/3BRecInfo/3BRecVars/NRecFrames")
+      .write(&outputFrames, H5::PredType::NATIVE_LLONG);
+  target.openDataSet("/3BRecInfo/3BRecVars/SamplingRate")
+      .write(&outputRate, H5::PredType::NATIVE_DOUBLE);
+
+  hsize_t rawSize = static_cast<hsize_t>(outputFrames) * channelCount;
+  H5::Group data = target.createGroup("/3BData");
+  H5::DataSpace rawSpace(1, &rawSize);
+  H5::DataSet raw =
+      data.createDataSet("Raw", H5::PredType::NATIVE_INT16, rawSpace);
+
+  hsize_t written = 0;
+  std::vector<int16_t> counts;
+  auto write = [&](const std::vector<double> &out) {
+    hsize_t count = std::min<hsize_t>(out.size(), rawSize - written);
+    if (count == 0)
+      return;
+    counts.resize(count);
+    for (hsize_t i = 0; i < count; ++i) {
+      counts[i] = static_cast<int16_t>(std::clamp(
+          std::lround(out[i]), static_cast<long>(INT16_MIN),
+          static_cast<long>(INT16_MAX)));
+    }
+    H5::DataSpace fileSpace = raw.getSpace();
+    fileSpace.selectHyperslab(H5S_SELECT_SET, &count, &written);
+    H5::DataSpace memSpace(1, &count);
+    raw.write(counts.data(), H5::PredType::NATIVE_INT16, memSpace, fileSpace);
+    written += count;
+  };
+  resampleStream(info, reader.availableFrames(), readerSource(reader),
+                 resampler, false, nullptr, write);
+
+  return outputRate;
+}
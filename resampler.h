@@ -0,0 +1,106 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include "brwreader.h"
+#include "rereference.h"
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Rational resampler for frame-major blocks: up-sample by up, low-pass and
+// down-sample by down without ever forming the up-sampled signal. Like
+// FilterBank, the inner loops run across channels, so all channels are
+// resampled together in SIMD lanes.
+class PolyphaseResampler {
+public:
+  PolyphaseResampler(int up, int down, int channels, int halfTaps = 16);
+
+  // Picks up/down (up <= maxUp) so that sourceRate * up / down is as close
+  // to targetRate as possible.
+  static void chooseRatio(double sourceRate, double targetRate, int &up,
+                          int &down, int maxUp = 64);
+
+  int upFactor() const { return up; }
+  int downFactor() const { return down; }
+  long long outputFrames(long long inputFrames) const;
+
+  // Consumes frameCount input frames and appends every output frame that
+  // can be computed so far to out.
+  void process(const double *frames, std::size_t frameCount,
+               std::vector<double> &out);
+  // Emits the remaining output frames, holding the last input frame.
+  void finish(std::vector<double> &out);
+
+private:
+  void append(const double *frames, std::size_t frameCount);
+  void produce(long long lastInput, long long outputLimit,
+               std::vector<double> &out);
+
+  int up;
+  int down;
+  int channels;
+  std::vector<double> taps;
+  long long center;
+  long long padFrames;
+
+  // Input frames starting at input index bufferFirst, which is negative
+  // while the leading padding is still buffered
+  std::vector<double> buffer;
+  long long bufferFirst;
+  long long inputFrames;
+  long long nextOutput;
+  std::vector<double> lastFrame;
+};
+
+// Resamples by large factors in stages: cheap decimate-by-4 stages with
+// short filters bring the rate down to within 8x of the target, and a final
+// rational stage applies the sharp anti-aliasing filter. This keeps the
+// filter history, and so the memory held per channel, a few hundred frames
+// long even for 4096 channels.
+class ResamplingChain {
+public:
+  ResamplingChain(double sourceRate, double targetRate, int channels);
+
+  double outputRate() const { return rate; }
+  long long outputFrames(long long inputFrames) const;
+  void process(const double *frames, std::size_t frameCount,
+               std::vector<double> &out);
+  void finish(std::vector<double> &out);
+
+private:
+  void run(std::size_t firstStage, const double *frames,
+           std::size_t frameCount, std::vector<double> &out);
+
+  std::vector<PolyphaseResampler> stages;
+  std::vector<std::vector<double>> scratch;
+  int channels;
+  double rate;
+};
+
+// Reads frameCount frames of ADC counts from firstFrame, frame-major, as
+// BrwReader::readFrames does
+using FrameSource = std::function<void(long long firstFrame,
+                                       long long frameCount,
+                                       std::vector<int16_t> &counts)>;
+
+// Resamples a recording to a new in-memory analysis copy, converted and
+// mean-corrected like get_cat_envelop. Returns the achieved rate.
+double resampleToChannels(const std::string &sourcePath, double targetRate,
+                          std::vector<ChannelData> &channels);
+// The same over frames read through read, so the caller decides how the
+// file is locked. When referencer is given it converts and re-references
+// each block, and its artifact windows are blanked at the new rate. Throws
+// if the current task token is cancelled.
+double resampleToChannels(const BrwInfo &info, long long frameCount,
+                          const FrameSource &read, double targetRate,
+                          std::vector<ChannelData> &channels,
+                          ReReferencer *referencer = nullptr);
+
+// Writes a resampled copy of a recording as a new BRW file. /3BRecInfo is
+// copied as is apart from NRecFrames and SamplingRate, and /3BData/Raw keeps
+// its frame-interleaved ADC counts. Returns the achieved rate.
+double writeResampledBrw(const std::string &sourcePath,
+                         const std::string &targetPath, double targetRate);
+
+#endif // RESAMPLER_H
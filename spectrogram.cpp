@@ -0,0 +1,168 @@
+#include "spectrogram.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <set>
+
+bool SpectrogramEngine::TileKey::operator<(const TileKey &other) const {
+  if (channel != other.channel)
+    return channel < other.channel;
+  if (level != other.level)
+    return level < other.level;
+  return index < other.index;
+}
+
+SpectrogramEngine::SpectrogramEngine(int fftSize, int tileColumns,
+                                     std::size_t maxTiles)
+    : windowSize(fftSize), tileColumns(tileColumns), maxTiles(maxTiles),
+      plan(FftPlan::get(fftSize)) {
+  window.resize(windowSize);
+  for (int i = 0; i < windowSize; ++i) {
+    window[i] = 0.5 - 0.5 * std::cos(2 * M_PI * i / windowSize);
+  }
+}
+
+void SpectrogramEngine::setSignal(int channel,
+                                  std::shared_ptr<const void> owner,
+                                  const double *samples, std::size_t length) {
+  dropChannel(channel);
+  signals[channel] = {std::move(owner), samples, length};
+}
+
+void SpectrogramEngine::clear() {
+  signals.clear();
+  tiles.clear();
+  recentTiles.clear();
+}
+
+void SpectrogramEngine::dropChannel(int channel) {
+  for (auto it = tiles.begin(); it != tiles.end();) {
+    if (it->first.channel == channel) {
+      recentTiles.erase(it->second.recent);
+      it = tiles.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+long long SpectrogramEngine::hopForLevel(int level) const {
+  return static_cast<long long>(windowSize / 2) << level;
+}
+
+void SpectrogramEngine::computeTile(const TileKey &key,
+                                    std::vector<float> &values) const {
+  const Signal &signal = signals.at(key.channel);
+  const long long hop = hopForLevel(key.level);
+  const int bins = binCount();
+  const double scale = 1.0 / windowSize;
+
+  values.resize(static_cast<std::size_t>(tileColumns) * bins);
+  std::vector<std::complex<double>> buffer(windowSize);
+  for (int c = 0; c < tileColumns; ++c) {
+    long long start =
+        (key.index * tileColumns + c) * hop - windowSize / 2;
+    for (int i = 0; i < windowSize; ++i) {
+      long long sample = start + i;
+      double x = sample >= 0 && sample < static_cast<long long>(signal.length)
+                     ? signal.samples[sample]
+                     : 0.0;
+      buffer[i] = window[i] * x;
+    }
+    plan->forward(buffer.data());
+    for (int b = 0; b < bins; ++b) {
+      double power = std::norm(buffer[b] * scale);
+      values[c * bins + b] = static_cast<float>(10.0 * std::log10(power + 1e-20));
+    }
+  }
+}
+
+const std::vector<float> &SpectrogramEngine::touch(const TileKey &key) {
+  Tile &tile = tiles.at(key);
+  recentTiles.splice(recentTiles.begin(), recentTiles, tile.recent);
+  return tile.values;
+}
+
+void SpectrogramEngine::compute(const std::vector<int> &channels,
+                                double firstSample, double lastSample,
+                                int maxColumns,
+                                std::vector<SpectrogramView> &views) {
+  views.assign(channels.size(), SpectrogramView());
+  if (channels.empty() || maxColumns < 1)
+    return;
+
+  firstSample = std::max(0.0, firstSample);
+  lastSample = std::max(firstSample, lastSample);
+  int level = 0;
+  while ((lastSample - firstSample) / hopForLevel(level) + 1 > maxColumns) {
+    ++level;
+  }
+  const long long hop = hopForLevel(level);
+  const int bins = binCount();
+
+  // Work out each view's column range and queue the tiles not yet cached
+  std::set<TileKey> missing;
+  for (std::size_t i = 0; i < channels.size(); ++i) {
+    auto signal = signals.find(channels[i]);
+    if (signal == signals.end() || signal->second.length == 0)
+      continue;
+
+    long long lastColumnInSignal =
+        static_cast<long long>(signal->second.length - 1) / hop;
+    long long first = static_cast<long long>(std::floor(firstSample / hop));
+    long long last = std::min(
+        static_cast<long long>(std::ceil(lastSample / hop)), lastColumnInSignal);
+    if (first > last)
+      continue;
+
+    SpectrogramView &view = views[i];
+    view.hop = hop;
+    view.firstColumn = first;
+    view.columns = static_cast<int>(last - first + 1);
+    view.bins = bins;
+    for (long long t = first / tileColumns; t <= last / tileColumns; ++t) {
+      TileKey key{channels[i], level, t};
+      if (tiles.find(key) == tiles.end()) {
+        missing.insert(key);
+      }
+    }
+  }
+
+  std::vector<TileKey> jobs(missing.begin(), missing.end());
+  std::vector<std::vector<float>> results(jobs.size());
+  parallelFor(jobs.size(),
+              [&](std::size_t j) { computeTile(jobs[j], results[j]); });
+  for (std::size_t j = 0; j < jobs.size(); ++j) {
+    recentTiles.push_front(jobs[j]);
+    tiles[jobs[j]] = {std::move(results[j]), recentTiles.begin()};
+  }
+
+  for (std::size_t i = 0; i < channels.size(); ++i) {
+    SpectrogramView &view = views[i];
+    if (view.columns == 0)
+      continue;
+    view.values.resize(static_cast<std::size_t>(view.columns) * bins);
+    for (int c = 0; c < view.columns; ++c) {
+      long long column = view.firstColumn + c;
+      const std::vector<float> &tile =
+          touch({channels[i], level, column / tileColumns});
+      const float *source = tile.data() + (column % tileColumns) * bins;
+      std::copy(source, source + bins, view.values.begin() + c * bins);
+    }
+  }
+
+  evict();
+}
+
+void SpectrogramEngine::setMaxTiles(std::size_t count) {
+  maxTiles = count;
+  evict();
+}
+
+void SpectrogramEngine::evict() {
+  while (tiles.size() > maxTiles) {
+    tiles.erase(recentTiles.back());
+    recentTiles.pop_back();
+  }
+}
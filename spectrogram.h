@@ -0,0 +1,90 @@
+#ifndef SPECTROGRAM_H
+#define SPECTROGRAM_H
+
+#include "fft.h"
+#include <cstddef>
+#include <list>
+#include <map>
+#include <memory>
+#include <vector>
+
+// Power spectra (dB) for a run of STFT columns of one channel.
+struct SpectrogramView {
+  long long hop = 0; // samples between column centers
+  long long firstColumn = 0;
+  int columns = 0;
+  int bins = 0;
+  std::vector<float> values; // values[column * bins + bin]
+
+  double columnSample(int column) const {
+    return static_cast<double>((firstColumn + column) * hop);
+  }
+};
+
+// Computes Hann-windowed STFTs on demand. Columns are grouped into tiles of
+// tileColumns, and tiles are cached per channel and level of detail, so
+// panning back over a computed range costs nothing. Zoomed-out views use a
+// coarser level with a longer hop, which keeps the number of columns per
+// view bounded.
+class SpectrogramEngine {
+public:
+  explicit SpectrogramEngine(int fftSize = 256, int tileColumns = 64,
+                             std::size_t maxTiles = 4096);
+
+  int fftSize() const { return windowSize; }
+  int binCount() const { return windowSize / 2 + 1; }
+
+  // owner holds samples, and the engine keeps it until the channel is set
+  // again or cleared, so the caller may replace its own copy at any time.
+  void setSignal(int channel, std::shared_ptr<const void> owner,
+                 const double *samples, std::size_t length);
+  void clear();
+
+  std::size_t tileBytes() const {
+    return static_cast<std::size_t>(tileColumns) * binCount() * sizeof(float);
+  }
+  std::size_t memoryBytes() const { return tiles.size() * tileBytes(); }
+  // Evicts the least recently used tiles down to the new limit
+  void setMaxTiles(std::size_t count);
+
+  // Fills views[i] for channels[i] over the samples [firstSample,
+  // lastSample], with at most maxColumns columns. Every missing tile of
+  // every channel is computed in one parallel batch.
+  void compute(const std::vector<int> &channels, double firstSample,
+               double lastSample, int maxColumns,
+               std::vector<SpectrogramView> &views);
+
+private:
+  struct Signal {
+    std::shared_ptr<const void> owner;
+    const double *samples;
+    std::size_t length;
+  };
+  struct TileKey {
+    int channel;
+    int level;
+    long long index;
+    bool operator<(const TileKey &other) const;
+  };
+  struct Tile {
+    std::vector<float> values;
+    std::list<TileKey>::iterator recent;
+  };
+
+  long long hopForLevel(int level) const;
+  void computeTile(const TileKey &key, std::vector<float> &values) const;
+  const std::vector<float> &touch(const TileKey &key);
+  void dropChannel(int channel);
+  void evict();
+
+  int windowSize;
+  int tileColumns;
+  std::size_t maxTiles;
+  std::shared_ptr<const FftPlan> plan;
+  std::vector<double> window;
+  std::map<int, Signal> signals;
+  std::map<TileKey, Tile> tiles;
+  std::list<TileKey> recentTiles; // most recently used first
+};
+
+#endif // SPECTROGRAM_H
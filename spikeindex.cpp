@@ -0,0 +1,273 @@
+#include "spikeindex.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                   \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SPIKE_SIMD_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define SPIKE_SIMD_NEON
+#endif
+
+namespace {
+const std::size_t NOISE_SAMPLES = 1 << 16;
+const std::size_t MERGE_CHUNKS = 64;
+const double RATE_TICK_SECONDS = 0.001;
+const std::size_t RATE_SCAN_PER_CHANNEL = 16;
+
+// Index of the first sample at or after i outside [lower, upper], or n.
+// Spikes are rare, so whole vectors are compared and only a vector that
+// holds a crossing is looked at sample by sample.
+std::size_t findOutside(const double *x, std::size_t i, std::size_t n,
+                        double lower, double upper) {
+#if defined(SPIKE_SIMD_SSE2)
+  const __m128d lo = _mm_set1_pd(lower), hi = _mm_set1_pd(upper);
+  for (; i + 4 <= n; i += 4) {
+    __m128d a = _mm_loadu_pd(x + i), b = _mm_loadu_pd(x + i + 2);
+    __m128d outside = _mm_or_pd(
+        _mm_or_pd(_mm_cmplt_pd(a, lo), _mm_cmpgt_pd(a, hi)),
+        _mm_or_pd(_mm_cmplt_pd(b, lo), _mm_cmpgt_pd(b, hi)));
+    if (_mm_movemask_pd(outside))
+      break;
+  }
+#elif defined(SPIKE_SIMD_NEON)
+  const float64x2_t lo = vdupq_n_f64(lower), hi = vdupq_n_f64(upper);
+  for (; i + 4 <= n; i += 4) {
+    float64x2_t a = vld1q_f64(x + i), b = vld1q_f64(x + i + 2);
+    uint64x2_t outside =
+        vorrq_u64(vorrq_u64(vcltq_f64(a, lo), vcgtq_f64(a, hi)),
+                  vorrq_u64(vcltq_f64(b, lo), vcgtq_f64(b, hi)));
+    if (vgetq_lane_u64(outside, 0) | vgetq_lane_u64(outside, 1))
+      break;
+  }
+#endif
+  for (; i < n; ++i) {
+    if (x[i] < lower || x[i] > upper)
+      return i;
+  }
+  return n;
+}
+
+std::vector<uint32_t> detectChannel(const std::vector<double> &signal,
+                                    double threshold, std::size_t refractory,
+                                    bool bothPolarities) {
+  std::vector<uint32_t> spikes;
+  const double *x = signal.data();
+  const std::size_t n = signal.size();
+  const double lower = -threshold;
+  const double upper =
+      bothPolarities ? threshold : std::numeric_limits<double>::infinity();
+
+  std::size_t i = 0;
+  while ((i = findOutside(x, i, n, lower, upper)) < n) {
+    // Only the sample where the signal leaves the band counts; if the
+    // previous sample was already past the threshold on the same side,
+    // wait for the signal to come back first.
+    bool below = x[i] < lower;
+    if (i > 0 && (below ? x[i - 1] < lower : x[i - 1] > upper)) {
+      while (i < n && (below ? x[i] < lower : x[i] > upper)) {
+        ++i;
+      }
+      continue;
+    }
+    spikes.push_back(static_cast<uint32_t>(i));
+    i += refractory;
+  }
+  return spikes;
+}
+}
+
+SpikeIndex::SpikeIndex(std::vector<std::vector<uint32_t>> spikesPerChannel,
+                       double samplingRate)
+    : perChannel(std::move(spikesPerChannel)),
+      channels(static_cast<int>(perChannel.size())),
+      samplingRate(samplingRate) {
+  if (perChannel.size() > std::numeric_limits<uint16_t>::max() + 1u) {
+    throw std::out_of_range("Too many channels for the spike index");
+  }
+
+  uint32_t end = 0;
+  for (const auto &spikes : perChannel) {
+    if (!spikes.empty()) {
+      end = std::max(end, spikes.back() + 1);
+    }
+  }
+
+  // Split the time axis into chunks; each chunk gathers its spikes from
+  // every channel and sorts them on its own, in parallel.
+  std::vector<uint32_t> bounds(MERGE_CHUNKS + 1);
+  for (std::size_t k = 0; k <= MERGE_CHUNKS; ++k) {
+    bounds[k] = static_cast<uint32_t>(static_cast<uint64_t>(end) * k /
+                                      MERGE_CHUNKS);
+  }
+  std::vector<std::size_t> offsets(MERGE_CHUNKS + 1, 0);
+  for (const auto &spikes : perChannel) {
+    for (std::size_t k = 1; k <= MERGE_CHUNKS; ++k) {
+      offsets[k] += std::lower_bound(spikes.begin(), spikes.end(), bounds[k]) -
+                    spikes.begin();
+    }
+  }
+  // offsets[k] now counts the spikes before bounds[k]
+
+  std::vector<uint64_t> keys(offsets[MERGE_CHUNKS]);
+  parallelFor(MERGE_CHUNKS, [&](std::size_t k) {
+    uint64_t *out = keys.data() + offsets[k];
+    for (std::size_t c = 0; c < perChannel.size(); ++c) {
+      const auto &spikes = perChannel[c];
+      auto first = std::lower_bound(spikes.begin(), spikes.end(), bounds[k]);
+      auto last = std::lower_bound(first, spikes.end(), bounds[k + 1]);
+      for (auto it = first; it != last; ++it) {
+        *out++ = (static_cast<uint64_t>(*it) << 16) | c;
+      }
+    }
+    std::sort(keys.data() + offsets[k], out);
+  });
+
+  samples.resize(keys.size());
+  channelOf.resize(keys.size());
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    samples[i] = static_cast<uint32_t>(keys[i] >> 16);
+    channelOf[i] = static_cast<uint16_t>(keys[i] & 0xffff);
+  }
+
+  // cumulative[t] counts the spikes before tick t
+  tickSamples = std::max<uint32_t>(
+      1, static_cast<uint32_t>(std::lround(RATE_TICK_SECONDS * samplingRate)));
+  std::size_t ticks = end / tickSamples + 2;
+  cumulative.assign(ticks, 0);
+  std::size_t i = 0;
+  for (std::size_t t = 0; t < ticks; ++t) {
+    uint64_t tickStart = static_cast<uint64_t>(t) * tickSamples;
+    while (i < samples.size() && samples[i] < tickStart) {
+      ++i;
+    }
+    cumulative[t] = static_cast<uint32_t>(i);
+  }
+}
+
+std::size_t SpikeIndex::countInRange(int channel, uint32_t first,
+                                      uint32_t last) const {
+  if (channel < 0 || channel >= channels)
+    return 0;
+  const std::vector<uint32_t> &spikes = perChannel[channel];
+  auto lower = std::lower_bound(spikes.begin(), spikes.end(), first);
+  return std::lower_bound(lower, spikes.end(), last) - lower;
+}
+
+std::size_t SpikeIndex::cumulativeAt(double seconds) const {
+  if (cumulative.empty() || seconds <= 0)
+    return 0;
+  double tick = std::round(seconds * samplingRate / tickSamples);
+  if (tick >= cumulative.size())
+    return cumulative.back();
+  return cumulative[static_cast<std::size_t>(tick)];
+}
+
+void SpikeIndex::populationRate(double startSeconds, double binSeconds,
+                                int bins, std::vector<double> &rates) const {
+  rates.assign(std::max(0, bins), 0.0);
+  if (binSeconds <= 0)
+    return;
+  std::size_t previous = cumulativeAt(startSeconds);
+  for (int b = 0; b < bins; ++b) {
+    std::size_t next = cumulativeAt(startSeconds + (b + 1) * binSeconds);
+    rates[b] = (next - previous) / binSeconds;
+    previous = next;
+  }
+}
+
+void SpikeIndex::channelRates(double startSeconds, double stopSeconds,
+                              std::vector<double> &rates) const {
+  rates.assign(channels, 0.0);
+  double duration = stopSeconds - startSeconds;
+  if (duration <= 0)
+    return;
+  auto toSample = [this](double seconds) {
+    return static_cast<uint32_t>(std::min(
+        std::max(0.0, seconds * samplingRate), static_cast<double>(UINT32_MAX)));
+  };
+  uint32_t first = toSample(startSeconds), last = toSample(stopSeconds);
+  // One pass over the window's spikes beats a search per channel until the
+  // window holds many spikes per channel
+  std::pair<std::size_t, std::size_t> span = range(first, last);
+  if (span.second - span.first <= RATE_SCAN_PER_CHANNEL * channels) {
+    for (std::size_t i = span.first; i < span.second; ++i) {
+      rates[channelOf[i]] += 1.0;
+    }
+    for (double &rate : rates) {
+      rate /= duration;
+    }
+    return;
+  }
+  for (int c = 0; c < channels; ++c) {
+    rates[c] = countInRange(c, first, last) / duration;
+  }
+}
+
+std::pair<std::size_t, std::size_t> SpikeIndex::range(uint32_t first,
+                                                      uint32_t last) const {
+  auto begin = std::lower_bound(samples.begin(), samples.end(), first);
+  auto end = std::lower_bound(begin, samples.end(), last);
+  return std::make_pair(begin - samples.begin(), end - samples.begin());
+}
+
+double estimateNoise(const std::vector<double> &signal) {
+  if (signal.empty())
+    return 0.0;
+
+  std::size_t stride = std::max<std::size_t>(1, signal.size() / NOISE_SAMPLES);
+  std::vector<double> values;
+  values.reserve(signal.size() / stride + 1);
+  for (std::size_t i = 0; i < signal.size(); i += stride) {
+    values.push_back(signal[i]);
+  }
+
+  auto middle = values.begin() + values.size() / 2;
+  std::nth_element(values.begin(), middle, values.end());
+  double median = *middle;
+  for (double &value : values) {
+    value = std::abs(value - median);
+  }
+  std::nth_element(values.begin(), middle, values.end());
+  // Scales the MAD to the standard deviation of Gaussian noise
+  return *middle / 0.6745;
+}
+
+void detectChannelSpikes(const std::vector<ChannelData> &channels,
+                         const std::vector<char> &mask, double samplingRate,
+                         const SpikeSettings &settings,
+                         std::vector<std::vector<uint32_t>> &spikes) {
+  for (const ChannelData &channel : channels) {
+    if (channel.signal.size() > std::numeric_limits<uint32_t>::max()) {
+      throw std::out_of_range("Recording too long for the spike index");
+    }
+  }
+
+  std::size_t refractory = std::max<std::size_t>(
+      1, std::lround(settings.refractorySeconds * samplingRate));
+  spikes.resize(channels.size());
+  parallelFor(channels.size(), [&](std::size_t c) {
+    if (!channelUsable(mask, c))
+      return;
+    const std::vector<double> &signal = channels[c].signal;
+    double threshold = settings.thresholdSigmas * estimateNoise(signal);
+    spikes[c].clear();
+    if (threshold > 0) {
+      spikes[c] = detectChannel(signal, threshold, refractory,
+                                settings.bothPolarities);
+    }
+  });
+}
+
+SpikeIndex detectSpikes(const std::vector<ChannelData> &channels,
+                        const std::vector<char> &mask, double samplingRate,
+                        const SpikeSettings &settings) {
+  std::vector<std::vector<uint32_t>> spikes;
+  detectChannelSpikes(channels, mask, samplingRate, settings, spikes);
+  return SpikeIndex(std::move(spikes), samplingRate);
+}
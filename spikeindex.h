@@ -0,0 +1,97 @@
+#ifndef SPIKEINDEX_H
+#define SPIKEINDEX_H
+
+#include "brwreader.h"
+#include "channelquality.h"
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Every spike of a recording sorted by sample offset (then channel), stored
+// as two parallel arrays: 6 bytes per spike. Offsets are 32-bit, which
+// covers about 59 hours at 20 kHz. The index also owns each channel's
+// offsets, 4 more bytes per spike and the only copy the analysis keeps,
+// together with the cumulative population count per millisecond, so spike
+// counts over any bins are lookups rather than rescans. An index is never
+// modified once built; updates build a new one.
+class SpikeIndex {
+public:
+  SpikeIndex() = default;
+  // spikesPerChannel[c] holds the sorted sample offsets of channel c.
+  SpikeIndex(std::vector<std::vector<uint32_t>> spikesPerChannel,
+             double samplingRate);
+
+  bool empty() const { return samples.empty(); }
+  std::size_t size() const { return samples.size(); }
+  int channelCount() const { return channels; }
+  double rate() const { return samplingRate; }
+  const std::vector<uint32_t> &sampleOffsets() const { return samples; }
+  const std::vector<uint16_t> &channelIds() const { return channelOf; }
+  const std::vector<std::vector<uint32_t>> &channelSpikes() const {
+    return perChannel;
+  }
+
+  // Index range [first, second) of the spikes with first <= offset < last.
+  std::pair<std::size_t, std::size_t> range(uint32_t first,
+                                            uint32_t last) const;
+
+  // Spikes of channel with first <= offset < last.
+  std::size_t countInRange(int channel, uint32_t first, uint32_t last) const;
+  // Population firing rate (spikes/s over all channels) in bins consecutive
+  // bins of binSeconds starting at startSeconds. Bin edges are rounded to
+  // whole milliseconds.
+  void populationRate(double startSeconds, double binSeconds, int bins,
+                      std::vector<double> &rates) const;
+  // Firing rate of every channel between startSeconds and stopSeconds.
+  // Short windows are counted from the time-sorted spikes they hold.
+  void channelRates(double startSeconds, double stopSeconds,
+                    std::vector<double> &rates) const;
+
+  // Calls fn(channel, offset) for every spike in [first, last), in time
+  // order.
+  template <typename Fn>
+  void forEachInRange(uint32_t first, uint32_t last, Fn fn) const {
+    std::pair<std::size_t, std::size_t> span = range(first, last);
+    for (std::size_t i = span.first; i < span.second; ++i) {
+      fn(channelOf[i], samples[i]);
+    }
+  }
+
+private:
+  std::size_t cumulativeAt(double seconds) const;
+
+  std::vector<uint32_t> samples;
+  std::vector<uint16_t> channelOf;
+  std::vector<std::vector<uint32_t>> perChannel;
+  std::vector<uint32_t> cumulative;
+  uint32_t tickSamples = 1;
+  int channels = 0;
+  double samplingRate = 0.0;
+};
+
+struct SpikeSettings {
+  double thresholdSigmas = 5.0;
+  double refractorySeconds = 0.002;
+  // Also detect positive-going crossings
+  bool bothPolarities = false;
+};
+
+// Noise level of signal from its median absolute deviation, which spikes
+// barely move. Long signals are estimated from an even subsample.
+double estimateNoise(const std::vector<double> &signal);
+
+// Detects threshold crossings on the channels in mask, in parallel, into
+// spikes (sample numbers per channel); other channels keep their entry. The
+// threshold is thresholdSigmas times each channel's noise level, and a
+// channel cannot fire again within the refractory period.
+void detectChannelSpikes(const std::vector<ChannelData> &channels,
+                         const std::vector<char> &mask, double samplingRate,
+                         const SpikeSettings &settings,
+                         std::vector<std::vector<uint32_t>> &spikes);
+// Same over every usable channel, indexed. Masked channels have no spikes.
+SpikeIndex detectSpikes(const std::vector<ChannelData> &channels,
+                        const std::vector<char> &mask,
+                        double samplingRate, const SpikeSettings &settings);
+
+#endif // SPIKEINDEX_H
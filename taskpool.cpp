@@ -0,0 +1,224 @@
+#include "taskpool.h"
+#include <algorithm>
+#include <exception>
+
+namespace {
+const std::size_t NOT_A_WORKER = static_cast<std::size_t>(-1);
+
+thread_local TaskPool *currentPool = nullptr;
+thread_local std::size_t workerIndex = NOT_A_WORKER;
+thread_local TaskPriority scopePriority = TaskPriority::Visible;
+thread_local CancelToken scopeToken;
+
+// One parallelFor call. Helpers that start after the caller has returned
+// only touch this shared state, never fn.
+struct Job {
+  std::size_t count;
+  const std::function<void(std::size_t)> *fn;
+  CancelToken token;
+  std::atomic<std::size_t> next{0};
+  std::atomic<int> active{0};
+  std::atomic<bool> stopped{false};
+  std::mutex mutex;
+  std::condition_variable done;
+  std::exception_ptr error;
+
+  void work() {
+    ++active;
+    while (!stopped && !token.cancelled()) {
+      std::size_t i = next++;
+      if (i >= count)
+        break;
+      try {
+        (*fn)(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error)
+          error = std::current_exception();
+        stopped = true;
+      }
+    }
+    if (--active == 0) {
+      std::lock_guard<std::mutex> lock(mutex);
+      done.notify_all();
+    }
+  }
+
+  void finish() {
+    stopped = true;
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return active == 0; });
+    if (error)
+      std::rethrow_exception(error);
+  }
+};
+}
+
+TaskScope::TaskScope(TaskPriority priority, CancelToken token)
+    : savedPriority(scopePriority), savedToken(std::move(scopeToken)) {
+  scopePriority = priority;
+  scopeToken = std::move(token);
+}
+
+TaskScope::~TaskScope() {
+  scopePriority = savedPriority;
+  scopeToken = std::move(savedToken);
+}
+
+TaskPool &TaskPool::instance() {
+  static TaskPool pool(std::max(1u, std::thread::hardware_concurrency()));
+  return pool;
+}
+
+TaskPool::TaskPool(unsigned threads) {
+  threads = std::max(1u, threads);
+  for (unsigned t = 0; t < threads; ++t) {
+    workers.push_back(std::make_unique<Worker>());
+  }
+  // Started only once every deque exists, since workers steal from all
+  for (unsigned t = 0; t < threads; ++t) {
+    workers[t]->thread = std::thread([this, t] { run(t); });
+  }
+}
+
+TaskPool::~TaskPool() {
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto &worker : workers) {
+    worker->thread.join();
+  }
+}
+
+TaskPriority TaskPool::currentPriority() { return scopePriority; }
+
+const CancelToken &TaskPool::currentToken() { return scopeToken; }
+
+void TaskPool::submit(TaskPriority priority, std::function<void()> task,
+                      CancelToken token) {
+  Queue &queue = currentPool == this
+                     ? workers[workerIndex]->queues[static_cast<int>(priority)]
+                     : injected[static_cast<int>(priority)];
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.entries.push_back({std::move(task), std::move(token), priority});
+  }
+  ++pending;
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+  }
+  wake.notify_one();
+}
+
+bool TaskPool::pop(std::size_t self, Entry &entry) {
+  std::size_t n = workers.size();
+  for (int p = 0; p < TASK_PRIORITY_COUNT; ++p) {
+    // Own work newest first, everyone else's oldest first
+    {
+      Queue &own = workers[self]->queues[p];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      if (!own.entries.empty()) {
+        entry = std::move(own.entries.back());
+        own.entries.pop_back();
+        return true;
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(injected[p].mutex);
+      if (!injected[p].entries.empty()) {
+        entry = std::move(injected[p].entries.front());
+        injected[p].entries.pop_front();
+        return true;
+      }
+    }
+    for (std::size_t k = 1; k < n; ++k) {
+      Queue &victim = workers[(self + k) % n]->queues[p];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.entries.empty()) {
+        entry = std::move(victim.entries.front());
+        victim.entries.pop_front();
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void TaskPool::run(std::size_t self) {
+  currentPool = this;
+  workerIndex = self;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(sleepMutex);
+      wake.wait(lock, [this] { return stopping || pending > 0; });
+      if (stopping)
+        return;
+    }
+    Entry entry;
+    if (pop(self, entry)) {
+      --pending;
+      execute(entry);
+    } else {
+      // Another worker took it between the wake-up and the pop
+      std::this_thread::yield();
+    }
+  }
+}
+
+void TaskPool::execute(Entry &entry) {
+  if (entry.token.cancelled())
+    return;
+  TaskScope scope(entry.priority, entry.token);
+  entry.task();
+}
+
+void TaskPool::parallelFor(std::size_t count,
+                           const std::function<void(std::size_t)> &fn) {
+  if (count == 0)
+    return;
+
+  const CancelToken &token = scopeToken;
+  std::size_t helpers = std::min<std::size_t>(workers.size(), count) - 1;
+  if (helpers == 0) {
+    for (std::size_t i = 0; i < count && !token.cancelled(); ++i) {
+      fn(i);
+    }
+    return;
+  }
+
+  auto job = std::make_shared<Job>();
+  job->count = count;
+  job->fn = &fn;
+  job->token = token;
+  for (std::size_t h = 0; h < helpers; ++h) {
+    submit(scopePriority, [job] { job->work(); });
+  }
+  job->work();
+  job->finish();
+}
+
+void TaskGroup::submit(TaskPriority priority, std::function<void()> task,
+                       CancelToken token) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++outstanding;
+  }
+  // Released with the last copy of the task, whether it ran or not
+  std::shared_ptr<void> release(nullptr, [this](void *) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--outstanding == 0) {
+      done.notify_all();
+    }
+  });
+  TaskPool::instance().submit(
+      priority,
+      [task = std::move(task), release = std::move(release)]() { task(); },
+      std::move(token));
+}
+
+void TaskGroup::wait() {
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [this] { return outstanding == 0; });
+}
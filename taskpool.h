@@ -0,0 +1,134 @@
+#ifndef TASKPOOL_H
+#define TASKPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Higher classes are always taken first
+enum class TaskPriority { Visible, Prefetch, Batch };
+const int TASK_PRIORITY_COUNT = 3;
+
+// Shared cancellation flag. Work polls cancelled() at convenient points and
+// returns early; nothing is interrupted.
+class CancelToken {
+public:
+  // A token that is never cancelled
+  CancelToken() = default;
+  static CancelToken create() {
+    CancelToken token;
+    token.flag = std::make_shared<std::atomic<bool>>(false);
+    return token;
+  }
+
+  void cancel() const {
+    if (flag)
+      flag->store(true);
+  }
+  bool cancelled() const {
+    return flag && flag->load(std::memory_order_relaxed);
+  }
+
+private:
+  std::shared_ptr<std::atomic<bool>> flag;
+};
+
+// Sets the priority and token that parallelFor calls on this thread pass on
+// to their helpers, until the scope ends. Pool tasks run inside a scope of
+// their own priority and token; any other thread starts at Visible.
+class TaskScope {
+public:
+  explicit TaskScope(TaskPriority priority, CancelToken token = CancelToken());
+  ~TaskScope();
+  TaskScope(const TaskScope &) = delete;
+  TaskScope &operator=(const TaskScope &) = delete;
+
+private:
+  TaskPriority savedPriority;
+  CancelToken savedToken;
+};
+
+// The one set of worker threads for the whole app. Each worker owns a deque
+// per priority class: tasks it submits go on the back of its own deque and
+// are popped from there, idle workers steal from the front of the others',
+// and tasks from other threads go through shared injection queues.
+class TaskPool {
+public:
+  static TaskPool &instance();
+
+  explicit TaskPool(unsigned threads);
+  ~TaskPool();
+  TaskPool(const TaskPool &) = delete;
+  TaskPool &operator=(const TaskPool &) = delete;
+
+  unsigned threadCount() const { return static_cast<unsigned>(workers.size()); }
+
+  // Queues a task. It is dropped unstarted if the token is cancelled first.
+  // Tasks must not throw.
+  void submit(TaskPriority priority, std::function<void()> task,
+              CancelToken token = CancelToken());
+
+  // Runs fn(i) for every i in [0, count), with the calling thread taking
+  // part, and returns when all of them are done. Stops handing out indices
+  // once the current token is cancelled. The first exception thrown by fn is
+  // rethrown here.
+  void parallelFor(std::size_t count,
+                   const std::function<void(std::size_t)> &fn);
+
+  static TaskPriority currentPriority();
+  static const CancelToken &currentToken();
+
+private:
+  struct Entry {
+    std::function<void()> task;
+    CancelToken token;
+    TaskPriority priority;
+  };
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Entry> entries;
+  };
+  struct Worker {
+    Queue queues[TASK_PRIORITY_COUNT];
+    std::thread thread;
+  };
+
+  bool pop(std::size_t self, Entry &entry);
+  void run(std::size_t self);
+  void execute(Entry &entry);
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  Queue injected[TASK_PRIORITY_COUNT];
+  std::atomic<std::size_t> pending{0};
+  std::mutex sleepMutex;
+  std::condition_variable wake;
+  bool stopping = false;
+};
+
+// Tasks submitted to the pool on behalf of one owner, so the owner can wait
+// for those that still use it before it goes away. A task counts until it
+// has run or been dropped unstarted.
+class TaskGroup {
+public:
+  TaskGroup() = default;
+  ~TaskGroup() { wait(); }
+  TaskGroup(const TaskGroup &) = delete;
+  TaskGroup &operator=(const TaskGroup &) = delete;
+
+  void submit(TaskPriority priority, std::function<void()> task,
+              CancelToken token = CancelToken());
+  void wait();
+
+private:
+  std::mutex mutex;
+  std::condition_variable done;
+  std::size_t outstanding = 0;
+};
+
+#endif // TASKPOOL_H
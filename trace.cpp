@@ -0,0 +1,178 @@
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+std::atomic<int> traceFlags(0);
+
+namespace {
+// Per thread; older events are overwritten
+const uint64_t TRACE_BUFFER_EVENTS = 1 << 14;
+
+// Fields are atomics so a dump can read a slot its thread is rewriting;
+// such slots are detected and dropped
+struct TraceEvent {
+  std::atomic<const char *> name{nullptr};
+  std::atomic<uint64_t> start{0};
+  std::atomic<uint64_t> duration{0};
+};
+
+struct TraceBuffer {
+  int thread = 0;
+  // Events ever written; only the owning thread stores it
+  std::atomic<uint64_t> head{0};
+  TraceEvent events[TRACE_BUFFER_EVENTS];
+};
+
+std::mutex buffersMutex;
+// Kept after their threads exit, so their events can still be dumped
+std::vector<std::unique_ptr<TraceBuffer>> buffers;
+thread_local TraceBuffer *threadBuffer = nullptr;
+
+std::atomic<double> metrics[TRACE_METRIC_COUNT];
+
+TraceBuffer *ownBuffer() {
+  if (!threadBuffer) {
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    buffers.push_back(std::make_unique<TraceBuffer>());
+    buffers.back()->thread = static_cast<int>(buffers.size());
+    threadBuffer = buffers.back().get();
+  }
+  return threadBuffer;
+}
+
+void setFlag(int flag, bool on) {
+  if (on) {
+    traceFlags.fetch_or(flag);
+  } else {
+    traceFlags.fetch_and(~flag);
+  }
+}
+
+void writeEscaped(std::FILE *file, const char *text) {
+  for (; *text; ++text) {
+    if (*text == '"' || *text == '\\') {
+      std::fputc('\\', file);
+    }
+    std::fputc(*text, file);
+  }
+}
+}
+
+void setTraceRecording(bool on) { setFlag(TRACE_RECORDING, on); }
+
+void setTraceMetrics(bool on) { setFlag(TRACE_METRICS, on); }
+
+uint64_t traceNow() {
+  return static_cast<uint64_t>(
+             std::chrono::duration_cast<std::chrono::nanoseconds>(
+                 std::chrono::steady_clock::now().time_since_epoch())
+                 .count()) |
+         1;
+}
+
+void recordTrace(const char *name, uint64_t start, uint64_t duration,
+                 TraceMetric metric) {
+  int flags = traceFlags.load(std::memory_order_relaxed);
+  if (flags & TRACE_RECORDING) {
+    TraceBuffer *buffer = ownBuffer();
+    uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    TraceEvent &event = buffer->events[head % TRACE_BUFFER_EVENTS];
+    event.name.store(name, std::memory_order_relaxed);
+    event.start.store(start, std::memory_order_relaxed);
+    event.duration.store(duration, std::memory_order_relaxed);
+    buffer->head.store(head + 1, std::memory_order_release);
+  }
+  if ((flags & TRACE_METRICS) && metric != TraceMetric::None) {
+    metrics[static_cast<int>(metric)].store(duration * 1e-6,
+                                            std::memory_order_relaxed);
+  }
+}
+
+void setTraceMetric(TraceMetric metric, double value) {
+  if (traceFlags.load(std::memory_order_relaxed) & TRACE_METRICS) {
+    metrics[static_cast<int>(metric)].store(value, std::memory_order_relaxed);
+  }
+}
+
+double traceMetric(TraceMetric metric) {
+  return metrics[static_cast<int>(metric)].load(std::memory_order_relaxed);
+}
+
+void writeChromeTrace(const std::string &path) {
+  struct Copied {
+    int thread;
+    const char *name;
+    uint64_t start;
+    uint64_t duration;
+  };
+  std::vector<Copied> copied;
+  {
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    for (const auto &buffer : buffers) {
+      uint64_t head = buffer->head.load(std::memory_order_acquire);
+      uint64_t first =
+          head > TRACE_BUFFER_EVENTS ? head - TRACE_BUFFER_EVENTS : 0;
+      std::size_t begin = copied.size();
+      for (uint64_t i = first; i < head; ++i) {
+        const TraceEvent &event = buffer->events[i % TRACE_BUFFER_EVENTS];
+        copied.push_back({buffer->thread,
+                          event.name.load(std::memory_order_relaxed),
+                          event.start.load(std::memory_order_relaxed),
+                          event.duration.load(std::memory_order_relaxed)});
+      }
+      // Slots the thread wrapped onto while they were copied, including the
+      // one it may be writing now
+      uint64_t after = buffer->head.load(std::memory_order_acquire) + 1;
+      uint64_t overwritten = after > TRACE_BUFFER_EVENTS + first
+                                 ? after - TRACE_BUFFER_EVENTS - first
+                                 : 0;
+      overwritten = std::min<uint64_t>(overwritten, copied.size() - begin);
+      copied.erase(copied.begin() + begin,
+                   copied.begin() + begin + overwritten);
+    }
+  }
+
+  std::FILE *file = std::fopen(path.c_str(), "w");
+  if (!file) {
+    throw std::runtime_error("Cannot write " + path);
+  }
+  uint64_t origin = ~uint64_t(0);
+  for (const Copied &event : copied) {
+    if (event.name) {
+      origin = std::min(origin, event.start);
+    }
+  }
+  std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+  bool first = true;
+  for (const Copied &event : copied) {
+    if (!event.name)
+      continue;
+    std::fputs(first ? "\n{\"name\":\"" : ",\n{\"name\":\"", file);
+    first = false;
+    writeEscaped(file, event.name);
+    std::fprintf(file,
+                 "\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,"
+                 "\"dur\":%.3f}",
+                 event.thread, (event.start - origin) * 1e-3,
+                 event.duration * 1e-3);
+  }
+  std::fputs("\n]}\n", file);
+  if (std::fclose(file) != 0) {
+    throw std::runtime_error("Cannot write " + path);
+  }
+}
+
+void clearTrace() {
+  std::lock_guard<std::mutex> lock(buffersMutex);
+  // Only the owners move their heads, so the slots are blanked instead
+  for (const auto &buffer : buffers) {
+    for (TraceEvent &event : buffer->events) {
+      event.name.store(nullptr, std::memory_order_relaxed);
+    }
+  }
+}
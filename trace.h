@@ -0,0 +1,61 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Latest values for the performance overlay
+enum class TraceMetric { None, FrameMs, ReplotMs, LoadMBps };
+const int TRACE_METRIC_COUNT = 4;
+
+const int TRACE_RECORDING = 1;
+const int TRACE_METRICS = 2;
+extern std::atomic<int> traceFlags;
+
+// Both switches start off. While neither is on, a ScopedTrace costs one
+// relaxed load and a branch.
+inline bool traceActive() {
+  return traceFlags.load(std::memory_order_relaxed) != 0;
+}
+void setTraceRecording(bool on);
+void setTraceMetrics(bool on);
+
+// Steady-clock nanoseconds, never zero
+uint64_t traceNow();
+
+// Appends a complete event to the calling thread's ring buffer when
+// recording, and updates the metric when metrics are on. name must outlive
+// the trace, which string literals do.
+void recordTrace(const char *name, uint64_t start, uint64_t duration,
+                 TraceMetric metric = TraceMetric::None);
+void setTraceMetric(TraceMetric metric, double value);
+double traceMetric(TraceMetric metric);
+
+// Writes the events still held by every thread's ring buffer as a Chrome
+// trace (chrome://tracing, Perfetto). Throws std::runtime_error when the
+// file cannot be written.
+void writeChromeTrace(const std::string &path);
+void clearTrace();
+
+// Times its own lifetime as one event
+class ScopedTrace {
+public:
+  explicit ScopedTrace(const char *name,
+                       TraceMetric metric = TraceMetric::None)
+      : name(name), metric(metric), start(traceActive() ? traceNow() : 0) {}
+  ~ScopedTrace() {
+    if (start != 0) {
+      recordTrace(name, start, traceNow() - start, metric);
+    }
+  }
+  ScopedTrace(const ScopedTrace &) = delete;
+  ScopedTrace &operator=(const ScopedTrace &) = delete;
+
+private:
+  const char *name;
+  TraceMetric metric;
+  uint64_t start;
+};
+
+#endif // TRACE_H